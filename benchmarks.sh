@@ -25,13 +25,15 @@ while getopts "hlpnj" option; do
   esac
 done
 
+shift $((OPTIND - 1))
+
 echo
 
 if [ $HYMN = true ]; then
   echo 'HYMN'
-  for file in test/benchmarks/*.hm; do
-    printf '> %s: %s\n' "$(basename "$file" .hm)" "$(./hymn "$file")"
-  done
+  mkdir -p objects
+  gcc test/benchmarks/runner.c -std=c11 -O2 -o objects/runner -lm || exit 1
+  objects/runner "$@"
   echo $'----------------------------------------\n'
 fi
 
@@ -3,9 +3,135 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 #include "hymn.h"
+#include "hymn_super.h"
+
+typedef struct MemoryHead MemoryHead;
+
+struct MemoryHead {
+    Hymn *owner;
+    size_t size;
+};
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static __declspec(thread) Hymn *active = NULL;
+static __declspec(thread) const char *allocation_kind = NULL;
+#define ATOMIC_INCREMENT(count) _InterlockedIncrement((volatile long *)&(count))
+#define ATOMIC_DECREMENT(count) _InterlockedDecrement((volatile long *)&(count))
+#define ATOMIC_ADD_64(count, value) _InterlockedExchangeAdd64((volatile __int64 *)&(count), (__int64)(value))
+#define ALWAYS_INLINE __forceinline
+#else
+static _Thread_local Hymn *active = NULL;
+static _Thread_local const char *allocation_kind = NULL;
+#define ATOMIC_INCREMENT(count) __atomic_add_fetch(&(count), 1, __ATOMIC_RELAXED)
+#define ATOMIC_DECREMENT(count) __atomic_sub_fetch(&(count), 1, __ATOMIC_ACQ_REL)
+#define ATOMIC_ADD_64(count, value) __atomic_add_fetch(&(count), (value), __ATOMIC_RELAXED)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#endif
+
+#define ALLOCATION_KIND(kind) allocation_kind = kind
+
+static Hymn frozen_owner;
+static int64_t frozen_memory = 0;
+static size_t frozen_limit = 0;
+
+static void memory_add(Hymn *H, size_t size) {
+    H->memory += size;
+    if (H->memory > H->memory_peak) {
+        H->memory_peak = H->memory;
+    }
+    if (H->memory_limit != 0 && H->memory > H->memory_limit) {
+        H->memory_exceeded = true;
+        H->interrupt = 1;
+    }
+}
+
+static bool memory_refuse(Hymn *H, size_t size, size_t previous) {
+    if (H == NULL || H->memory_limit == 0 || size <= previous) {
+        return false;
+    }
+    size_t memory = H->memory - previous;
+    if (memory <= H->memory_limit && size <= H->memory_limit - memory) {
+        return false;
+    }
+    H->memory_exceeded = true;
+    return true;
+}
+
+static void *memory_allocate(size_t size, bool zero, bool limited) {
+    if (size > SIZE_MAX - sizeof(MemoryHead)) {
+        return NULL;
+    }
+    size_t total = sizeof(MemoryHead) + size;
+    Hymn *H = active;
+    if (limited && memory_refuse(H, size, 0)) {
+        allocation_kind = NULL;
+        return NULL;
+    }
+    MemoryHead *head;
+    if (H != NULL && H->allocator.allocate != NULL) {
+        head = H->allocator.allocate(H->allocator.user, total);
+        if (head != NULL && zero) {
+            memset(head, 0, total);
+        }
+    } else {
+        head = zero ? calloc(1, total) : malloc(total);
+    }
+    if (head == NULL) {
+        return NULL;
+    }
+    head->owner = H;
+    head->size = size;
+    if (H == &frozen_owner) {
+        ATOMIC_ADD_64(frozen_memory, (int64_t)size);
+    } else if (H != NULL) {
+        memory_add(H, size);
+        if (H->allocated != NULL) {
+            H->allocated(H, size, allocation_kind);
+        }
+    }
+    allocation_kind = NULL;
+    return head + 1;
+}
+
+static void *memory_reallocate(void *mem, size_t size, bool limited) {
+    if (mem == NULL) {
+        return memory_allocate(size, false, limited);
+    } else if (size > SIZE_MAX - sizeof(MemoryHead)) {
+        return NULL;
+    }
+    size_t total = sizeof(MemoryHead) + size;
+    MemoryHead *head = (MemoryHead *)mem - 1;
+    Hymn *H = head->owner;
+    size_t previous = head->size;
+    if (limited && memory_refuse(H, size, previous)) {
+        allocation_kind = NULL;
+        return NULL;
+    }
+    if (H != NULL && H->allocator.reallocate != NULL) {
+        head = H->allocator.reallocate(H->allocator.user, head, total);
+    } else {
+        head = realloc(head, total);
+    }
+    if (head == NULL) {
+        return NULL;
+    }
+    head->size = size;
+    if (H == &frozen_owner) {
+        ATOMIC_ADD_64(frozen_memory, (int64_t)size - (int64_t)previous);
+    } else if (H != NULL) {
+        H->memory -= previous;
+        memory_add(H, size);
+        if (H->allocated != NULL && size > previous) {
+            H->allocated(H, size - previous, allocation_kind);
+        }
+    }
+    allocation_kind = NULL;
+    return head + 1;
+}
 
 void *hymn_malloc(size_t size) {
-    void *mem = malloc(size);
+    void *mem = memory_allocate(size, false, false);
     if (mem) {
         return mem;
     }
@@ -14,7 +140,11 @@ void *hymn_malloc(size_t size) {
 }
 
 void *hymn_calloc(size_t count, size_t size) {
-    void *mem = calloc(count, size);
+    if (size != 0 && count > SIZE_MAX / size) {
+        fprintf(stderr, "calloc overflow.\n");
+        exit(1);
+    }
+    void *mem = memory_allocate(count * size, true, false);
     if (mem) {
         return mem;
     }
@@ -23,7 +153,7 @@ void *hymn_calloc(size_t count, size_t size) {
 }
 
 void *hymn_realloc(void *mem, size_t size) {
-    mem = realloc(mem, size);
+    mem = memory_reallocate(mem, size, false);
     if (mem) {
         return mem;
     }
@@ -36,7 +166,7 @@ void *hymn_malloc_int(int count, size_t size) {
         fprintf(stderr, "malloc negative count.\n");
         exit(1);
     }
-    void *mem = malloc((size_t)count * size);
+    void *mem = memory_allocate((size_t)count * size, false, false);
     if (mem) {
         return mem;
     }
@@ -49,7 +179,7 @@ void *hymn_calloc_int(int count, size_t size) {
         fprintf(stderr, "calloc negative count.\n");
         exit(1);
     }
-    void *mem = calloc((size_t)count, size);
+    void *mem = memory_allocate((size_t)count * size, true, false);
     if (mem) {
         return mem;
     }
@@ -62,7 +192,43 @@ void *hymn_realloc_int(void *mem, int count, size_t size) {
         fprintf(stderr, "realloc negative count.\n");
         exit(1);
     }
-    mem = realloc(mem, (size_t)count * size);
+    mem = memory_reallocate(mem, (size_t)count * size, false);
+    if (mem) {
+        return mem;
+    }
+    fprintf(stderr, "realloc failed.\n");
+    exit(1);
+}
+
+void hymn_free(void *mem) {
+    if (mem == NULL) {
+        return;
+    }
+    MemoryHead *head = (MemoryHead *)mem - 1;
+    Hymn *H = head->owner;
+    if (H == &frozen_owner) {
+        ATOMIC_ADD_64(frozen_memory, -(int64_t)head->size);
+    } else if (H != NULL) {
+        H->memory -= head->size;
+        if (H->allocator.release != NULL) {
+            H->allocator.release(H->allocator.user, head);
+            return;
+        }
+    }
+    free(head);
+}
+
+static void *system_malloc(size_t size) {
+    void *mem = malloc(size);
+    if (mem) {
+        return mem;
+    }
+    fprintf(stderr, "malloc failed.\n");
+    exit(1);
+}
+
+static void *system_realloc(void *mem, size_t size) {
+    mem = realloc(mem, size);
     if (mem) {
         return mem;
     }
@@ -88,8 +254,122 @@ FILE *hymn_open_file(const char *path, const char *mode) {
 #endif
 }
 
+#define CENSUS_TOMBSTONE ((void *)1)
+#define CENSUS_SHARED -1
+
+typedef struct CensusEntry CensusEntry;
+
+struct CensusEntry {
+    void *key;
+    size_t size;
+    int root;
+    enum HymnValueType is;
+};
+
+struct HymnCensus {
+    unsigned int count;
+    unsigned int used;
+    unsigned int capacity;
+    char padding[4];
+    CensusEntry *entries;
+};
+
+static unsigned int census_hash(void *pointer) {
+    uintptr_t bits = (uintptr_t)pointer;
+    return (unsigned int)((bits >> 4) ^ (bits >> 20)) * 2654435761u;
+}
+
+static CensusEntry *census_find(HymnCensus *this, void *key) {
+    if (this->capacity == 0) {
+        return NULL;
+    }
+    unsigned int mask = this->capacity - 1;
+    unsigned int index = census_hash(key) & mask;
+    while (true) {
+        CensusEntry *entry = &this->entries[index];
+        if (entry->key == key) {
+            return entry;
+        } else if (entry->key == NULL) {
+            return NULL;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+static void census_resize(HymnCensus *this) {
+    unsigned int old_capacity = this->capacity;
+    CensusEntry *old_entries = this->entries;
+    unsigned int capacity = old_capacity == 0 ? 64 : (this->count * 4 > old_capacity ? old_capacity << 1U : old_capacity);
+    this->capacity = capacity;
+    this->entries = system_malloc(capacity * sizeof(CensusEntry));
+    memset(this->entries, 0, capacity * sizeof(CensusEntry));
+    this->used = this->count;
+    unsigned int mask = capacity - 1;
+    for (unsigned int i = 0; i < old_capacity; i++) {
+        CensusEntry *old = &old_entries[i];
+        if (old->key == NULL || old->key == CENSUS_TOMBSTONE) {
+            continue;
+        }
+        unsigned int index = census_hash(old->key) & mask;
+        while (this->entries[index].key != NULL) {
+            index = (index + 1) & mask;
+        }
+        this->entries[index] = *old;
+    }
+    free(old_entries);
+}
+
+static CensusEntry *census_insert(HymnCensus *this, void *key, bool *added) {
+    CensusEntry *entry = census_find(this, key);
+    if (entry != NULL) {
+        *added = false;
+        return entry;
+    }
+    if ((this->used + 1) * 4 > this->capacity * 3) {
+        census_resize(this);
+    }
+    unsigned int mask = this->capacity - 1;
+    unsigned int index = census_hash(key) & mask;
+    while (this->entries[index].key != NULL && this->entries[index].key != CENSUS_TOMBSTONE) {
+        index = (index + 1) & mask;
+    }
+    entry = &this->entries[index];
+    if (entry->key == NULL) {
+        this->used++;
+    }
+    this->count++;
+    memset(entry, 0, sizeof(CensusEntry));
+    entry->key = key;
+    *added = true;
+    return entry;
+}
+
+static void census_track(void *object, enum HymnValueType is) {
+    Hymn *H = active;
+    if (H != NULL && H->census != NULL) {
+        bool added;
+        census_insert(H->census, object, &added)->is = is;
+    }
+}
+
+static void census_untrack(Hymn *H, void *object) {
+    if (H != NULL && H->census != NULL) {
+        CensusEntry *entry = census_find(H->census, object);
+        if (entry != NULL) {
+            entry->key = CENSUS_TOMBSTONE;
+            H->census->count--;
+        }
+    }
+}
+
+static void census_release(HymnCensus *this) {
+    free(this->entries);
+    free(this);
+}
+
 static HymnStringHead *string_head_init(size_t length, size_t capacity) {
     size_t memory = sizeof(HymnStringHead) + capacity + 1;
+    ALLOCATION_KIND("string");
     HymnStringHead *head = (HymnStringHead *)hymn_malloc(memory);
     memset(head, 0, memory);
     head->length = length;
@@ -97,6 +377,20 @@ static HymnStringHead *string_head_init(size_t length, size_t capacity) {
     return head;
 }
 
+static HymnString *string_limited(size_t length) {
+    if (length > SIZE_MAX - sizeof(HymnStringHead) - 1) {
+        return NULL;
+    }
+    ALLOCATION_KIND("string");
+    HymnStringHead *head = memory_allocate(sizeof(HymnStringHead) + length + 1, true, true);
+    if (head == NULL) {
+        return NULL;
+    }
+    head->length = length;
+    head->capacity = length;
+    return (HymnString *)(head + 1);
+}
+
 HymnString *hymn_new_string_with_capacity(size_t capacity) {
     HymnStringHead *head = string_head_init(0, capacity);
     return (HymnString *)(head + 1);
@@ -171,7 +465,7 @@ void hymn_string_delete(HymnString *string) {
     if (string == NULL) {
         return;
     }
-    free((char *)string - sizeof(HymnStringHead));
+    hymn_free((char *)string - sizeof(HymnStringHead));
 }
 
 void hymn_string_zero(HymnString *string) {
@@ -182,6 +476,7 @@ void hymn_string_zero(HymnString *string) {
 
 static HymnStringHead *string_resize(HymnStringHead *head, size_t capacity) {
     size_t memory = sizeof(HymnStringHead) + capacity + 1;
+    ALLOCATION_KIND("string");
     HymnStringHead *new = hymn_realloc(head, memory);
     new->capacity = capacity;
     return new;
@@ -309,7 +604,7 @@ HymnString *hymn_int_to_string(HymnInt number) {
     char *str = hymn_malloc(len + 1);
     snprintf(str, len + 1, "%lld", number);
     HymnString *s = hymn_new_string_with_length(str, len);
-    free(str);
+    hymn_free(str);
     return s;
 }
 
@@ -318,13 +613,13 @@ HymnString *hymn_float_to_string(HymnFloat number) {
     char *str = hymn_malloc(len + 1);
     snprintf(str, len + 1, "%g", number);
     HymnString *s = hymn_new_string_with_length(str, len);
-    free(str);
+    hymn_free(str);
     return s;
 }
 
 static char *string_to_chars(HymnString *this) {
     size_t len = hymn_string_len(this);
-    char *s = hymn_malloc((len + 1) * sizeof(char));
+    char *s = system_malloc((len + 1) * sizeof(char));
     memcpy(s, this, len);
     s[len] = '\0';
     return s;
@@ -341,7 +636,7 @@ HymnString *hymn_string_format(const char *format, ...) {
     len = (size_t)vsnprintf(chars, len + 1, format, args);
     va_end(args);
     HymnString *str = hymn_new_string_with_length(chars, len);
-    free(chars);
+    hymn_free(chars);
     return str;
 }
 
@@ -356,7 +651,7 @@ static HymnString *string_append_format(HymnString *this, const char *format, ..
     len = (size_t)vsnprintf(chars, len + 1, format, args);
     va_end(args);
     this = hymn_string_append(this, chars);
-    free(chars);
+    hymn_free(chars);
     return this;
 }
 
@@ -459,9 +754,10 @@ size_t hymn_file_size(const char *path) {
         return 0;
     }
     size_t size = 0;
-    int ch;
-    while ((ch = fgetc(open)) != EOF) {
-        size++;
+    size_t read;
+    char buffer[4096];
+    while ((read = fread(buffer, 1, sizeof(buffer), open)) > 0) {
+        size += read;
     }
     fclose(open);
     return size;
@@ -475,11 +771,10 @@ HymnString *hymn_read_file(const char *path) {
     }
     HymnString *string = hymn_new_string_with_capacity(size);
     HymnStringHead *head = hymn_string_head(string);
-    for (size_t i = 0; i < size; i++) {
-        string[i] = (char)fgetc(open);
-    }
+    size_t length = fread(string, 1, size, open);
     fclose(open);
-    head->length = size;
+    string[length] = '\0';
+    head->length = length;
     return string;
 }
 
@@ -504,6 +799,7 @@ typedef struct Local Local;
 typedef struct Rule Rule;
 typedef struct Scope Scope;
 typedef struct Compiler Compiler;
+typedef struct ImportList ImportList;
 typedef struct CompileResult CompileResult;
 
 typedef struct Instruction Instruction;
@@ -513,6 +809,8 @@ static const float LOAD_FACTOR = 0.80f;
 static const unsigned int INITIAL_BINS = 1 << 3;
 static const unsigned int MAXIMUM_BINS = 1 << 30;
 
+static const int FRAME_STACK = HYMN_UINT8_COUNT * 2;
+
 enum TokenType {
     TOKEN_ADD,
     TOKEN_AND,
@@ -557,6 +855,7 @@ enum TokenType {
     TOKEN_FLOAT,
     TOKEN_FOR,
     TOKEN_FORMAT,
+    TOKEN_FREEZE,
     TOKEN_FUNCTION,
     TOKEN_GREATER,
     TOKEN_GREATER_EQUAL,
@@ -602,6 +901,7 @@ enum TokenType {
     TOKEN_USE,
     TOKEN_VALUE,
     TOKEN_WHILE,
+    TOKEN_YIELD,
 };
 
 enum Precedence {
@@ -650,6 +950,7 @@ enum OpCode {
     OP_STACK,
     OP_REFERENCE,
     OP_FORMAT,
+    OP_FREEZE,
     OP_DEFINE_GLOBAL,
     OP_DELETE,
     OP_DIVIDE,
@@ -716,11 +1017,15 @@ enum OpCode {
     OP_FOR,
     OP_FOR_LOOP,
     OP_VOID,
+    OP_YIELD,
+    HYMN_SUPER_OPCODES
+    OPCODES,
 };
 
 enum FunctionType {
     TYPE_FUNCTION,
     TYPE_SCRIPT,
+    TYPE_MODULE,
     TYPE_DIRECT,
     TYPE_REPL,
 };
@@ -752,6 +1057,8 @@ static void cast_float_expression(Compiler *C, bool assign);
 static void cast_string_expression(Compiler *C, bool assign);
 static void clear_expression(Compiler *C, bool assign);
 static void copy_expression(Compiler *C, bool assign);
+static void freeze_expression(Compiler *C, bool assign);
+static void yield_expression(Compiler *C, bool assign);
 static void index_expression(Compiler *C, bool assign);
 static void keys_expression(Compiler *C, bool assign);
 static void type_expression(Compiler *C, bool assign);
@@ -841,7 +1148,16 @@ struct Compiler {
     int string_format;
     enum StringStatus string_status;
     bool interactive;
-    char padding[7];
+    bool lazy;
+    char padding[6];
+    HymnCompileStats *stats;
+    ImportList *uses;
+};
+
+struct ImportList {
+    HymnString **items;
+    int count;
+    int capacity;
 };
 
 struct CompileResult {
@@ -913,6 +1229,10 @@ void *hymn_as_pointer(HymnValue v) {
     return (v).as.p;
 }
 
+HymnCoroutine *hymn_as_coroutine(HymnValue v) {
+    return (HymnCoroutine *)(v).as.o;
+}
+
 void *hymn_as_object(HymnValue v) {
     return (void *)(v).as.o;
 }
@@ -965,6 +1285,10 @@ bool hymn_is_pointer(HymnValue v) {
     return (v).is == HYMN_VALUE_POINTER;
 }
 
+bool hymn_is_coroutine(HymnValue v) {
+    return (v).is == HYMN_VALUE_COROUTINE;
+}
+
 bool hymn_is_string(HymnValue v) {
     return (v).is == HYMN_VALUE_STRING;
 }
@@ -981,7 +1305,7 @@ bool hymn_is_func(HymnValue v) {
     return (v).is == HYMN_VALUE_FUNC;
 }
 
-static Rule rules[] = {
+static const Rule rules[] = {
     [TOKEN_ADD] = {NULL, compile_binary, PRECEDENCE_TERM, {0}},
     [TOKEN_AND] = {NULL, compile_and, PRECEDENCE_AND, {0}},
     [TOKEN_ASSIGN] = {NULL, NULL, PRECEDENCE_NONE, {0}},
@@ -1007,6 +1331,7 @@ static Rule rules[] = {
     [TOKEN_COMMA] = {NULL, NULL, PRECEDENCE_NONE, {0}},
     [TOKEN_CONTINUE] = {NULL, NULL, PRECEDENCE_NONE, {0}},
     [TOKEN_COPY] = {copy_expression, NULL, PRECEDENCE_NONE, {0}},
+    [TOKEN_FREEZE] = {freeze_expression, NULL, PRECEDENCE_NONE, {0}},
     [TOKEN_OPCODES] = {opcode_expression, NULL, PRECEDENCE_NONE, {0}},
     [TOKEN_STACK] = {stack_expression, NULL, PRECEDENCE_NONE, {0}},
     [TOKEN_REFERENCE] = {reference_expression, NULL, PRECEDENCE_NONE, {0}},
@@ -1070,6 +1395,7 @@ static Rule rules[] = {
     [TOKEN_USE] = {NULL, NULL, PRECEDENCE_NONE, {0}},
     [TOKEN_VALUE] = {NULL, NULL, PRECEDENCE_NONE, {0}},
     [TOKEN_WHILE] = {NULL, NULL, PRECEDENCE_NONE, {0}},
+    [TOKEN_YIELD] = {yield_expression, NULL, PRECEDENCE_NONE, {0}},
 };
 
 const char *hymn_value_type(enum HymnValueType type) {
@@ -1085,6 +1411,7 @@ const char *hymn_value_type(enum HymnValueType type) {
     case HYMN_VALUE_FUNC: return "function";
     case HYMN_VALUE_FUNC_NATIVE: return "native";
     case HYMN_VALUE_POINTER: return "pointer";
+    case HYMN_VALUE_COROUTINE: return "coroutine";
     default: return "?";
     }
 }
@@ -1108,6 +1435,7 @@ static unsigned int string_mix_code_const(const char *key) {
 }
 
 static HymnObjectString *new_hymn_string_with_hash(HymnString *string, unsigned int hash) {
+    ALLOCATION_KIND("string");
     HymnObjectString *object = hymn_calloc(1, sizeof(HymnObjectString));
     object->hash = hash;
     object->string = string;
@@ -1121,6 +1449,7 @@ HymnObjectString *hymn_new_string_object(HymnString *string) {
 static void table_init(HymnTable *this) {
     this->size = 0;
     this->bins = INITIAL_BINS;
+    ALLOCATION_KIND("table");
     this->items = hymn_calloc(this->bins, sizeof(HymnTableItem *));
 }
 
@@ -1128,17 +1457,9 @@ static unsigned int table_get_bin(HymnTable *this, unsigned int hash) {
     return (this->bins - 1U) & hash;
 }
 
-static void table_resize(HymnTable *this) {
+static void table_rehash(HymnTable *this, HymnTableItem **items, unsigned int bins) {
     unsigned int old_bins = this->bins;
-
-    if (old_bins >= MAXIMUM_BINS) {
-        return;
-    }
-
-    unsigned int bins = old_bins << 1U;
-
     HymnTableItem **old_items = this->items;
-    HymnTableItem **items = hymn_calloc(bins, sizeof(HymnTableItem *));
 
     for (unsigned int i = 0; i < old_bins; i++) {
         HymnTableItem *item = old_items[i];
@@ -1183,12 +1504,37 @@ static void table_resize(HymnTable *this) {
         }
     }
 
-    free(old_items);
+    hymn_free(old_items);
 
     this->bins = bins;
     this->items = items;
 }
 
+static void table_resize(HymnTable *this) {
+    if (this->bins >= MAXIMUM_BINS) {
+        return;
+    }
+    unsigned int bins = this->bins << 1U;
+    ALLOCATION_KIND("table");
+    table_rehash(this, hymn_calloc(bins, sizeof(HymnTableItem *)), bins);
+}
+
+static bool table_reserve(HymnTable *this) {
+    if (memory_refuse(active, sizeof(HymnTableItem), 0)) {
+        return false;
+    } else if (this->size + 1 < (int)((float)this->bins * LOAD_FACTOR) || this->bins >= MAXIMUM_BINS) {
+        return true;
+    }
+    unsigned int bins = this->bins << 1U;
+    ALLOCATION_KIND("table");
+    HymnTableItem **items = memory_allocate(bins * sizeof(HymnTableItem *), true, true);
+    if (items == NULL) {
+        return false;
+    }
+    table_rehash(this, items, bins);
+    return true;
+}
+
 static HymnValue table_put(HymnTable *this, HymnObjectString *key, HymnValue value) {
     unsigned int bin = table_get_bin(this, key->hash);
     HymnTableItem *item = this->items[bin];
@@ -1202,6 +1548,7 @@ static HymnValue table_put(HymnTable *this, HymnObjectString *key, HymnValue val
         previous = item;
         item = item->next;
     }
+    ALLOCATION_KIND("table");
     item = hymn_malloc(sizeof(HymnTableItem));
     item->key = key;
     item->value = value;
@@ -1227,6 +1574,15 @@ static HymnValue table_get(HymnTable *this, HymnObjectString *key) {
         }
         item = item->next;
     }
+    if (this->frozen) {
+        item = this->items[bin];
+        while (item != NULL) {
+            if (key->hash == item->key->hash && hymn_string_equal(key->string, item->key->string)) {
+                return item->value;
+            }
+            item = item->next;
+        }
+    }
     return hymn_new_undefined();
 }
 
@@ -1276,6 +1632,10 @@ static HymnTableItem *table_next(HymnTable *this, HymnObjectString *key) {
     return NULL;
 }
 
+HymnTableItem *hymn_table_next(HymnTable *table, HymnObjectString *key) {
+    return table_next(table, key);
+}
+
 static HymnValue table_remove(HymnTable *this, HymnObjectString *key) {
     unsigned int bin = table_get_bin(this, key->hash);
     HymnTableItem *item = this->items[bin];
@@ -1288,7 +1648,7 @@ static HymnValue table_remove(HymnTable *this, HymnObjectString *key) {
                 previous->next = item->next;
             }
             HymnValue value = item->value;
-            free(item);
+            hymn_free(item);
             this->size--;
             return value;
         }
@@ -1307,7 +1667,7 @@ static void table_clear(Hymn *H, HymnTable *this) {
             HymnTableItem *next = item->next;
             hymn_dereference(H, item->value);
             hymn_dereference_string(H, item->key);
-            free(item);
+            hymn_free(item);
             item = next;
         }
         this->items[i] = NULL;
@@ -1316,12 +1676,13 @@ static void table_clear(Hymn *H, HymnTable *this) {
 
 static void table_release(Hymn *H, HymnTable *this) {
     table_clear(H, this);
-    free(this->items);
+    hymn_free(this->items);
 }
 
 static void table_delete(Hymn *H, HymnTable *this) {
+    census_untrack(H, this);
     table_release(H, this);
-    free(this);
+    hymn_free(this);
 }
 
 void hymn_set_property(Hymn *H, HymnTable *table, HymnObjectString *name, HymnValue value) {
@@ -1342,6 +1703,7 @@ void hymn_set_property_const(Hymn *H, HymnTable *table, const char *name, HymnVa
 static void set_init(HymnSet *this) {
     this->size = 0;
     this->bins = INITIAL_BINS;
+    ALLOCATION_KIND("string");
     this->items = hymn_calloc(this->bins, sizeof(HymnSetItem *));
 }
 
@@ -1359,6 +1721,7 @@ static void set_resize(HymnSet *this) {
     unsigned int bins = old_bins << 1U;
 
     HymnSetItem **old_items = this->items;
+    ALLOCATION_KIND("string");
     HymnSetItem **items = hymn_calloc(bins, sizeof(HymnSetItem *));
 
     for (unsigned int i = 0; i < old_bins; i++) {
@@ -1404,7 +1767,7 @@ static void set_resize(HymnSet *this) {
         }
     }
 
-    free(old_items);
+    hymn_free(old_items);
 
     this->bins = bins;
     this->items = items;
@@ -1423,6 +1786,7 @@ static HymnObjectString *set_add_or_get(HymnSet *this, HymnString *add) {
         item = item->next;
     }
     HymnObjectString *new = new_hymn_string_with_hash(add, hash);
+    ALLOCATION_KIND("string");
     item = hymn_malloc(sizeof(HymnSetItem));
     item->string = new;
     item->next = NULL;
@@ -1451,7 +1815,7 @@ static HymnObjectString *set_remove(HymnSet *this, HymnString *remove) {
                 previous->next = item->next;
             }
             HymnObjectString *string = item->string;
-            free(item);
+            hymn_free(item);
             this->size--;
             return string;
         }
@@ -1487,7 +1851,7 @@ static void compile_error(Compiler *C, Token *token, const char *format, ...) {
     HymnString *error = hymn_new_string_with_capacity(len + 128);
     error = hymn_string_append(error, chars);
 
-    free(chars);
+    hymn_free(chars);
 
     if (token->type != TOKEN_EOF && token->length > 0) {
         const char *source = C->source;
@@ -1657,6 +2021,9 @@ static enum TokenType ident_keyword(const char *ident, size_t size) {
     case 'w':
         if (size == 5) return ident_trie(ident, 1, "hile", TOKEN_WHILE);
         break;
+    case 'y':
+        if (size == 5) return ident_trie(ident, 1, "ield", TOKEN_YIELD);
+        break;
     case 'b':
         if (size == 5) return ident_trie(ident, 1, "reak", TOKEN_BREAK);
         break;
@@ -1732,6 +2099,7 @@ static enum TokenType ident_keyword(const char *ident, size_t size) {
             if (ident[1] == 'a') return ident_trie(ident, 2, "lse", TOKEN_FALSE);
             if (ident[1] == 'l') return ident_trie(ident, 2, "oat", TOKEN_TO_FLOAT);
         }
+        if (size == 6) return ident_trie(ident, 1, "reeze", TOKEN_FREEZE);
         break;
     case 'S':
         if (size == 5) return ident_trie(ident, 1, "TACK", TOKEN_STACK);
@@ -1847,7 +2215,13 @@ static void parse_string(Compiler *C, size_t start) {
     value_token(C, TOKEN_STRING, start, end);
 }
 
-static void advance(Compiler *C) {
+static int64_t compile_clock(void) {
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+    return (int64_t)time.tv_sec * 1000000000 + (int64_t)time.tv_nsec;
+}
+
+static void lex(Compiler *C) {
     C->previous = C->current;
     if (C->previous.type == TOKEN_EOF) {
         return;
@@ -2164,6 +2538,16 @@ static void advance(Compiler *C) {
     }
 }
 
+static void advance(Compiler *C) {
+    if (C->stats == NULL) {
+        lex(C);
+        return;
+    }
+    int64_t start = compile_clock();
+    lex(C);
+    C->stats->lex += compile_clock() - start;
+}
+
 bool hymn_value_false(HymnValue value) {
     switch (value.is) {
     case HYMN_VALUE_NONE: return true;
@@ -2179,6 +2563,13 @@ bool hymn_value_false(HymnValue value) {
     }
 }
 
+static bool strings_equal(HymnObjectString *a, HymnObjectString *b) {
+    if (a == b) {
+        return true;
+    }
+    return (a->frozen || b->frozen) && a->hash == b->hash && hymn_string_equal(a->string, b->string);
+}
+
 bool hymn_values_equal(HymnValue a, HymnValue b) {
     switch (a.is) {
     case HYMN_VALUE_NONE: return hymn_is_none(b);
@@ -2196,10 +2587,12 @@ bool hymn_values_equal(HymnValue a, HymnValue b) {
         default: return false;
         }
     case HYMN_VALUE_STRING:
+        return hymn_is_string(b) && strings_equal(hymn_as_hymn_string(a), hymn_as_hymn_string(b));
     case HYMN_VALUE_ARRAY:
     case HYMN_VALUE_TABLE:
     case HYMN_VALUE_FUNC:
     case HYMN_VALUE_FUNC_NATIVE:
+    case HYMN_VALUE_COROUTINE:
         return b.is == a.is && hymn_as_object(a) == hymn_as_object(b);
     case HYMN_VALUE_POINTER:
         return hymn_is_pointer(b) && hymn_as_pointer(a) == hymn_as_pointer(b);
@@ -2217,11 +2610,12 @@ bool hymn_match_values(HymnValue a, HymnValue b) {
     case HYMN_VALUE_BOOL: return hymn_as_bool(a) == hymn_as_bool(b);
     case HYMN_VALUE_INTEGER: return hymn_as_int(a) == hymn_as_int(b);
     case HYMN_VALUE_FLOAT: return hymn_as_float(a) == hymn_as_float(b);
-    case HYMN_VALUE_STRING:
+    case HYMN_VALUE_STRING: return strings_equal(hymn_as_hymn_string(a), hymn_as_hymn_string(b));
     case HYMN_VALUE_ARRAY:
     case HYMN_VALUE_TABLE:
     case HYMN_VALUE_FUNC:
     case HYMN_VALUE_FUNC_NATIVE:
+    case HYMN_VALUE_COROUTINE:
         return hymn_as_object(a) == hymn_as_object(b);
     case HYMN_VALUE_POINTER: return hymn_as_pointer(a) == hymn_as_pointer(b);
     default:
@@ -2232,6 +2626,7 @@ bool hymn_match_values(HymnValue a, HymnValue b) {
 static void value_pool_init(HymnValuePool *this) {
     this->count = 0;
     this->capacity = 8;
+    ALLOCATION_KIND("function");
     this->values = hymn_malloc(8 * sizeof(HymnValue));
 }
 
@@ -2244,6 +2639,7 @@ static int value_pool_add(HymnValuePool *this, HymnValue value) {
     }
     if (count >= this->capacity) {
         this->capacity *= 2;
+        ALLOCATION_KIND("function");
         this->values = hymn_realloc_int(this->values, this->capacity, sizeof(HymnValue));
     }
     this->values[count] = value;
@@ -2254,23 +2650,93 @@ static int value_pool_add(HymnValuePool *this, HymnValue value) {
 static void byte_code_init(HymnByteCode *this) {
     this->count = 0;
     this->capacity = 8;
+    ALLOCATION_KIND("function");
     this->instructions = hymn_malloc(8 * sizeof(uint8_t));
-    this->lines = hymn_malloc(8 * sizeof(int));
+    ALLOCATION_KIND("function");
+    this->rows = hymn_malloc(8 * sizeof(int));
+    this->lines = NULL;
+    this->line_size = 0;
     value_pool_init(&this->constants);
 }
 
 static HymnNativeFunction *new_native_function(HymnObjectString *name, HymnNativeCall func) {
+    ALLOCATION_KIND("function");
     HymnNativeFunction *native = hymn_calloc(1, sizeof(HymnNativeFunction));
+    native->arity = -1;
     native->name = name;
     native->func = func;
     hymn_reference_string(name);
     return native;
 }
 
+static const uint16_t SIGNATURE_NUMBER = (1 << HYMN_VALUE_INTEGER) | (1 << HYMN_VALUE_FLOAT);
+static const uint16_t SIGNATURE_SCALAR = (1 << HYMN_VALUE_NONE) | (1 << HYMN_VALUE_BOOL) | (1 << HYMN_VALUE_INTEGER) | (1 << HYMN_VALUE_FLOAT) | (1 << HYMN_VALUE_POINTER);
+
+static uint16_t signature_type(char c) {
+    switch (c) {
+    case 'b': return 1 << HYMN_VALUE_BOOL;
+    case 'i': return 1 << HYMN_VALUE_INTEGER;
+    case 'f': return 1 << HYMN_VALUE_FLOAT;
+    case 'n': return SIGNATURE_NUMBER;
+    case 's': return 1 << HYMN_VALUE_STRING;
+    case 'a': return 1 << HYMN_VALUE_ARRAY;
+    case 't': return 1 << HYMN_VALUE_TABLE;
+    case 'p': return 1 << HYMN_VALUE_POINTER;
+    case 'c': return (1 << HYMN_VALUE_FUNC) | (1 << HYMN_VALUE_FUNC_NATIVE);
+    case 'v': return UINT16_MAX;
+    default: return 0;
+    }
+}
+
+static void native_signature(HymnNativeFunction *native, const char *signature) {
+    if (strlen(signature) > HYMN_SIGNATURE_MAX) {
+        fprintf(stderr, "signature '%s' for '%s' has more than %d parameters.\n", signature, native->name->string, HYMN_SIGNATURE_MAX);
+        exit(1);
+    }
+    int arity = 0;
+    bool scalar = true;
+    while (signature[arity] != '\0') {
+        uint16_t type = signature_type(signature[arity]);
+        if (type == 0) {
+            fprintf(stderr, "signature '%s' for '%s' has unknown type '%c'.\n", signature, native->name->string, signature[arity]);
+            exit(1);
+        } else if ((type & ~SIGNATURE_SCALAR) != 0) {
+            scalar = false;
+        }
+        native->types[arity++] = type;
+    }
+    native->arity = arity;
+    native->scalar = scalar;
+}
+
+static bool native_arguments(Hymn *H, HymnNativeFunction *native, int count, HymnValue *arguments) {
+    if (count != native->arity) {
+        hymn_arity_exception(H, native->arity, count);
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        uint16_t type = native->types[i];
+        if (((1 << arguments[i].is) & type) == 0) {
+            const char *expected = "number";
+            if (type != SIGNATURE_NUMBER) {
+                int is = 0;
+                while (((1 << is) & type) == 0) {
+                    is++;
+                }
+                expected = hymn_value_type((enum HymnValueType)is);
+            }
+            H->exception = hymn_string_format("expected type: %s for argument %d but was: %s", expected, i + 1, hymn_value_type(arguments[i].is));
+            return false;
+        }
+    }
+    return true;
+}
+
 static void array_init_with_capacity(HymnArray *this, HymnInt length, HymnInt capacity) {
     if (capacity == 0) {
         this->items = NULL;
     } else {
+        ALLOCATION_KIND("array");
         this->items = hymn_calloc((size_t)capacity, sizeof(HymnValue));
     }
     this->length = length;
@@ -2278,8 +2744,10 @@ static void array_init_with_capacity(HymnArray *this, HymnInt length, HymnInt ca
 }
 
 static HymnArray *new_array_with_capacity(HymnInt length, HymnInt capacity) {
+    ALLOCATION_KIND("array");
     HymnArray *this = hymn_calloc(1, sizeof(HymnArray));
     array_init_with_capacity(this, length, capacity);
+    census_track(this, HYMN_VALUE_ARRAY);
     return this;
 }
 
@@ -2290,7 +2758,9 @@ HymnArray *hymn_new_array(HymnInt length) {
 static HymnArray *new_array_slice(HymnArray *from, HymnInt start, HymnInt end) {
     HymnInt length = end - start;
     size_t size = (size_t)length * sizeof(HymnValue);
+    ALLOCATION_KIND("array");
     HymnArray *this = hymn_calloc(1, sizeof(HymnArray));
+    ALLOCATION_KIND("array");
     this->items = hymn_malloc(size);
     memcpy(this->items, &from->items[start], size);
     this->length = length;
@@ -2298,6 +2768,7 @@ static HymnArray *new_array_slice(HymnArray *from, HymnInt start, HymnInt end) {
     for (HymnInt i = 0; i < length; i++) {
         hymn_reference(this->items[i]);
     }
+    census_track(this, HYMN_VALUE_ARRAY);
     return this;
 }
 
@@ -2309,15 +2780,35 @@ static void array_update_capacity(HymnArray *this, HymnInt length) {
     if (length > this->capacity) {
         if (this->capacity == 0) {
             this->capacity = length;
+            ALLOCATION_KIND("array");
             this->items = hymn_calloc((size_t)length, sizeof(HymnValue));
         } else {
             this->capacity = length * 2;
+            ALLOCATION_KIND("array");
             this->items = hymn_realloc(this->items, (size_t)this->capacity * sizeof(HymnValue));
             memset(this->items + (size_t)this->length, 0, (size_t)(this->capacity - this->length));
         }
     }
 }
 
+static bool array_reserve(HymnArray *this, HymnInt length) {
+    if (length <= this->capacity) {
+        return true;
+    }
+    HymnInt capacity = this->capacity == 0 ? length : length * 2;
+    if ((size_t)capacity > SIZE_MAX / sizeof(HymnValue)) {
+        return false;
+    }
+    ALLOCATION_KIND("array");
+    HymnValue *items = memory_reallocate(this->items, (size_t)capacity * sizeof(HymnValue), true);
+    if (items == NULL) {
+        return false;
+    }
+    this->items = items;
+    this->capacity = capacity;
+    return true;
+}
+
 void hymn_array_push(HymnArray *this, HymnValue value) {
     HymnInt length = this->length + 1;
     array_update_capacity(this, length);
@@ -2382,25 +2873,29 @@ void hymn_array_clear(Hymn *H, HymnArray *this) {
 }
 
 void hymn_array_delete(Hymn *H, HymnArray *this) {
+    census_untrack(H, this);
     hymn_array_clear(H, this);
-    free(this->items);
-    free(this);
+    hymn_free(this->items);
+    hymn_free(this);
 }
 
 HymnTable *hymn_new_table(void) {
+    ALLOCATION_KIND("table");
     HymnTable *this = hymn_calloc(1, sizeof(HymnTable));
     table_init(this);
+    census_track(this, HYMN_VALUE_TABLE);
     return this;
 }
 
-static HymnTable *new_table_copy(HymnTable *from) {
+static HymnTable *new_table_copy(Hymn *H, HymnTable *from) {
     HymnTable *this = hymn_new_table();
     unsigned int bins = from->bins;
     for (unsigned int i = 0; i < bins; i++) {
         HymnTableItem *item = from->items[i];
         while (item != NULL) {
-            table_put(this, item->key, item->value);
-            hymn_reference_string(item->key);
+            HymnObjectString *key = item->key->frozen ? hymn_intern_string(H, hymn_string_copy(item->key->string)) : item->key;
+            table_put(this, key, item->value);
+            hymn_reference_string(key);
             hymn_reference(item->value);
             item = item->next;
         }
@@ -2485,8 +2980,11 @@ static void scope_init(Compiler *C, Scope *scope, enum FunctionType type, size_t
     scope->depth = 0;
     scope->type = type;
     scope->begin = begin;
+    ALLOCATION_KIND("function");
     scope->func = hymn_calloc(1, sizeof(HymnFunction));
-    byte_code_init(&scope->func->code);
+    if (type != TYPE_FUNCTION || !C->lazy) {
+        byte_code_init(&scope->func->code);
+    }
     if (C->script != NULL) {
         scope->func->script = hymn_new_string(C->script);
     }
@@ -2503,9 +3001,10 @@ static void scope_init(Compiler *C, Scope *scope, enum FunctionType type, size_t
 }
 
 static void byte_code_delete(HymnByteCode *this) {
-    free(this->instructions);
-    free(this->lines);
-    free(this->constants.values);
+    hymn_free(this->instructions);
+    hymn_free(this->rows);
+    hymn_free(this->lines);
+    hymn_free(this->constants.values);
 }
 
 static uint8_t byte_code_new_constant(Compiler *C, HymnValue value) {
@@ -2523,13 +3022,103 @@ static void write_byte(HymnByteCode *code, uint8_t b, int row) {
     if (count >= code->capacity) {
         code->capacity *= 2;
         code->instructions = hymn_realloc_int(code->instructions, code->capacity, sizeof(uint8_t));
-        code->lines = hymn_realloc_int(code->lines, code->capacity, sizeof(int));
+        code->rows = hymn_realloc_int(code->rows, code->capacity, sizeof(int));
     }
     code->instructions[count] = b;
-    code->lines[count] = row;
+    code->rows[count] = row;
     code->count = count + 1;
 }
 
+static size_t line_varint(uint8_t *out, unsigned int value) {
+    size_t size = 0;
+    do {
+        uint8_t b = (uint8_t)(value & 0x7f);
+        value >>= 7;
+        if (value != 0) {
+            b |= 0x80;
+        }
+        if (out != NULL) {
+            out[size] = b;
+        }
+        size++;
+    } while (value != 0);
+    return size;
+}
+
+static size_t line_runs(HymnByteCode *code, uint8_t *out) {
+    int *rows = code->rows;
+    size_t size = 0;
+    int previous = 0;
+    int start = 0;
+    for (int i = 1; i <= code->count; i++) {
+        if (i < code->count && rows[i] == rows[start]) {
+            continue;
+        }
+        int delta = rows[start] - previous;
+        unsigned int zigzag = delta >= 0 ? (unsigned int)delta << 1 : (((unsigned int)-delta) << 1) - 1;
+        size += line_varint(out != NULL ? out + size : NULL, (unsigned int)(i - start));
+        size += line_varint(out != NULL ? out + size : NULL, zigzag);
+        previous = rows[start];
+        start = i;
+    }
+    return size;
+}
+
+static void line_encode(HymnByteCode *code) {
+    size_t size = line_runs(code, NULL);
+    ALLOCATION_KIND("function");
+    code->lines = hymn_malloc(size > 0 ? size : 1);
+    line_runs(code, code->lines);
+    code->line_size = size;
+    hymn_free(code->rows);
+    code->rows = NULL;
+}
+
+static unsigned int line_read(HymnByteCode *code, size_t *position) {
+    unsigned int value = 0;
+    unsigned int shift = 0;
+    while (*position < code->line_size) {
+        uint8_t b = code->lines[(*position)++];
+        value |= (unsigned int)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            break;
+        }
+        shift += 7;
+    }
+    return value;
+}
+
+static int line_decode(HymnByteCode *code, int offset, int *start, int *end) {
+    if (code->rows != NULL) {
+        *start = offset;
+        *end = offset + 1;
+        return code->rows[offset];
+    }
+    size_t position = 0;
+    int line = 0;
+    int begin = 0;
+    while (position < code->line_size) {
+        int length = (int)line_read(code, &position);
+        unsigned int zigzag = line_read(code, &position);
+        line += (zigzag & 1) ? -(int)((zigzag + 1) >> 1) : (int)(zigzag >> 1);
+        if (offset < begin + length) {
+            *start = begin;
+            *end = begin + length;
+            return line;
+        }
+        begin += length;
+    }
+    *start = begin;
+    *end = begin;
+    return line;
+}
+
+static int line_at(HymnByteCode *code, int offset) {
+    int start;
+    int end;
+    return line_decode(code, offset, &start, &end);
+}
+
 static void emit(Compiler *C, uint8_t i) {
     write_byte(current(C), i, C->previous.row);
 }
@@ -2561,7 +3150,7 @@ static uint8_t emit_constant(Compiler *C, HymnValue value) {
     return constant;
 }
 
-static Rule *token_rule(enum TokenType type) {
+static const Rule *token_rule(enum TokenType type) {
     return &rules[type];
 }
 
@@ -2875,15 +3464,35 @@ static void function_delete(HymnFunction *this) {
     HymnExceptList *except = this->except;
     while (except != NULL) {
         HymnExceptList *next = except->next;
-        free(except);
+        hymn_free(except);
         except = next;
     }
-    free(this);
+    hymn_free(this);
 }
 
 static void native_function_delete(Hymn *H, HymnNativeFunction *this) {
     hymn_dereference_string(H, this->name);
-    free(this);
+    hymn_free(this);
+}
+
+enum CoroutineStatus {
+    COROUTINE_NEW,
+    COROUTINE_SUSPENDED,
+    COROUTINE_RUNNING,
+    COROUTINE_DEAD,
+};
+
+static void coroutine_delete(Hymn *H, HymnCoroutine *this) {
+    if (this->stack != NULL) {
+        while (this->stack_top != this->stack) {
+            hymn_dereference(H, *--this->stack_top);
+        }
+    }
+    hymn_dereference(H, this->function);
+    hymn_dereference(H, this->value);
+    hymn_free(this->stack);
+    hymn_free(this->frames);
+    hymn_free(this);
 }
 
 static void push_local(Compiler *C, Token name) {
@@ -3035,7 +3644,7 @@ static void compile_unary(Compiler *C, bool assign) {
 static void compile_binary(Compiler *C, bool assign) {
     (void)assign;
     enum TokenType type = C->previous.type;
-    Rule *rule = token_rule(type);
+    const Rule *rule = token_rule(type);
     compile_with_precedence(C, (enum Precedence)(rule->precedence + 1));
     switch (type) {
     case TOKEN_ADD: emit(C, OP_ADD); break;
@@ -3155,7 +3764,7 @@ static void free_jump_and_list(Compiler *C) {
         }
         patch_jump(C, jump->jump);
         JumpList *next = jump->next;
-        free(jump);
+        hymn_free(jump);
         jump = next;
     }
     C->jump_and = jump;
@@ -3171,7 +3780,7 @@ static void free_jump_or_list(Compiler *C) {
         }
         patch_jump(C, jump->jump);
         JumpList *next = jump->next;
-        free(jump);
+        hymn_free(jump);
         jump = next;
     }
     C->jump_or = jump;
@@ -3181,7 +3790,7 @@ static void free_jumps(Compiler *C, JumpList *jump) {
     while (jump != NULL) {
         patch_jump(C, jump->jump);
         JumpList *next = jump->next;
-        free(jump);
+        hymn_free(jump);
         jump = next;
     }
 }
@@ -3316,7 +3925,7 @@ static HymnString *value_to_string_recusive(HymnValue value, struct PointerSet *
             hymn_string_delete(add);
         }
         string = hymn_string_append(string, " }");
-        free(keys);
+        hymn_free(keys);
         return string;
     }
     case HYMN_VALUE_FUNC: {
@@ -3327,6 +3936,7 @@ static HymnString *value_to_string_recusive(HymnValue value, struct PointerSet *
     }
     case HYMN_VALUE_FUNC_NATIVE: return hymn_string_copy(hymn_as_native(value)->name->string);
     case HYMN_VALUE_POINTER: return hymn_string_format("%p", hymn_as_pointer(value));
+    case HYMN_VALUE_COROUTINE: return hymn_new_string("coroutine");
     default:
         break;
     }
@@ -3336,15 +3946,27 @@ static HymnString *value_to_string_recusive(HymnValue value, struct PointerSet *
 HymnString *hymn_value_to_string(HymnValue value) {
     struct PointerSet set = {.count = 0, .capacity = 0, .items = NULL};
     HymnString *string = value_to_string_recusive(value, &set, false);
-    free(set.items);
+    hymn_free(set.items);
     return string;
 }
 
-static HymnString *value_concat(HymnValue a, HymnValue b) {
-    HymnString *string = hymn_value_to_string(a);
-    HymnString *second = hymn_value_to_string(b);
-    string = hymn_string_append(string, second);
-    hymn_string_delete(second);
+static HymnString *value_concat(HymnValue a, HymnValue b, bool limited) {
+    HymnString *first = hymn_is_string(a) ? hymn_as_string(a) : hymn_value_to_string(a);
+    HymnString *second = hymn_is_string(b) ? hymn_as_string(b) : hymn_value_to_string(b);
+    size_t length_a = hymn_string_len(first);
+    size_t length_b = hymn_string_len(second);
+    HymnString *string = NULL;
+    if (!limited) {
+        string = hymn_new_empty_string(length_a + length_b);
+    } else if (length_b <= SIZE_MAX - length_a) {
+        string = string_limited(length_a + length_b);
+    }
+    if (string != NULL) {
+        memcpy(string, first, length_a);
+        memcpy(string + length_a, second, length_b);
+    }
+    if (!hymn_is_string(a)) hymn_string_delete(first);
+    if (!hymn_is_string(b)) hymn_string_delete(second);
     return string;
 }
 
@@ -3397,6 +4019,7 @@ static int next(uint8_t instruction) {
     case OP_INCREMENT_LOOP:
     case OP_JUMP_IF_GREATER_LOCALS:
         return 5;
+        HYMN_SUPER_NEXT
     default:
         return 1;
     }
@@ -3531,7 +4154,7 @@ static void rewrite(Optimizer *optimizer, int start, int shift) {
                     jump -= shift;
                     UPDATE_JUMP(instructions, i, 1, 2, jump)
                 } else {
-                    assert(destination > start + shift || shift == next(optimizer->code->instructions[destination]));
+                    assert(destination >= start + shift || shift == next(optimizer->code->instructions[destination]));
                 }
             }
             break;
@@ -3544,7 +4167,7 @@ static void rewrite(Optimizer *optimizer, int start, int shift) {
                     jump -= shift;
                     UPDATE_JUMP(instructions, i, 2, 3, jump)
                 } else {
-                    assert(destination > start + shift || shift == next(optimizer->code->instructions[destination]));
+                    assert(destination >= start + shift || shift == next(optimizer->code->instructions[destination]));
                 }
             }
             break;
@@ -3557,7 +4180,7 @@ static void rewrite(Optimizer *optimizer, int start, int shift) {
                     jump -= shift;
                     UPDATE_JUMP(instructions, i, 3, 4, jump)
                 } else {
-                    assert(destination > start + shift || shift == next(optimizer->code->instructions[destination]));
+                    assert(destination >= start + shift || shift == next(optimizer->code->instructions[destination]));
                 }
             }
             break;
@@ -3570,12 +4193,12 @@ static void rewrite(Optimizer *optimizer, int start, int shift) {
         view = view->next;
     }
 
-    int *lines = optimizer->code->lines;
+    int *rows = optimizer->code->rows;
     int count = optimizer->code->count - shift;
     for (int c = start; c < count; c++) {
         int n = c + shift;
         instructions[c] = instructions[n];
-        lines[c] = lines[n];
+        rows[c] = rows[n];
     }
     optimizer->code->count = count;
 
@@ -3626,7 +4249,7 @@ static void deletion(Optimizer *optimizer, int index) {
     while (view != NULL) {
         if (index == view->index) {
             Instruction *next = view->next;
-            free(view);
+            hymn_free(view);
             if (previous == NULL) {
                 optimizer->important = next;
             } else {
@@ -3683,12 +4306,70 @@ static void interest(Optimizer *optimizer) {
     optimizer->important = head;
 }
 
-static HymnString *disassemble_byte_code(HymnByteCode *code);
+#if HYMN_SUPER_COUNT > 0
 
-static void optimize(Compiler *C) {
+typedef struct Superinstruction Superinstruction;
 
-    Scope *scope = C->scope;
-    HymnFunction *func = scope->func;
+struct Superinstruction {
+    uint8_t instruction;
+    uint8_t count;
+    uint8_t sequence[HYMN_SUPER_MAX];
+};
+
+static const Superinstruction superinstructions[] = {HYMN_SUPER_PATTERNS};
+
+static bool except_boundary(Optimizer *optimizer, int index) {
+    HymnExceptList *except = optimizer->except;
+    while (except != NULL) {
+        if (index == except->start || index == except->end) {
+            return true;
+        }
+        except = except->next;
+    }
+    return false;
+}
+
+static void fuse(Optimizer *optimizer) {
+    HymnByteCode *code = optimizer->code;
+    int one = 0;
+    while (one < code->count) {
+        uint8_t first = code->instructions[one];
+        for (size_t s = 0; s < sizeof(superinstructions) / sizeof(Superinstruction); s++) {
+            const Superinstruction *super = &superinstructions[s];
+            if (first != super->sequence[0]) {
+                continue;
+            }
+            int index[HYMN_SUPER_MAX];
+            index[0] = one;
+            bool match = true;
+            for (int i = 1; i < super->count; i++) {
+                int at = index[i - 1] + next(code->instructions[index[i - 1]]);
+                if (at >= code->count || code->instructions[at] != super->sequence[i] || adjustable(optimizer, at) != NULL || except_boundary(optimizer, at)) {
+                    match = false;
+                    break;
+                }
+                index[i] = at;
+            }
+            if (match) {
+                for (int i = super->count - 1; i > 0; i--) {
+                    rewrite(optimizer, index[i], 1);
+                }
+                code->instructions[one] = super->instruction;
+                break;
+            }
+        }
+        one += next(code->instructions[one]);
+    }
+}
+
+#endif
+
+static HymnString *disassemble_byte_code(HymnByteCode *code);
+
+static void optimize(Compiler *C) {
+
+    Scope *scope = C->scope;
+    HymnFunction *func = scope->func;
 
     Optimizer optimizer = {0};
     optimizer.code = &func->code;
@@ -3906,13 +4587,13 @@ static void optimize(Compiler *C) {
                     HymnValue value;
                     if (hymn_is_none(a)) {
                         if (hymn_is_string(b)) {
-                            value = compile_intern_string(C->H, value_concat(a, b));
+                            value = compile_intern_string(C->H, value_concat(a, b, false));
                         } else {
                             break;
                         }
                     } else if (hymn_is_bool(a)) {
                         if (hymn_is_string(b)) {
-                            value = compile_intern_string(C->H, value_concat(a, b));
+                            value = compile_intern_string(C->H, value_concat(a, b, false));
                         } else {
                             break;
                         }
@@ -3922,7 +4603,7 @@ static void optimize(Compiler *C) {
                         } else if (hymn_is_float(b)) {
                             value = hymn_new_float((HymnFloat)a.as.i + b.as.f);
                         } else if (hymn_is_string(b)) {
-                            value = compile_intern_string(C->H, value_concat(a, b));
+                            value = compile_intern_string(C->H, value_concat(a, b, false));
                         } else {
                             break;
                         }
@@ -3932,12 +4613,12 @@ static void optimize(Compiler *C) {
                         } else if (hymn_is_float(b)) {
                             value = hymn_new_float(a.as.f + b.as.f);
                         } else if (hymn_is_string(b)) {
-                            value = compile_intern_string(C->H, value_concat(a, b));
+                            value = compile_intern_string(C->H, value_concat(a, b, false));
                         } else {
                             break;
                         }
                     } else if (hymn_is_string(a)) {
-                        value = compile_intern_string(C->H, value_concat(a, b));
+                        value = compile_intern_string(C->H, value_concat(a, b, false));
                     } else {
                         break;
                     }
@@ -4215,10 +4896,14 @@ static void optimize(Compiler *C) {
         one = two;
     }
 
+#if HYMN_SUPER_COUNT > 0
+    fuse(&optimizer);
+#endif
+
     Instruction *important = optimizer.important;
     while (important != NULL) {
         Instruction *next = important->next;
-        free(important);
+        hymn_free(important);
         important = next;
     }
 }
@@ -4237,24 +4922,34 @@ static HymnFunction *end_function(Compiler *C) {
     HymnFunction *func = scope->func;
     if (scope->type == TYPE_DIRECT || scope->type == TYPE_REPL) echo_if_none(C);
     emit(C, OP_VOID);
+    HymnCompileStats *stats = C->stats;
+    if (stats != NULL) {
+        stats->bytes += (size_t)func->code.count;
+    }
 #ifndef HYMN_NO_OPTIMIZE
-    optimize(C);
+    if (stats != NULL) {
+        int64_t start = compile_clock();
+        optimize(C);
+        stats->optimize += compile_clock() - start;
+    } else {
+        optimize(C);
+    }
 #endif
-    if (scope->type == TYPE_FUNCTION) func->source = hymn_substring(C->source, scope->begin, C->previous.start + C->previous.length);
+    line_encode(&func->code);
+    if (stats != NULL) {
+        stats->optimized += (size_t)func->code.count;
+        stats->constants += (size_t)func->code.constants.count;
+        stats->lines += func->code.line_size;
+        stats->functions++;
+    }
+    if (scope->type == TYPE_FUNCTION && func->source == NULL) func->source = hymn_substring(C->source, scope->begin, C->previous.start + C->previous.length);
     C->scope = scope->enclosing;
     return func;
 }
 
-static void compile_function(Compiler *C, enum FunctionType type, size_t begin) {
-    Scope scope = {0};
-    scope_init(C, &scope, type, begin);
-
-    begin_scope(C);
-
+static void function_parameters(Compiler *C, HymnFunction *func) {
     consume(C, TOKEN_LEFT_PAREN, "expected '(' after function name");
 
-    HymnFunction *func = C->scope->func;
-
     if (!check(C, TOKEN_RIGHT_PAREN)) {
         do {
             func->arity++;
@@ -4270,27 +4965,67 @@ static void compile_function(Compiler *C, enum FunctionType type, size_t begin)
     consume(C, TOKEN_RIGHT_PAREN, "expected ')' after function parameters");
     type_declaration(C);
     consume(C, TOKEN_LEFT_CURLY, "expected '{' after function parameters");
+}
 
+static void function_body(Compiler *C) {
     while (!check(C, TOKEN_RIGHT_CURLY) && !check(C, TOKEN_EOF)) {
         declaration(C);
     }
 
     consume(C, TOKEN_RIGHT_CURLY, "expected '}' at end of function body");
+}
+
+static void skip_function_body(Compiler *C) {
+    int depth = 1;
+    while (!check(C, TOKEN_EOF)) {
+        if (check(C, TOKEN_LEFT_CURLY)) {
+            depth++;
+        } else if (check(C, TOKEN_RIGHT_CURLY)) {
+            if (--depth == 0) {
+                break;
+            }
+        }
+        advance(C);
+    }
+
+    consume(C, TOKEN_RIGHT_CURLY, "expected '}' at end of function body");
+}
+
+static void compile_function(Compiler *C, enum FunctionType type, Token *begin) {
+    Scope scope = {0};
+    scope_init(C, &scope, type, begin->start);
+
+    begin_scope(C);
+
+    HymnFunction *func = C->scope->func;
+    func->row = begin->row;
+    func->column = begin->column;
+
+    function_parameters(C, func);
+
+    if (C->lazy) {
+        skip_function_body(C);
+        func->source = hymn_substring(C->source, begin->start, C->previous.start + C->previous.length);
+        C->scope = scope.enclosing;
+    } else {
+        function_body(C);
+        end_function(C);
+    }
 
-    end_function(C);
     emit_constant(C, hymn_new_func_value(func));
 }
 
 static void function_expression(Compiler *C, bool assign) {
     (void)assign;
-    compile_function(C, TYPE_FUNCTION, C->previous.start);
+    Token begin = C->previous;
+    compile_function(C, TYPE_FUNCTION, &begin);
 }
 
 static void declare_function(Compiler *C) {
-    size_t begin = C->previous.start;
+    Token begin = C->previous;
     uint8_t global = variable(C, "expected function name");
     local_initialize(C);
-    compile_function(C, TYPE_FUNCTION, begin);
+    compile_function(C, TYPE_FUNCTION, &begin);
     finalize_variable(C, global);
 }
 
@@ -4395,7 +5130,7 @@ static void patch_jump_list(Compiler *C) {
         }
         patch_jump(C, C->jump->jump);
         JumpList *next = C->jump->next;
-        free(C->jump);
+        hymn_free(C->jump);
         C->jump = next;
     }
 }
@@ -4413,7 +5148,7 @@ static void patch_jump_for_list(Compiler *C) {
         }
         patch_jump(C, C->jump_for->jump);
         JumpList *next = C->jump_for->next;
-        free(C->jump_for);
+        hymn_free(C->jump_for);
         C->jump_for = next;
     }
 }
@@ -4535,9 +5270,9 @@ static void for_statement(Compiler *C) {
 
     int count = code->count - increment;
     uint8_t *instructions = hymn_malloc_int(count, sizeof(uint8_t));
-    int *lines = hymn_malloc_int(count, sizeof(int));
+    int *rows = hymn_malloc_int(count, sizeof(int));
     hymn_mem_copy(instructions, &code->instructions[increment], count, sizeof(uint8_t));
-    hymn_mem_copy(lines, &code->lines[increment], count, sizeof(int));
+    hymn_mem_copy(rows, &code->rows[increment], count, sizeof(int));
     code->count = increment;
 
     // BODY
@@ -4552,13 +5287,13 @@ static void for_statement(Compiler *C) {
     while (code->count + count > code->capacity) {
         code->capacity *= 2;
         code->instructions = hymn_realloc_int(code->instructions, code->capacity, sizeof(uint8_t));
-        code->lines = hymn_realloc_int(code->lines, code->capacity, sizeof(int));
+        code->rows = hymn_realloc_int(code->rows, code->capacity, sizeof(int));
     }
     hymn_mem_copy(&code->instructions[code->count], instructions, count, sizeof(uint8_t));
-    hymn_mem_copy(&code->lines[code->count], lines, count, sizeof(int));
+    hymn_mem_copy(&code->rows[code->count], rows, count, sizeof(int));
     code->count += count;
-    free(instructions);
-    free(lines);
+    hymn_free(instructions);
+    hymn_free(rows);
 
     emit_loop(C, compare);
 
@@ -4724,8 +5459,33 @@ static void insert_statement(Compiler *C) {
     emit(C, OP_INSERT);
 }
 
+static void import_list_add(ImportList *list, const char *source, Token *literal) {
+    if (memchr(&source[literal->start], '\\', literal->length) != NULL) {
+        return;
+    }
+    Hymn *previous = active;
+    active = NULL;
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity == 0 ? 4 : list->capacity * 2;
+        list->items = hymn_realloc_int(list->items, list->capacity, sizeof(HymnString *));
+    }
+    list->items[list->count++] = hymn_new_string_with_length(&source[literal->start], literal->length);
+    active = previous;
+}
+
+static void import_list_delete(ImportList *list) {
+    for (int i = 0; i < list->count; i++) {
+        hymn_string_delete(list->items[i]);
+    }
+    hymn_free(list->items);
+}
+
 static void use_statement(Compiler *C) {
+    Token literal = C->current;
     expression(C);
+    if (C->uses != NULL && literal.type == TOKEN_STRING && C->previous.type == TOKEN_STRING && C->previous.start == literal.start) {
+        import_list_add(C->uses, C->source, &literal);
+    }
     emit(C, OP_USE);
 }
 
@@ -4843,6 +5603,26 @@ static void copy_expression(Compiler *C, bool assign) {
     emit(C, OP_COPY);
 }
 
+static void freeze_expression(Compiler *C, bool assign) {
+    (void)assign;
+    consume(C, TOKEN_LEFT_PAREN, "expected opening '(' in call to 'freeze'");
+    expression(C);
+    consume(C, TOKEN_RIGHT_PAREN, "expected closing ')' in call to 'freeze'");
+    emit(C, OP_FREEZE);
+}
+
+static void yield_expression(Compiler *C, bool assign) {
+    (void)assign;
+    consume(C, TOKEN_LEFT_PAREN, "expected opening '(' in call to 'yield'");
+    if (check(C, TOKEN_RIGHT_PAREN)) {
+        emit(C, OP_NONE);
+    } else {
+        expression(C);
+    }
+    consume(C, TOKEN_RIGHT_PAREN, "expected closing ')' in call to 'yield'");
+    emit(C, OP_YIELD);
+}
+
 static void keys_expression(Compiler *C, bool assign) {
     (void)assign;
     consume(C, TOKEN_LEFT_PAREN, "expected opening '(' in call to 'keys'");
@@ -4929,21 +5709,70 @@ static HymnFrame *current_frame(Hymn *H) {
     return &H->frames[H->frame_count - 1];
 }
 
-static CompileResult compile(Hymn *H, const char *script, const char *source, enum FunctionType type) {
+static void compiler_init(Compiler *C, Hymn *H, const char *script, const char *source, enum FunctionType type) {
+    C->row = 1;
+    C->column = 1;
+    C->script = script;
+    C->source = source;
+    C->interactive = type == TYPE_REPL;
+#ifndef HYMN_NO_LAZY
+    C->lazy = type == TYPE_MODULE;
+#endif
+    C->size = strlen(source);
+    C->previous.type = TOKEN_UNDEFINED;
+    C->current.type = TOKEN_UNDEFINED;
+    C->string_status = STRING_STATUS_NONE;
+    C->H = H;
+    C->pop = -1;
+    C->barrier = -1;
+}
+
+static HymnCompileStats *new_compile_stats(const char *script, size_t source) {
+    HymnCompileStats *stats = system_malloc(sizeof(HymnCompileStats));
+    memset(stats, 0, sizeof(HymnCompileStats));
+    const char *name = script != NULL ? script : "<source>";
+    size_t length = strlen(name);
+    stats->script = system_malloc(length + 1);
+    memcpy(stats->script, name, length + 1);
+    stats->source = source;
+    return stats;
+}
+
+static void compile_stats_append(Hymn *H, HymnCompileStats *stats) {
+    HymnCompileStats **tail = &H->compile_stats;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = stats;
+}
+
+static HymnCompileStats *compile_stats_find(Hymn *H, const char *script) {
+    const char *name = script != NULL ? script : "<source>";
+    HymnCompileStats *found = NULL;
+    for (HymnCompileStats *stats = H->compile_stats; stats != NULL; stats = stats->next) {
+        if (strcmp(stats->script, name) == 0) {
+            found = stats;
+        }
+    }
+    if (found == NULL) {
+        found = new_compile_stats(script, 0);
+        compile_stats_append(H, found);
+    }
+    return found;
+}
+
+static CompileResult compile_with_uses(Hymn *H, const char *script, const char *source, enum FunctionType type, ImportList *uses) {
     Scope scope = {0};
     Compiler C = {0};
-    C.row = 1;
-    C.column = 1;
-    C.script = script;
-    C.source = source;
-    C.interactive = type == TYPE_REPL;
-    C.size = strlen(source);
-    C.previous.type = TOKEN_UNDEFINED;
-    C.current.type = TOKEN_UNDEFINED;
-    C.string_status = STRING_STATUS_NONE;
-    C.H = H;
-    C.pop = -1;
-    C.barrier = -1;
+    compiler_init(&C, H, script, source, type);
+    C.uses = uses;
+
+    int64_t start = 0;
+    if (H->compile_tracking) {
+        C.stats = new_compile_stats(script, C.size);
+        start = compile_clock();
+    }
+
     scope_init(&C, &scope, type, 0);
 
     advance(&C);
@@ -4953,6 +5782,12 @@ static CompileResult compile(Hymn *H, const char *script, const char *source, en
 
     HymnFunction *func = end_function(&C);
 
+    if (C.stats != NULL) {
+        HymnCompileStats *stats = C.stats;
+        stats->parse = compile_clock() - start - stats->lex - stats->optimize;
+        compile_stats_append(H, stats);
+    }
+
     if (C.error != NULL) {
         char *error = string_to_chars(C.error);
         hymn_string_delete(C.error);
@@ -4963,6 +5798,125 @@ static CompileResult compile(Hymn *H, const char *script, const char *source, en
     return (CompileResult){.func = func, .error = NULL};
 }
 
+static CompileResult compile(Hymn *H, const char *script, const char *source, enum FunctionType type) {
+    return compile_with_uses(H, script, source, type, NULL);
+}
+
+static void function_reset(HymnFunction *func) {
+    HymnValuePool *constants = &func->code.constants;
+    for (int i = 0; i < constants->count; i++) {
+        HymnValue value = constants->values[i];
+        if (hymn_is_func(value)) {
+            HymnFunction *child = hymn_as_func(value);
+            child->parent = NULL;
+            if (child->count == 0) {
+                function_delete(child);
+            }
+        }
+    }
+    byte_code_delete(&func->code);
+    memset(&func->code, 0, sizeof(HymnByteCode));
+    HymnExceptList *except = func->except;
+    while (except != NULL) {
+        HymnExceptList *next = except->next;
+        hymn_free(except);
+        except = next;
+    }
+    func->except = NULL;
+}
+
+static char *compile_deferred(Hymn *H, HymnFunction *func) {
+    Scope scope = {0};
+    Compiler C = {0};
+    compiler_init(&C, H, func->script, func->source, TYPE_FUNCTION);
+    C.lazy = true;
+    C.row = func->row;
+    C.column = func->column;
+
+    int64_t start = 0;
+    int64_t lex = 0;
+    int64_t optimize = 0;
+    if (H->compile_tracking) {
+        C.stats = compile_stats_find(H, func->script);
+        lex = C.stats->lex;
+        optimize = C.stats->optimize;
+        start = compile_clock();
+    }
+
+    scope.type = TYPE_FUNCTION;
+    scope.func = func;
+    scope.local_count = 1;
+    C.scope = &scope;
+
+    int arity = func->arity;
+    func->arity = 0;
+    byte_code_init(&func->code);
+
+    advance(&C);
+    consume(&C, TOKEN_FUNCTION, "expected function");
+    match(&C, TOKEN_IDENT);
+
+    begin_scope(&C);
+    function_parameters(&C, func);
+    function_body(&C);
+    end_function(&C);
+
+    if (C.stats != NULL) {
+        HymnCompileStats *stats = C.stats;
+        stats->parse += compile_clock() - start - (stats->lex - lex) - (stats->optimize - optimize);
+    }
+
+    if (C.error != NULL) {
+        char *error = string_to_chars(C.error);
+        hymn_string_delete(C.error);
+        function_reset(func);
+        func->arity = arity;
+        return error;
+    }
+
+    return NULL;
+}
+
+void hymn_compile_stats_track(Hymn *H, bool track) {
+    H->compile_tracking = track;
+    if (!track) {
+        HymnCompileStats *stats = H->compile_stats;
+        while (stats != NULL) {
+            HymnCompileStats *next = stats->next;
+            free(stats->script);
+            free(stats);
+            stats = next;
+        }
+        H->compile_stats = NULL;
+    }
+}
+
+static HymnString *compile_stats_line(HymnString *out, const char *name, HymnCompileStats *stats) {
+    HymnString *line = hymn_string_format("%10zu %10.3f %10.3f %10.3f %10zu %10zu %10zu %10zu %10d  %s\n", stats->source, (double)stats->lex / 1e6, (double)stats->parse / 1e6, (double)stats->optimize / 1e6, stats->bytes, stats->optimized, stats->constants, stats->lines, stats->functions, name);
+    out = hymn_string_append(out, line);
+    hymn_string_delete(line);
+    return out;
+}
+
+HymnString *hymn_compile_stats(Hymn *H) {
+    HymnString *out = hymn_string_format("%10s %10s %10s %10s %10s %10s %10s %10s %10s  %s\n", "SOURCE", "LEX MS", "PARSE MS", "OPT MS", "BYTES", "OPTIMIZED", "CONSTANTS", "LINES", "FUNCTIONS", "MODULE");
+    HymnCompileStats total;
+    memset(&total, 0, sizeof(HymnCompileStats));
+    for (HymnCompileStats *stats = H->compile_stats; stats != NULL; stats = stats->next) {
+        out = compile_stats_line(out, stats->script, stats);
+        total.source += stats->source;
+        total.lex += stats->lex;
+        total.parse += stats->parse;
+        total.optimize += stats->optimize;
+        total.bytes += stats->bytes;
+        total.optimized += stats->optimized;
+        total.constants += stats->constants;
+        total.lines += stats->lines;
+        total.functions += stats->functions;
+    }
+    return compile_stats_line(out, "total", &total);
+}
+
 HymnString *hymn_quote_string(HymnString *string) {
     size_t len = hymn_string_len(string);
     size_t extra = 2;
@@ -4994,94 +5948,537 @@ HymnString *hymn_quote_string(HymnString *string) {
     return quoted;
 }
 
-static void reset_stack(Hymn *H) {
-    H->stack_top = H->stack;
-    H->frame_count = 0;
+static HymnObjectString *freeze_string(HymnObjectString *string) {
+    if (string->frozen) {
+        return string;
+    }
+    HymnObjectString *frozen = new_hymn_string_with_hash(hymn_string_copy(string->string), string->hash);
+    frozen->frozen = true;
+    return frozen;
 }
 
-#ifdef HYMN_NO_MEMORY
-void hymn_reference_string(HymnObjectString *string) {
-    (void)string;
+static HymnValue freeze_value(HymnValue value, struct PointerSet *parents, const char **error) {
+    switch (value.is) {
+    case HYMN_VALUE_STRING: return hymn_new_string_value(freeze_string(hymn_as_hymn_string(value)));
+    case HYMN_VALUE_ARRAY: {
+        HymnArray *array = hymn_as_array(value);
+        if (array->frozen) {
+            return value;
+        } else if (pointer_set_has(parents, array)) {
+            *error = "can't freeze a cyclic value";
+            return hymn_new_none();
+        }
+        pointer_set_add(parents, array);
+        HymnArray *frozen = hymn_new_array(array->length);
+        frozen->frozen = true;
+        census_untrack(active, frozen);
+        for (HymnInt i = 0; i < array->length; i++) {
+            HymnValue item = *error == NULL ? freeze_value(array->items[i], parents, error) : hymn_new_none();
+            hymn_reference(item);
+            frozen->items[i] = item;
+        }
+        parents->count--;
+        return hymn_new_array_value(frozen);
+    }
+    case HYMN_VALUE_TABLE: {
+        HymnTable *table = hymn_as_table(value);
+        if (table->frozen) {
+            return value;
+        } else if (pointer_set_has(parents, table)) {
+            *error = "can't freeze a cyclic value";
+            return hymn_new_none();
+        }
+        pointer_set_add(parents, table);
+        HymnTable *frozen = hymn_new_table();
+        frozen->frozen = true;
+        census_untrack(active, frozen);
+        HymnTableItem *item = NULL;
+        while (*error == NULL && (item = table_next(table, item == NULL ? NULL : item->key)) != NULL) {
+            HymnObjectString *key = freeze_string(item->key);
+            HymnValue property = freeze_value(item->value, parents, error);
+            table_put(frozen, key, property);
+            hymn_reference_string(key);
+            hymn_reference(property);
+        }
+        parents->count--;
+        return hymn_new_table_value(frozen);
+    }
+    case HYMN_VALUE_FUNC:
+    case HYMN_VALUE_FUNC_NATIVE:
+        *error = "can't freeze a function";
+        return hymn_new_none();
+    case HYMN_VALUE_COROUTINE:
+        *error = "can't freeze a coroutine";
+        return hymn_new_none();
+    default:
+        return value;
+    }
 }
-#else
-void hymn_reference_string(HymnObjectString *string) {
-    string->count++;
+
+static HymnValue freeze(Hymn *H, HymnValue value, const char **error) {
+    Hymn *previous = active;
+    active = &frozen_owner;
+    struct PointerSet parents = {.count = 0, .capacity = 0, .items = NULL};
+    HymnValue frozen = freeze_value(value, &parents, error);
+    hymn_free(parents.items);
+    active = previous;
+    size_t limit = frozen_limit != 0 ? frozen_limit : H->memory_limit;
+    if (*error == NULL && limit != 0 && hymn_frozen_memory() > limit) {
+        *error = "frozen memory limit exceeded";
+    }
+    if (*error != NULL) {
+        hymn_reference(frozen);
+        hymn_dereference(H, frozen);
+        return hymn_new_none();
+    }
+    return frozen;
 }
+
+size_t hymn_frozen_memory(void) {
+#ifdef _MSC_VER
+    return (size_t)ATOMIC_ADD_64(frozen_memory, 0);
+#else
+    return (size_t)__atomic_load_n(&frozen_memory, __ATOMIC_RELAXED);
 #endif
+}
 
-#ifdef HYMN_NO_MEMORY
-void hymn_reference(HymnValue value) {
-    (void)value;
+void hymn_set_frozen_limit(size_t limit) {
+    frozen_limit = limit;
 }
-#else
-void hymn_reference(HymnValue value) {
+
+HymnValue hymn_freeze(Hymn *H, HymnValue value) {
+    const char *error = NULL;
+    HymnValue frozen = freeze(H, value, &error);
+    if (error != NULL) {
+        return hymn_new_exception(H, error);
+    }
+    return frozen;
+}
+
+typedef struct CensusRoot CensusRoot;
+typedef struct Census Census;
+
+struct CensusRoot {
+    const char *name;
+    int64_t count;
+    size_t bytes;
+};
+
+struct Census {
+    HymnCensus visited;
+    HymnTable *globals;
+    HymnValue *pending;
+    int pending_count;
+    int pending_capacity;
+    CensusRoot *roots;
+    int root_count;
+    int root_capacity;
+};
+
+static size_t census_size(HymnValue value) {
+    switch (value.is) {
+    case HYMN_VALUE_STRING: {
+        HymnObjectString *string = hymn_as_hymn_string(value);
+        return sizeof(HymnObjectString) + sizeof(HymnStringHead) + hymn_string_head(string->string)->capacity + 1;
+    }
+    case HYMN_VALUE_ARRAY: {
+        HymnArray *array = hymn_as_array(value);
+        return sizeof(HymnArray) + (size_t)array->capacity * sizeof(HymnValue);
+    }
+    case HYMN_VALUE_TABLE: {
+        HymnTable *table = hymn_as_table(value);
+        return sizeof(HymnTable) + table->bins * sizeof(HymnTableItem *) + (size_t)table->size * sizeof(HymnTableItem);
+    }
+    case HYMN_VALUE_FUNC: {
+        HymnFunction *func = hymn_as_func(value);
+        size_t size = sizeof(HymnFunction);
+        size += (size_t)func->code.capacity * sizeof(uint8_t) + func->code.line_size;
+        size += (size_t)func->code.constants.capacity * sizeof(HymnValue);
+        return size;
+    }
+    case HYMN_VALUE_FUNC_NATIVE: return sizeof(HymnNativeFunction);
+    case HYMN_VALUE_COROUTINE: {
+        HymnCoroutine *coroutine = hymn_as_coroutine(value);
+        return sizeof(HymnCoroutine) + (size_t)coroutine->stack_capacity * sizeof(HymnValue) + (size_t)coroutine->frame_capacity * sizeof(HymnFrame);
+    }
+    default: return 0;
+    }
+}
+
+static void census_push(Census *C, HymnValue value) {
     switch (value.is) {
     case HYMN_VALUE_STRING:
-        ((HymnObjectString *)value.as.o)->count++;
-        return;
     case HYMN_VALUE_ARRAY:
-        ((HymnArray *)value.as.o)->count++;
-        return;
     case HYMN_VALUE_TABLE:
-        ((HymnTable *)value.as.o)->count++;
-        return;
     case HYMN_VALUE_FUNC:
-        ((HymnFunction *)value.as.o)->count++;
-        return;
     case HYMN_VALUE_FUNC_NATIVE:
-        ((HymnNativeFunction *)value.as.o)->count++;
-        return;
+    case HYMN_VALUE_COROUTINE:
+        break;
     default:
         return;
     }
-}
-#endif
-
-#ifdef HYMN_NO_MEMORY
-void hymn_dereference_string(Hymn *H, HymnObjectString *string) {
-    (void)H;
-    (void)string;
-}
-#else
-void hymn_dereference_string(Hymn *H, HymnObjectString *string) {
-    int count = --string->count;
-    assert(count >= 0);
-    if (count == 0) {
-        set_remove(&H->strings, string->string);
-        hymn_string_delete(string->string);
-        free(string);
+    if (C->pending_count == C->pending_capacity) {
+        C->pending_capacity = C->pending_capacity == 0 ? 64 : C->pending_capacity * 2;
+        C->pending = system_realloc(C->pending, (size_t)C->pending_capacity * sizeof(HymnValue));
     }
+    C->pending[C->pending_count++] = value;
 }
-#endif
 
-#ifdef HYMN_NO_MEMORY
-void hymn_dereference(Hymn *H, HymnValue value) {
-    (void)H;
-    (void)value;
-}
-#else
-void hymn_dereference(Hymn *H, HymnValue value) {
+static void census_children(Census *C, HymnValue value) {
     switch (value.is) {
-    case HYMN_VALUE_STRING: {
-        HymnObjectString *string = (HymnObjectString *)value.as.o;
-        hymn_dereference_string(H, string);
-        return;
-    }
     case HYMN_VALUE_ARRAY: {
-        HymnArray *array = (HymnArray *)value.as.o;
-        int count = --array->count;
-        assert(count >= 0);
-        if (count == 0) {
-            hymn_array_delete(H, array);
+        HymnArray *array = hymn_as_array(value);
+        for (HymnInt i = 0; i < array->length; i++) {
+            census_push(C, array->items[i]);
         }
         return;
     }
     case HYMN_VALUE_TABLE: {
-        HymnTable *table = (HymnTable *)value.as.o;
-        int count = --table->count;
-        assert(count >= 0);
-        if (count == 0) {
-            table_delete(H, table);
+        HymnTable *table = hymn_as_table(value);
+        for (unsigned int i = 0; i < table->bins; i++) {
+            for (HymnTableItem *item = table->items[i]; item != NULL; item = item->next) {
+                census_push(C, hymn_new_string_value(item->key));
+                census_push(C, item->value);
+            }
+        }
+        return;
+    }
+    case HYMN_VALUE_FUNC: {
+        HymnValuePool *constants = &hymn_as_func(value)->code.constants;
+        for (int i = 0; i < constants->count; i++) {
+            census_push(C, constants->values[i]);
+        }
+        return;
+    }
+    case HYMN_VALUE_FUNC_NATIVE: {
+        census_push(C, hymn_new_string_value(hymn_as_native(value)->name));
+        return;
+    }
+    case HYMN_VALUE_COROUTINE: {
+        HymnCoroutine *coroutine = hymn_as_coroutine(value);
+        census_push(C, coroutine->function);
+        census_push(C, coroutine->value);
+        if (coroutine->stack != NULL) {
+            for (HymnValue *v = coroutine->stack; v < coroutine->stack_top; v++) {
+                census_push(C, *v);
+            }
+        }
+        for (int i = 0; i < coroutine->frame_count; i++) {
+            census_push(C, hymn_new_func_value(coroutine->frames[i].func));
+        }
+        return;
+    }
+    default:
+        return;
+    }
+}
+
+static void census_walk(Census *C, int root) {
+    while (C->pending_count > 0) {
+        HymnValue value = C->pending[--C->pending_count];
+        if (value.as.o == C->globals) {
+            continue;
+        }
+        bool added;
+        CensusEntry *entry = census_insert(&C->visited, value.as.o, &added);
+        if (added) {
+            entry->root = root;
+            entry->is = value.is;
+            entry->size = census_size(value);
+        } else if (entry->root != root && entry->root != CENSUS_SHARED) {
+            entry->root = CENSUS_SHARED;
+        } else {
+            continue;
+        }
+        census_children(C, value);
+    }
+}
+
+static int census_root(Census *C, const char *name) {
+    if (C->root_count == C->root_capacity) {
+        C->root_capacity = C->root_capacity == 0 ? 64 : C->root_capacity * 2;
+        C->roots = system_realloc(C->roots, (size_t)C->root_capacity * sizeof(CensusRoot));
+    }
+    CensusRoot *root = &C->roots[C->root_count];
+    root->name = name;
+    root->count = 0;
+    root->bytes = 0;
+    return C->root_count++;
+}
+
+static int census_root_compare(const void *a, const void *b) {
+    const CensusRoot *x = (const CensusRoot *)a;
+    const CensusRoot *y = (const CensusRoot *)b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+static HymnString *census_line(HymnString *out, HymnString *line) {
+    out = hymn_string_append(out, line);
+    hymn_string_delete(line);
+    return out;
+}
+
+void hymn_census_track(Hymn *H, bool track) {
+    if (track && H->census == NULL) {
+        H->census = system_malloc(sizeof(HymnCensus));
+        memset(H->census, 0, sizeof(HymnCensus));
+    } else if (!track && H->census != NULL) {
+        census_release(H->census);
+        H->census = NULL;
+    }
+}
+
+HymnString *hymn_census(Hymn *H) {
+    Census census;
+    memset(&census, 0, sizeof(Census));
+    Census *C = &census;
+    C->globals = &H->globals;
+
+    bool added;
+    int root = census_root(C, "globals");
+    CensusEntry *entry = census_insert(&C->visited, C->globals, &added);
+    entry->root = root;
+    entry->is = HYMN_VALUE_TABLE;
+    entry->size = census_size(hymn_new_table_value(C->globals));
+
+    root = census_root(C, "stack");
+    for (HymnValue *v = H->stack; v < H->stack_top; v++) {
+        census_push(C, *v);
+    }
+    for (int i = 0; i < H->frame_count; i++) {
+        census_push(C, hymn_new_func_value(H->frames[i].func));
+    }
+    if (H->coroutine != NULL) {
+        census_push(C, (HymnValue){.is = HYMN_VALUE_COROUTINE, .as = {.o = (void *)H->coroutine}});
+    }
+    census_walk(C, root);
+
+    for (unsigned int i = 0; i < H->globals.bins; i++) {
+        for (HymnTableItem *item = H->globals.items[i]; item != NULL; item = item->next) {
+            root = census_root(C, item->key->string);
+            census_push(C, hymn_new_string_value(item->key));
+            census_push(C, item->value);
+            census_walk(C, root);
+        }
+    }
+
+    root = census_root(C, "imports");
+    census_push(C, hymn_new_table_value(H->imports));
+    census_push(C, hymn_new_array_value(H->paths));
+    census_walk(C, root);
+
+    if (H->snapshot != NULL) {
+        root = census_root(C, "snapshot");
+        census_push(C, hymn_new_table_value(H->snapshot->globals));
+        census_push(C, hymn_new_array_value(H->snapshot->objects));
+        census_push(C, hymn_new_array_value(H->snapshot->copies));
+        census_walk(C, root);
+    }
+
+    root = census_root(C, "strings");
+    for (unsigned int i = 0; i < H->strings.bins; i++) {
+        for (HymnSetItem *item = H->strings.items[i]; item != NULL; item = item->next) {
+            if (census_find(&C->visited, item->string) == NULL) {
+                census_push(C, hymn_new_string_value(item->string));
+                census_walk(C, root);
+            }
+        }
+    }
+
+    int64_t type_count[HYMN_VALUE_COROUTINE + 1];
+    size_t type_bytes[HYMN_VALUE_COROUTINE + 1];
+    memset(type_count, 0, sizeof(type_count));
+    memset(type_bytes, 0, sizeof(type_bytes));
+
+    int64_t shared_count = 0;
+    size_t shared_bytes = 0;
+
+    for (unsigned int i = 0; i < C->visited.capacity; i++) {
+        entry = &C->visited.entries[i];
+        if (entry->key == NULL || entry->key == CENSUS_TOMBSTONE) {
+            continue;
+        }
+        type_count[entry->is]++;
+        type_bytes[entry->is] += entry->size;
+        if (entry->root == CENSUS_SHARED) {
+            shared_count++;
+            shared_bytes += entry->size;
+        } else {
+            C->roots[entry->root].count++;
+            C->roots[entry->root].bytes += entry->size;
+        }
+    }
+
+    HymnString *out = hymn_new_string("");
+
+    out = census_line(out, hymn_string_format("%-24s %10s %14s\n", "TYPE", "COUNT", "BYTES"));
+    for (int i = HYMN_VALUE_STRING; i <= HYMN_VALUE_COROUTINE; i++) {
+        if (type_count[i] > 0) {
+            out = census_line(out, hymn_string_format("%-24s %10" PRId64 " %14zu\n", hymn_value_type((enum HymnValueType)i), type_count[i], type_bytes[i]));
+        }
+    }
+
+    qsort(C->roots, (size_t)C->root_count, sizeof(CensusRoot), census_root_compare);
+
+    out = census_line(out, hymn_string_format("\n%-24s %10s %14s\n", "ROOT", "COUNT", "RETAINED"));
+    for (int i = 0; i < C->root_count; i++) {
+        CensusRoot *r = &C->roots[i];
+        if (r->count > 0) {
+            out = census_line(out, hymn_string_format("%-24s %10" PRId64 " %14zu\n", r->name, r->count, r->bytes));
+        }
+    }
+    if (shared_count > 0) {
+        out = census_line(out, hymn_string_format("%-24s %10" PRId64 " %14zu\n", "(shared)", shared_count, shared_bytes));
+    }
+
+    if (H->census != NULL) {
+        out = census_line(out, hymn_string_format("\n%-24s %10s %14s\n", "UNREACHABLE", "REFERENCES", "BYTES"));
+        HymnCensus *tracked = H->census;
+        for (unsigned int i = 0; i < tracked->capacity; i++) {
+            entry = &tracked->entries[i];
+            if (entry->key == NULL || entry->key == CENSUS_TOMBSTONE || census_find(&C->visited, entry->key) != NULL) {
+                continue;
+            }
+            if (entry->is == HYMN_VALUE_ARRAY) {
+                HymnArray *array = entry->key;
+                HymnValue value = hymn_new_array_value(array);
+                out = census_line(out, hymn_string_format("array %-18p %10d %14zu length %" PRId64 "\n", entry->key, array->count, census_size(value), array->length));
+            } else {
+                HymnTable *table = entry->key;
+                HymnValue value = hymn_new_table_value(table);
+                HymnString *keys = hymn_new_string("");
+                HymnTableItem *item = NULL;
+                for (int k = 0; k < 4 && (item = table_next(table, item == NULL ? NULL : item->key)) != NULL; k++) {
+                    keys = hymn_string_append(keys, k == 0 ? "" : ", ");
+                    keys = hymn_string_append(keys, item->key->string);
+                }
+                out = census_line(out, hymn_string_format("table %-18p %10d %14zu keys [%s%s]\n", entry->key, table->count, census_size(value), keys, table->size > 4 ? ", .." : ""));
+                hymn_string_delete(keys);
+            }
+        }
+    }
+
+    free(C->visited.entries);
+    free(C->pending);
+    free(C->roots);
+
+    return out;
+}
+
+static void reset_stack(Hymn *H) {
+    H->stack_top = H->stack;
+    H->frame_count = 0;
+}
+
+#ifdef HYMN_NO_MEMORY
+void hymn_reference_string(HymnObjectString *string) {
+    (void)string;
+}
+#else
+void hymn_reference_string(HymnObjectString *string) {
+    if (string->frozen) {
+        ATOMIC_INCREMENT(string->count);
+    } else {
+        string->count++;
+    }
+}
+#endif
+
+#ifdef HYMN_NO_MEMORY
+void hymn_reference(HymnValue value) {
+    (void)value;
+}
+#else
+void hymn_reference(HymnValue value) {
+    switch (value.is) {
+    case HYMN_VALUE_STRING:
+        hymn_reference_string((HymnObjectString *)value.as.o);
+        return;
+    case HYMN_VALUE_ARRAY: {
+        HymnArray *array = (HymnArray *)value.as.o;
+        if (array->frozen) {
+            ATOMIC_INCREMENT(array->count);
+        } else {
+            array->count++;
+        }
+        return;
+    }
+    case HYMN_VALUE_TABLE: {
+        HymnTable *table = (HymnTable *)value.as.o;
+        if (table->frozen) {
+            ATOMIC_INCREMENT(table->count);
+        } else {
+            table->count++;
+        }
+        return;
+    }
+    case HYMN_VALUE_FUNC:
+        ((HymnFunction *)value.as.o)->count++;
+        return;
+    case HYMN_VALUE_FUNC_NATIVE:
+        ((HymnNativeFunction *)value.as.o)->count++;
+        return;
+    case HYMN_VALUE_COROUTINE:
+        ((HymnCoroutine *)value.as.o)->count++;
+        return;
+    default:
+        return;
+    }
+}
+#endif
+
+#ifdef HYMN_NO_MEMORY
+void hymn_dereference_string(Hymn *H, HymnObjectString *string) {
+    (void)H;
+    (void)string;
+}
+#else
+void hymn_dereference_string(Hymn *H, HymnObjectString *string) {
+    if (string->frozen) {
+        if (ATOMIC_DECREMENT(string->count) == 0) {
+            hymn_string_delete(string->string);
+            hymn_free(string);
+        }
+        return;
+    }
+    int count = --string->count;
+    assert(count >= 0);
+    if (count == 0) {
+        set_remove(&H->strings, string->string);
+        hymn_string_delete(string->string);
+        hymn_free(string);
+    }
+}
+#endif
+
+#ifdef HYMN_NO_MEMORY
+void hymn_dereference(Hymn *H, HymnValue value) {
+    (void)H;
+    (void)value;
+}
+#else
+void hymn_dereference(Hymn *H, HymnValue value) {
+    switch (value.is) {
+    case HYMN_VALUE_STRING: {
+        HymnObjectString *string = (HymnObjectString *)value.as.o;
+        hymn_dereference_string(H, string);
+        return;
+    }
+    case HYMN_VALUE_ARRAY: {
+        HymnArray *array = (HymnArray *)value.as.o;
+        int count = array->frozen ? ATOMIC_DECREMENT(array->count) : --array->count;
+        assert(count >= 0);
+        if (count == 0) {
+            hymn_array_delete(H, array);
+        }
+        return;
+    }
+    case HYMN_VALUE_TABLE: {
+        HymnTable *table = (HymnTable *)value.as.o;
+        int count = table->frozen ? ATOMIC_DECREMENT(table->count) : --table->count;
+        assert(count >= 0);
+        if (count == 0) {
+            table_delete(H, table);
         }
         return;
     }
@@ -5103,6 +6500,15 @@ void hymn_dereference(Hymn *H, HymnValue value) {
         }
         return;
     }
+    case HYMN_VALUE_COROUTINE: {
+        HymnCoroutine *coroutine = (HymnCoroutine *)value.as.o;
+        int count = --coroutine->count;
+        assert(count >= 0);
+        if (count == 0) {
+            coroutine_delete(H, coroutine);
+        }
+        return;
+    }
     default:
         return;
     }
@@ -5131,7 +6537,31 @@ static void push_string(Hymn *H, HymnString *string) {
     push(H, hymn_new_string_value(intern));
 }
 
+static bool push_concat(Hymn *H, HymnValue a, HymnValue b) {
+    HymnString *string = value_concat(a, b, true);
+    if (string == NULL) {
+        return false;
+    }
+    push_string(H, string);
+    return true;
+}
+
+static const char *allocation_failure(Hymn *H) {
+    if (H->memory_exceeded) {
+        H->memory_exceeded = false;
+        return "memory limit exceeded";
+    }
+    return "out of memory";
+}
+
 static HymnFrame *exception(Hymn *H) {
+    if (H->frame_count == H->frame_base) {
+        HymnValue message = pop(H);
+        assert(H->error == NULL);
+        H->error = hymn_value_to_string(message);
+        hymn_dereference(H, message);
+        return NULL;
+    }
     HymnFrame *frame = current_frame(H);
     while (true) {
         HymnFunction *func = frame->func;
@@ -5158,7 +6588,7 @@ static HymnFrame *exception(Hymn *H) {
             hymn_dereference(H, pop(H));
         }
         H->frame_count--;
-        if (H->frame_count == 0 || func->name == NULL) {
+        if (H->frame_count == H->frame_base || func->name == NULL) {
             assert(H->error == NULL);
             H->error = hymn_value_to_string(message);
             hymn_dereference(H, message);
@@ -5169,12 +6599,20 @@ static HymnFrame *exception(Hymn *H) {
     }
 }
 
+int hymn_frame_row(HymnFrame *frame) {
+    HymnFunction *func = frame->func;
+    if (frame->ip == func->code.instructions) {
+        return line_at(&func->code, 0);
+    }
+    return line_at(&func->code, (int)(frame->ip - func->code.instructions - 1));
+}
+
 static HymnString *stacktrace(Hymn *H) {
     HymnString *trace = hymn_new_string("");
     for (int i = H->frame_count - 1; i >= 0; i--) {
         HymnFrame *frame = &H->frames[i];
         HymnFunction *func = frame->func;
-        int row = func->code.lines[frame->ip - func->code.instructions - 1];
+        int row = hymn_frame_row(frame);
         if (func->name == NULL) {
             if (func->script == NULL) {
                 trace = string_append_format(trace, "  at script:%d", row);
@@ -5217,7 +6655,7 @@ static HymnFrame *throw_error(Hymn *H, const char *format, ...) {
     HymnString *error = hymn_new_string_with_capacity(len + 128);
     error = hymn_string_append(error, chars);
 
-    free(chars);
+    hymn_free(chars);
 
     HymnString *trace = stacktrace(H);
     error = hymn_string_append(error, "\n");
@@ -5240,7 +6678,7 @@ static HymnFrame *throw_exception(Hymn *H, const char *name) {
     error = hymn_string_append(error, name);
     HymnFrame *frame = &H->frames[H->frame_count - 1];
     HymnFunction *func = frame->func;
-    int row = func->code.lines[frame->ip - func->code.instructions - 1];
+    int row = hymn_frame_row(frame);
     if (func->script == NULL) {
         error = string_append_format(error, " script:%d\n", row);
     } else {
@@ -5258,6 +6696,14 @@ static HymnFrame *throw_error_string(Hymn *H, HymnString *string) {
     return frame;
 }
 
+static HymnFrame *throw_operands(Hymn *H, const char *format, HymnValue a, HymnValue b) {
+    const char *is_a = hymn_value_type(a.is);
+    const char *is_b = hymn_value_type(b.is);
+    hymn_dereference(H, a);
+    hymn_dereference(H, b);
+    return throw_error(H, format, is_a, is_b);
+}
+
 HymnValue hymn_new_exception(Hymn *H, const char *error) {
     H->exception = hymn_new_string(error);
     return hymn_new_none();
@@ -5273,12 +6719,56 @@ HymnValue hymn_type_exception(Hymn *H, enum HymnValueType expected, enum HymnVal
     return hymn_new_none();
 }
 
+static void stack_reserve(Hymn *H, HymnValue *base, int size) {
+    int need = (int)(base - H->stack) + size;
+    if (need <= H->stack_capacity) {
+        return;
+    }
+    int capacity = H->stack_capacity;
+    while (capacity < need) {
+        capacity *= 2;
+    }
+    ALLOCATION_KIND("stack");
+    HymnValue *stack = hymn_malloc_int(capacity, sizeof(HymnValue));
+    hymn_mem_copy(stack, H->stack, (int)(H->stack_top - H->stack), sizeof(HymnValue));
+    for (int f = 0; f < H->frame_count; f++) {
+        HymnFrame *frame = &H->frames[f];
+        frame->stack = stack + (frame->stack - H->stack);
+    }
+    H->stack_top = stack + (H->stack_top - H->stack);
+    hymn_free(H->stack);
+    H->stack = stack;
+    H->stack_capacity = capacity;
+}
+
+static bool memory_over_limit(Hymn *H) {
+    H->memory_exceeded = false;
+    return H->memory_limit != 0 && H->memory > H->memory_limit;
+}
+
 static HymnFrame *call(Hymn *H, HymnFunction *func, int count) {
     if (count != func->arity) {
         if (count < func->arity) return throw_error(H, "not enough arguments in call to '%s' (expected %d)", func->name, func->arity);
         return throw_error(H, "too many arguments in call to '%s' (expected %d)", func->name, func->arity);
-    } else if (H->frame_count == HYMN_FRAMES_MAX) {
+    } else if (H->frame_count == H->frame_limit) {
         return throw_error(H, "stack overflow");
+    } else if (H->memory_exceeded && memory_over_limit(H)) {
+        return throw_error(H, "memory limit exceeded");
+    }
+
+    if (H->frame_count == H->frame_capacity) {
+        H->frame_capacity *= 2;
+        ALLOCATION_KIND("stack");
+        H->frames = hymn_realloc_int(H->frames, H->frame_capacity, sizeof(HymnFrame));
+    }
+
+    stack_reserve(H, H->stack_top - count - 1, FRAME_STACK);
+
+    if (func->code.instructions == NULL) {
+        char *error = compile_deferred(H, func);
+        if (error != NULL) {
+            return throw_existing_error(H, error);
+        }
     }
 
     HymnFrame *frame = &H->frames[H->frame_count++];
@@ -5295,16 +6785,34 @@ static HymnFrame *call_value(Hymn *H, HymnValue value, int count) {
         return call(H, hymn_as_func(value), count);
     case HYMN_VALUE_FUNC_NATIVE: {
         HymnNativeFunction *native = hymn_as_native(value);
-        HymnNativeCall func = native->func;
-        HymnValue result = func(H, count, H->stack_top - count);
-        HymnValue *top = H->stack_top - count - 1;
-        while (H->stack_top != top) {
+        HymnValue *arguments = H->stack_top - count;
+        ptrdiff_t top = arguments - 1 - H->stack;
+        HymnValue result;
+        if (native->arity < 0) {
+            result = native->func(H, count, arguments);
+        } else if (native_arguments(H, native, count, arguments)) {
+            result = native->func(H, count, arguments);
+            if (native->scalar && H->exception == NULL && !H->memory_exceeded) {
+                H->stack_top = H->stack + top;
+                hymn_dereference(H, value);
+                hymn_reference(result);
+                push(H, result);
+                return current_frame(H);
+            }
+        } else {
+            result = hymn_new_none();
+        }
+        while (H->stack_top != H->stack + top) {
             hymn_dereference(H, pop(H));
         }
+        hymn_reference(result);
         if (H->exception != NULL) {
+            hymn_dereference(H, result);
             return throw_exception(H, native->name->string);
+        } else if (H->memory_exceeded && memory_over_limit(H)) {
+            hymn_dereference(H, result);
+            return throw_error(H, "memory limit exceeded");
         } else {
-            hymn_reference(result);
             push(H, result);
             return current_frame(H);
         }
@@ -5316,38 +6824,131 @@ static HymnFrame *call_value(Hymn *H, HymnValue value, int count) {
     }
 }
 
-static HymnFrame *import(Hymn *H, HymnObjectString *file) {
-    HymnTable *imports = H->imports;
+typedef struct ImportResolution ImportResolution;
 
-    HymnString *script = NULL;
-    int p = 1;
-    while (true) {
-        HymnFrame *frame = parent_frame(H, p);
-        if (frame == NULL) {
-            break;
-        }
-        script = frame->func->script;
-        if (script) {
-            break;
+struct ImportResolution {
+    HymnString *key;
+    ImportResolution *next;
+    HymnObjectString **candidates;
+    int count;
+    int found;
+    unsigned int hash;
+    char padding[4];
+};
+
+struct HymnImportCache {
+    ImportResolution **items;
+    HymnObjectString **paths;
+    HymnInt path_count;
+    unsigned int bins;
+    unsigned int size;
+};
+
+static void import_cache_clear(Hymn *H, HymnImportCache *cache) {
+    for (unsigned int i = 0; i < cache->bins; i++) {
+        ImportResolution *resolution = cache->items[i];
+        while (resolution != NULL) {
+            ImportResolution *next = resolution->next;
+            for (int c = 0; c < resolution->count; c++) {
+                hymn_dereference_string(H, resolution->candidates[c]);
+            }
+            hymn_free(resolution->candidates);
+            hymn_string_delete(resolution->key);
+            hymn_free(resolution);
+            resolution = next;
         }
-        p++;
+        cache->items[i] = NULL;
     }
+    cache->size = 0;
+    for (HymnInt i = 0; i < cache->path_count; i++) {
+        if (cache->paths[i] != NULL) hymn_dereference_string(H, cache->paths[i]);
+    }
+    hymn_free(cache->paths);
+    cache->paths = NULL;
+    cache->path_count = 0;
+}
 
-    HymnString *look = hymn_path_convert(file->string);
-    HymnString *parent = script ? hymn_path_parent(script) : NULL;
-
-    HymnObjectString *module = NULL;
+static void import_cache_delete(Hymn *H, HymnImportCache *cache) {
+    import_cache_clear(H, cache);
+    hymn_free(cache->items);
+    hymn_free(cache);
+}
 
+static HymnImportCache *import_cache(Hymn *H) {
+    HymnImportCache *cache = H->import_cache;
+    if (cache == NULL) {
+        ALLOCATION_KIND("import");
+        cache = hymn_calloc(1, sizeof(HymnImportCache));
+        cache->bins = 16;
+        cache->items = hymn_calloc(cache->bins, sizeof(ImportResolution *));
+        H->import_cache = cache;
+    }
     HymnArray *paths = H->paths;
-    HymnInt size = paths->length;
-    for (HymnInt i = 0; i < size; i++) {
+    bool valid = cache->paths != NULL && cache->path_count == paths->length;
+    for (HymnInt i = 0; valid && i < paths->length; i++) {
         HymnValue value = paths->items[i];
-        if (!hymn_is_string(value)) {
-            continue;
+        valid = cache->paths[i] == (hymn_is_string(value) ? hymn_as_hymn_string(value) : NULL);
+    }
+    if (!valid) {
+        import_cache_clear(H, cache);
+        ALLOCATION_KIND("import");
+        cache->paths = hymn_malloc_int(paths->length > 0 ? paths->length : 1, sizeof(HymnObjectString *));
+        cache->path_count = paths->length;
+        for (HymnInt i = 0; i < paths->length; i++) {
+            HymnValue value = paths->items[i];
+            cache->paths[i] = hymn_is_string(value) ? hymn_as_hymn_string(value) : NULL;
+            if (cache->paths[i] != NULL) hymn_reference_string(cache->paths[i]);
         }
-        HymnString *question = hymn_as_string(value);
+    }
+    return cache;
+}
 
-        HymnString *replace = hymn_string_replace(question, "<path>", look);
+static void import_cache_resize(HymnImportCache *cache) {
+    unsigned int bins = cache->bins * 2;
+    ALLOCATION_KIND("import");
+    ImportResolution **items = hymn_calloc(bins, sizeof(ImportResolution *));
+    for (unsigned int i = 0; i < cache->bins; i++) {
+        ImportResolution *resolution = cache->items[i];
+        while (resolution != NULL) {
+            ImportResolution *next = resolution->next;
+            unsigned int bin = resolution->hash & (bins - 1);
+            resolution->next = items[bin];
+            items[bin] = resolution;
+            resolution = next;
+        }
+    }
+    hymn_free(cache->items);
+    cache->items = items;
+    cache->bins = bins;
+}
+
+static ImportResolution *import_resolve(Hymn *H, HymnString *look, HymnString *parent) {
+    HymnImportCache *cache = import_cache(H);
+
+    HymnString *key = hymn_string_format("%s\n%s", parent ? parent : "", look);
+    unsigned int hash = string_mix_code(key);
+    unsigned int bin = hash & (cache->bins - 1);
+    for (ImportResolution *resolution = cache->items[bin]; resolution != NULL; resolution = resolution->next) {
+        if (resolution->hash == hash && hymn_string_equal(resolution->key, key)) {
+            hymn_string_delete(key);
+            return resolution;
+        }
+    }
+
+    ALLOCATION_KIND("import");
+    ImportResolution *resolution = hymn_calloc(1, sizeof(ImportResolution));
+    resolution->key = key;
+    resolution->hash = hash;
+    resolution->found = -1;
+    resolution->candidates = hymn_malloc_int(cache->path_count > 0 ? cache->path_count : 1, sizeof(HymnObjectString *));
+
+    for (HymnInt i = 0; i < cache->path_count; i++) {
+        HymnObjectString *question = cache->paths[i];
+        if (question == NULL) {
+            continue;
+        }
+
+        HymnString *replace = hymn_string_replace(question->string, "<path>", look);
         HymnString *path = parent ? hymn_string_replace(replace, "<parent>", parent) : hymn_string_copy(replace);
 
         HymnObjectString *use = hymn_intern_string(H, hymn_path_absolute(path));
@@ -5356,52 +6957,104 @@ static HymnFrame *import(Hymn *H, HymnObjectString *file) {
         hymn_string_delete(path);
         hymn_string_delete(replace);
 
-        if (!hymn_is_undefined(table_get(imports, use))) {
-            hymn_dereference_string(H, use);
-            hymn_string_delete(look);
-            if (parent) hymn_string_delete(parent);
-            return current_frame(H);
-        }
+        resolution->candidates[resolution->count++] = use;
 
         if (hymn_file_exists(use->string)) {
-            module = use;
+            resolution->found = resolution->count - 1;
             break;
         }
+    }
 
-        hymn_dereference_string(H, use);
+    resolution->next = cache->items[bin];
+    cache->items[bin] = resolution;
+    cache->size++;
+    if (cache->size > cache->bins / 4 * 3) {
+        import_cache_resize(cache);
     }
 
-    if (module == NULL) {
-        HymnString *missing = hymn_string_format("import not found: %s", look);
+    return resolution;
+}
 
-        for (HymnInt i = 0; i < size; i++) {
-            HymnValue value = paths->items[i];
-            if (!hymn_is_string(value)) {
-                continue;
-            }
-            HymnString *question = hymn_as_string(value);
 
-            HymnString *replace = hymn_string_replace(question, "<path>", look);
-            HymnString *path = parent ? hymn_string_replace(replace, "<parent>", parent) : hymn_string_copy(replace);
-            HymnString *use = hymn_path_absolute(path);
+static bool file_stamp(const char *path, HymnInt *stamp) {
+    struct stat b;
+    if (stat(path, &b) != 0) {
+        return false;
+    }
+    stamp[0] = (HymnInt)b.st_mtime;
+    stamp[1] = (HymnInt)b.st_size;
+    return true;
+}
+
+static HymnFunction *precompiled_take(Hymn *H, HymnObjectString *module) {
+    if (H->precompiled.size == 0) {
+        return NULL;
+    }
+    HymnValue entry = table_remove(&H->precompiled, module);
+    if (hymn_is_undefined(entry)) {
+        return NULL;
+    }
+    hymn_dereference_string(H, module);
+    HymnArray *array = hymn_as_array(entry);
+    HymnInt stamp[2];
+    HymnFunction *func = NULL;
+    if (file_stamp(module->string, stamp) && stamp[0] == hymn_as_int(array->items[1]) && stamp[1] == hymn_as_int(array->items[2])) {
+        func = hymn_as_func(array->items[0]);
+        hymn_reference(array->items[0]);
+    }
+    hymn_dereference(H, entry);
+    return func;
+}
 
-            missing = string_append_format(missing, "\n  no file: %s", use);
+static HymnFrame *import(Hymn *H, HymnObjectString *file) {
+    HymnTable *imports = H->imports;
 
-            hymn_string_delete(path);
-            hymn_string_delete(replace);
-            hymn_string_delete(use);
+    HymnString *script = NULL;
+    int p = 1;
+    while (true) {
+        HymnFrame *frame = parent_frame(H, p);
+        if (frame == NULL) {
+            break;
+        }
+        script = frame->func->script;
+        if (script) {
+            break;
         }
+        p++;
+    }
 
-        hymn_string_delete(look);
-        if (parent) hymn_string_delete(parent);
+    HymnString *look = hymn_path_convert(file->string);
+    HymnString *parent = script ? hymn_path_parent(script) : NULL;
+
+    ImportResolution *resolution = import_resolve(H, look, parent);
+
+    if (parent) hymn_string_delete(parent);
+
+    HymnObjectString *module = NULL;
+
+    for (int i = 0; i < resolution->count; i++) {
+        HymnObjectString *use = resolution->candidates[i];
+        if (!hymn_is_undefined(table_get(imports, use))) {
+            hymn_string_delete(look);
+            return current_frame(H);
+        }
+        if (i == resolution->found) {
+            module = use;
+            hymn_reference_string(module);
+            break;
+        }
+    }
 
+    if (module == NULL) {
+        HymnString *missing = hymn_string_format("import not found: %s", look);
+        for (int i = 0; i < resolution->count; i++) {
+            missing = string_append_format(missing, "\n  no file: %s", resolution->candidates[i]->string);
+        }
+        hymn_string_delete(look);
         return throw_error_string(H, missing);
     }
 
     hymn_string_delete(look);
-    if (parent != NULL) {
-        hymn_string_delete(parent);
-    }
 
     table_put(imports, module, hymn_new_bool(true));
 
@@ -5422,31 +7075,48 @@ static HymnFrame *import(Hymn *H, HymnObjectString *file) {
     }
 #endif
 
-    HymnString *source = hymn_read_file(module_string);
-    if (source == NULL) {
-        HymnString *failed = hymn_string_format("error reading file: %s\n", module_string);
-        return throw_error_string(H, failed);
-    }
+    HymnFunction *func;
+    char *error;
+
+    HymnFunction *precompiled = precompiled_take(H, module);
+    if (precompiled != NULL) {
+        func = precompiled;
+    } else {
+        HymnString *source = hymn_read_file(module_string);
+        if (source == NULL) {
+            HymnString *failed = hymn_string_format("error reading file: %s\n", module_string);
+            return throw_error_string(H, failed);
+        }
 
-    CompileResult result = compile(H, module_string, source, TYPE_SCRIPT);
+        CompileResult result = compile(H, module_string, source, TYPE_MODULE);
 
-    hymn_string_delete(source);
+        hymn_string_delete(source);
 
-    char *error = result.error;
-    if (error != NULL) {
-        return throw_existing_error(H, error);
+        error = result.error;
+        if (error != NULL) {
+            return throw_existing_error(H, error);
+        }
+
+        func = result.func;
     }
 
-    HymnFunction *func = result.func;
     HymnValue function = hymn_new_func_value(func);
     func->count = 1;
 
     push(H, function);
     call(H, func, 0);
 
+    HymnCoroutine *coroutine = H->coroutine;
+    H->coroutine = NULL;
+
     error = interpret(H);
+
+    H->coroutine = coroutine;
+
     if (error != NULL) return throw_existing_error(H, error);
 
+    hymn_dereference(H, pop(H));
+
     return current_frame(H);
 }
 
@@ -5511,109 +7181,223 @@ static int debug_increment_loop_instruction(HymnString **debug, const char *name
     return index + 5;
 }
 
+static int debug_super_instruction(HymnString **debug, const char *name, int size, HymnByteCode *code, int index) {
+    *debug = hymn_string_append(*debug, name);
+    *debug = hymn_string_append_char(*debug, ':');
+    for (int i = 1; i < size; i++) {
+        *debug = string_append_format(*debug, " [%d]", code->instructions[index + i]);
+    }
+    return index + size;
+}
+
 static int debug_instruction(HymnString **debug, const char *name, int index) {
     *debug = string_append_format(*debug, "%s", name);
     return index + 1;
 }
 
+static const char *opcode_name(uint8_t instruction) {
+    switch (instruction) {
+    case OP_ADD: return "OP_ADD";
+    case OP_ADD_LOCALS: return "OP_ADD_LOCALS";
+    case OP_INSERT: return "OP_INSERT";
+    case OP_ARRAY_POP: return "OP_ARRAY_POP";
+    case OP_ARRAY_PUSH: return "OP_ARRAY_PUSH";
+    case OP_ARRAY_PUSH_LOCALS: return "OP_ARRAY_PUSH_LOCALS";
+    case OP_BIT_AND: return "OP_BIT_AND";
+    case OP_BIT_LEFT_SHIFT: return "OP_BIT_LEFT_SHIFT";
+    case OP_BIT_NOT: return "OP_BIT_NOT";
+    case OP_BIT_OR: return "OP_BIT_OR";
+    case OP_BIT_RIGHT_SHIFT: return "OP_BIT_RIGHT_SHIFT";
+    case OP_BIT_XOR: return "OP_BIT_XOR";
+    case OP_CALL: return "OP_CALL";
+    case OP_SELF: return "OP_SELF";
+    case OP_CLEAR: return "OP_CLEAR";
+    case OP_CONSTANT: return "OP_CONSTANT";
+    case OP_NEW_ARRAY: return "OP_NEW_ARRAY";
+    case OP_NEW_TABLE: return "OP_NEW_TABLE";
+    case OP_COPY: return "OP_COPY";
+    case OP_FREEZE: return "OP_FREEZE";
+    case OP_DEFINE_GLOBAL: return "OP_DEFINE_GLOBAL";
+    case OP_CODES: return "OP_CODES";
+    case OP_STACK: return "OP_STACK";
+    case OP_REFERENCE: return "OP_REFERENCE";
+    case OP_FORMAT: return "OP_FORMAT";
+    case OP_DELETE: return "OP_DELETE";
+    case OP_DIVIDE: return "OP_DIVIDE";
+    case OP_DUPLICATE: return "OP_DUPLICATE";
+    case OP_EQUAL: return "OP_EQUAL";
+    case OP_ECHO: return "OP_ECHO";
+    case OP_EXISTS: return "OP_EXISTS";
+    case OP_FALSE: return "OP_FALSE";
+    case OP_FOR: return "OP_FOR";
+    case OP_FOR_LOOP: return "OP_FOR_LOOP";
+    case OP_GET_DYNAMIC: return "OP_GET_DYNAMIC";
+    case OP_GET_GLOBAL: return "OP_GET_GLOBAL";
+    case OP_GET_GLOBAL_PROPERTY: return "OP_GET_GLOBAL_PROPERTY";
+    case OP_GET_LOCAL: return "OP_GET_LOCAL";
+    case OP_GET_PROPERTY: return "OP_GET_PROPERTY";
+    case OP_GET_LOCALS: return "OP_GET_LOCALS";
+    case OP_GREATER: return "OP_GREATER";
+    case OP_GREATER_EQUAL: return "OP_GREATER_EQUAL";
+    case OP_INCREMENT: return "OP_INCREMENT";
+    case OP_INCREMENT_LOCAL: return "OP_INCREMENT_LOCAL";
+    case OP_INCREMENT_LOCAL_AND_SET: return "OP_INCREMENT_LOCAL_AND_SET";
+    case OP_INCREMENT_LOOP: return "OP_INCREMENT_LOOP";
+    case OP_INDEX: return "OP_INDEX";
+    case OP_SOURCE: return "OP_SOURCE";
+    case OP_JUMP: return "OP_JUMP";
+    case OP_JUMP_IF_EQUAL: return "OP_JUMP_IF_EQUAL";
+    case OP_JUMP_IF_FALSE: return "OP_JUMP_IF_FALSE";
+    case OP_JUMP_IF_GREATER: return "OP_JUMP_IF_GREATER";
+    case OP_JUMP_IF_GREATER_LOCALS: return "OP_JUMP_IF_GREATER_LOCALS";
+    case OP_JUMP_IF_GREATER_EQUAL: return "OP_JUMP_IF_GREATER_EQUAL";
+    case OP_JUMP_IF_LESS: return "OP_JUMP_IF_LESS";
+    case OP_JUMP_IF_LESS_EQUAL: return "OP_JUMP_IF_LESS_EQUAL";
+    case OP_JUMP_IF_NOT_EQUAL: return "OP_JUMP_IF_NOT_EQUAL";
+    case OP_JUMP_IF_TRUE: return "OP_JUMP_IF_TRUE";
+    case OP_KEYS: return "OP_KEYS";
+    case OP_LEN: return "OP_LEN";
+    case OP_LESS: return "OP_LESS";
+    case OP_LESS_EQUAL: return "OP_LESS_EQUAL";
+    case OP_LOOP: return "OP_LOOP";
+    case OP_MODULO: return "OP_MODULO";
+    case OP_MODULO_LOCALS: return "OP_MODULO_LOCALS";
+    case OP_MULTIPLY: return "OP_MULTIPLY";
+    case OP_NEGATE: return "OP_NEGATE";
+    case OP_NONE: return "OP_NONE";
+    case OP_NOT: return "OP_NOT";
+    case OP_NOT_EQUAL: return "OP_NOT_EQUAL";
+    case OP_POP: return "OP_POP";
+    case OP_POP_N: return "OP_POP_N";
+    case OP_POP_TWO: return "OP_POP_TWO";
+    case OP_PRINT: return "OP_PRINT";
+    case OP_RETURN: return "OP_RETURN";
+    case OP_VOID: return "OP_VOID";
+    case OP_YIELD: return "OP_YIELD";
+    case OP_SET_DYNAMIC: return "OP_SET_DYNAMIC";
+    case OP_SET_GLOBAL: return "OP_SET_GLOBAL";
+    case OP_SET_LOCAL: return "OP_SET_LOCAL";
+    case OP_SET_PROPERTY: return "OP_SET_PROPERTY";
+    case OP_SLICE: return "OP_SLICE";
+    case OP_SUBTRACT: return "OP_SUBTRACT";
+    case OP_TAIL_CALL: return "OP_TAIL_CALL";
+    case OP_THROW: return "OP_THROW";
+    case OP_FLOAT: return "OP_FLOAT";
+    case OP_INT: return "OP_INT";
+    case OP_STRING: return "OP_STRING";
+    case OP_TRUE: return "OP_TRUE";
+    case OP_TYPE: return "OP_TYPE";
+    case OP_USE: return "OP_USE";
+        HYMN_SUPER_NAMES
+    default: return NULL;
+    }
+}
+
 static int disassemble_instruction(HymnString **debug, HymnByteCode *code, int index) {
     *debug = string_append_format(*debug, "%04zu ", index);
-    if (index > 0 && code->lines[index] == code->lines[index - 1]) {
+    int start;
+    int end;
+    int row = line_decode(code, index, &start, &end);
+    if (index > start) {
         *debug = hymn_string_append(*debug, "   | ");
     } else {
-        *debug = string_append_format(*debug, "%4d ", code->lines[index]);
+        *debug = string_append_format(*debug, "%4d ", row);
     }
     uint8_t instruction = code->instructions[index];
+    const char *name = opcode_name(instruction);
     switch (instruction) {
-    case OP_ADD: return debug_instruction(debug, "OP_ADD", index);
-    case OP_ADD_LOCALS: return debug_three_byte_instruction(debug, "OP_ADD_LOCALS", code, index);
-    case OP_INSERT: return debug_instruction(debug, "OP_INSERT", index);
-    case OP_ARRAY_POP: return debug_instruction(debug, "OP_ARRAY_POP", index);
-    case OP_ARRAY_PUSH: return debug_instruction(debug, "OP_ARRAY_PUSH", index);
-    case OP_ARRAY_PUSH_LOCALS: return debug_three_byte_instruction(debug, "OP_ARRAY_PUSH_LOCALS", code, index);
-    case OP_BIT_AND: return debug_instruction(debug, "OP_BIT_AND", index);
-    case OP_BIT_LEFT_SHIFT: return debug_instruction(debug, "OP_BIT_LEFT_SHIFT", index);
-    case OP_BIT_NOT: return debug_instruction(debug, "OP_BIT_NOT", index);
-    case OP_BIT_OR: return debug_instruction(debug, "OP_BIT_OR", index);
-    case OP_BIT_RIGHT_SHIFT: return debug_instruction(debug, "OP_BIT_RIGHT_SHIFT", index);
-    case OP_BIT_XOR: return debug_instruction(debug, "OP_BIT_XOR", index);
-    case OP_CALL: return debug_byte_instruction(debug, "OP_CALL", code, index);
-    case OP_SELF: return debug_constant_instruction(debug, "OP_SELF", code, index);
-    case OP_CLEAR: return debug_instruction(debug, "OP_CLEAR", index);
-    case OP_CONSTANT: return debug_constant_instruction(debug, "OP_CONSTANT", code, index);
-    case OP_NEW_ARRAY: return debug_instruction(debug, "OP_NEW_ARRAY", index);
-    case OP_NEW_TABLE: return debug_instruction(debug, "OP_NEW_TABLE", index);
-    case OP_COPY: return debug_instruction(debug, "OP_COPY", index);
-    case OP_DEFINE_GLOBAL: return debug_constant_instruction(debug, "OP_DEFINE_GLOBAL", code, index);
-    case OP_CODES: return debug_instruction(debug, "OP_CODES", index);
-    case OP_STACK: return debug_instruction(debug, "OP_STACK", index);
-    case OP_REFERENCE: return debug_instruction(debug, "OP_REFERENCE", index);
-    case OP_FORMAT: return debug_instruction(debug, "OP_FORMAT", index);
-    case OP_DELETE: return debug_instruction(debug, "OP_DELETE", index);
-    case OP_DIVIDE: return debug_instruction(debug, "OP_DIVIDE", index);
-    case OP_DUPLICATE: return debug_instruction(debug, "OP_DUPLICATE", index);
-    case OP_EQUAL: return debug_instruction(debug, "OP_EQUAL", index);
-    case OP_ECHO: return debug_instruction(debug, "OP_ECHO", index);
-    case OP_EXISTS: return debug_instruction(debug, "OP_EXISTS", index);
-    case OP_FALSE: return debug_instruction(debug, "OP_FALSE", index);
-    case OP_FOR: return debug_for_loop_instruction(debug, "OP_FOR", 1, code, index);
-    case OP_FOR_LOOP: return debug_for_loop_instruction(debug, "OP_FOR_LOOP", -1, code, index);
-    case OP_GET_DYNAMIC: return debug_instruction(debug, "OP_GET_DYNAMIC", index);
-    case OP_GET_GLOBAL: return debug_constant_instruction(debug, "OP_GET_GLOBAL", code, index);
-    case OP_GET_GLOBAL_PROPERTY: return debug_two_constant_instruction(debug, "OP_GET_GLOBAL_PROPERTY", code, index);
-    case OP_GET_LOCAL: return debug_byte_instruction(debug, "OP_GET_LOCAL", code, index);
-    case OP_GET_PROPERTY: return debug_constant_instruction(debug, "OP_GET_PROPERTY", code, index);
-    case OP_GET_LOCALS: return debug_three_byte_instruction(debug, "OP_GET_LOCALS", code, index);
-    case OP_GREATER: return debug_instruction(debug, "OP_GREATER", index);
-    case OP_GREATER_EQUAL: return debug_instruction(debug, "OP_GREATER_EQUAL", index);
-    case OP_INCREMENT: return debug_byte_instruction(debug, "OP_INCREMENT", code, index);
-    case OP_INCREMENT_LOCAL: return debug_three_byte_instruction(debug, "OP_INCREMENT_LOCAL", code, index);
-    case OP_INCREMENT_LOCAL_AND_SET: return debug_three_byte_instruction(debug, "OP_INCREMENT_LOCAL_AND_SET", code, index);
-    case OP_INCREMENT_LOOP: return debug_increment_loop_instruction(debug, "OP_INCREMENT_LOOP", code, index);
-    case OP_INDEX: return debug_instruction(debug, "OP_INDEX", index);
-    case OP_SOURCE: return debug_instruction(debug, "OP_SOURCE", index);
-    case OP_JUMP: return debug_jump_instruction(debug, "OP_JUMP", 1, code, index);
-    case OP_JUMP_IF_EQUAL: return debug_jump_instruction(debug, "OP_JUMP_IF_EQUAL", 1, code, index);
-    case OP_JUMP_IF_FALSE: return debug_jump_instruction(debug, "OP_JUMP_IF_FALSE", 1, code, index);
-    case OP_JUMP_IF_GREATER: return debug_jump_instruction(debug, "OP_JUMP_IF_GREATER", 1, code, index);
-    case OP_JUMP_IF_GREATER_LOCALS: return debug_register_jump_instruction(debug, "OP_JUMP_IF_GREATER_LOCALS", code, index);
-    case OP_JUMP_IF_GREATER_EQUAL: return debug_jump_instruction(debug, "OP_JUMP_IF_GREATER_EQUAL", 1, code, index);
-    case OP_JUMP_IF_LESS: return debug_jump_instruction(debug, "OP_JUMP_IF_LESS", 1, code, index);
-    case OP_JUMP_IF_LESS_EQUAL: return debug_jump_instruction(debug, "OP_JUMP_IF_LESS_EQUAL", 1, code, index);
-    case OP_JUMP_IF_NOT_EQUAL: return debug_jump_instruction(debug, "OP_JUMP_IF_NOT_EQUAL", 1, code, index);
-    case OP_JUMP_IF_TRUE: return debug_jump_instruction(debug, "OP_JUMP_IF_TRUE", 1, code, index);
-    case OP_KEYS: return debug_instruction(debug, "OP_KEYS", index);
-    case OP_LEN: return debug_instruction(debug, "OP_LEN", index);
-    case OP_LESS: return debug_instruction(debug, "OP_LESS", index);
-    case OP_LESS_EQUAL: return debug_instruction(debug, "OP_LESS_EQUAL", index);
-    case OP_LOOP: return debug_jump_instruction(debug, "OP_LOOP", -1, code, index);
-    case OP_MODULO: return debug_instruction(debug, "OP_MODULO", index);
-    case OP_MODULO_LOCALS: return debug_three_byte_instruction(debug, "OP_MODULO_LOCALS", code, index);
-    case OP_MULTIPLY: return debug_instruction(debug, "OP_MULTIPLY", index);
-    case OP_NEGATE: return debug_instruction(debug, "OP_NEGATE", index);
-    case OP_NONE: return debug_instruction(debug, "OP_NONE", index);
-    case OP_NOT: return debug_instruction(debug, "OP_NOT", index);
-    case OP_NOT_EQUAL: return debug_instruction(debug, "OP_NOT_EQUAL", index);
-    case OP_POP: return debug_instruction(debug, "OP_POP", index);
-    case OP_POP_N: return debug_byte_instruction(debug, "OP_POP_N", code, index);
-    case OP_POP_TWO: return debug_instruction(debug, "OP_POP_TWO", index);
-    case OP_PRINT: return debug_instruction(debug, "OP_PRINT", index);
-    case OP_RETURN: return debug_instruction(debug, "OP_RETURN", index);
-    case OP_VOID: return debug_instruction(debug, "OP_VOID", index);
-    case OP_SET_DYNAMIC: return debug_instruction(debug, "OP_SET_DYNAMIC", index);
-    case OP_SET_GLOBAL: return debug_constant_instruction(debug, "OP_SET_GLOBAL", code, index);
-    case OP_SET_LOCAL: return debug_byte_instruction(debug, "OP_SET_LOCAL", code, index);
-    case OP_SET_PROPERTY: return debug_constant_instruction(debug, "OP_SET_PROPERTY", code, index);
-    case OP_SLICE: return debug_instruction(debug, "OP_SLICE", index);
-    case OP_SUBTRACT: return debug_instruction(debug, "OP_SUBTRACT", index);
-    case OP_TAIL_CALL: return debug_byte_instruction(debug, "OP_TAIL_CALL", code, index);
-    case OP_THROW: return debug_instruction(debug, "OP_THROW", index);
-    case OP_FLOAT: return debug_instruction(debug, "OP_FLOAT", index);
-    case OP_INT: return debug_instruction(debug, "OP_INT", index);
-    case OP_STRING: return debug_instruction(debug, "OP_STRING", index);
-    case OP_TRUE: return debug_instruction(debug, "OP_TRUE", index);
-    case OP_TYPE: return debug_instruction(debug, "OP_TYPE", index);
-    case OP_USE: return debug_instruction(debug, "OP_USE", index);
+    case OP_ADD: return debug_instruction(debug, name, index);
+    case OP_ADD_LOCALS: return debug_three_byte_instruction(debug, name, code, index);
+    case OP_INSERT: return debug_instruction(debug, name, index);
+    case OP_ARRAY_POP: return debug_instruction(debug, name, index);
+    case OP_ARRAY_PUSH: return debug_instruction(debug, name, index);
+    case OP_ARRAY_PUSH_LOCALS: return debug_three_byte_instruction(debug, name, code, index);
+    case OP_BIT_AND: return debug_instruction(debug, name, index);
+    case OP_BIT_LEFT_SHIFT: return debug_instruction(debug, name, index);
+    case OP_BIT_NOT: return debug_instruction(debug, name, index);
+    case OP_BIT_OR: return debug_instruction(debug, name, index);
+    case OP_BIT_RIGHT_SHIFT: return debug_instruction(debug, name, index);
+    case OP_BIT_XOR: return debug_instruction(debug, name, index);
+    case OP_CALL: return debug_byte_instruction(debug, name, code, index);
+    case OP_SELF: return debug_constant_instruction(debug, name, code, index);
+    case OP_CLEAR: return debug_instruction(debug, name, index);
+    case OP_CONSTANT: return debug_constant_instruction(debug, name, code, index);
+    case OP_NEW_ARRAY: return debug_instruction(debug, name, index);
+    case OP_NEW_TABLE: return debug_instruction(debug, name, index);
+    case OP_COPY: return debug_instruction(debug, name, index);
+    case OP_FREEZE: return debug_instruction(debug, name, index);
+    case OP_DEFINE_GLOBAL: return debug_constant_instruction(debug, name, code, index);
+    case OP_CODES: return debug_instruction(debug, name, index);
+    case OP_STACK: return debug_instruction(debug, name, index);
+    case OP_REFERENCE: return debug_instruction(debug, name, index);
+    case OP_FORMAT: return debug_instruction(debug, name, index);
+    case OP_DELETE: return debug_instruction(debug, name, index);
+    case OP_DIVIDE: return debug_instruction(debug, name, index);
+    case OP_DUPLICATE: return debug_instruction(debug, name, index);
+    case OP_EQUAL: return debug_instruction(debug, name, index);
+    case OP_ECHO: return debug_instruction(debug, name, index);
+    case OP_EXISTS: return debug_instruction(debug, name, index);
+    case OP_FALSE: return debug_instruction(debug, name, index);
+    case OP_FOR: return debug_for_loop_instruction(debug, name, 1, code, index);
+    case OP_FOR_LOOP: return debug_for_loop_instruction(debug, name, -1, code, index);
+    case OP_GET_DYNAMIC: return debug_instruction(debug, name, index);
+    case OP_GET_GLOBAL: return debug_constant_instruction(debug, name, code, index);
+    case OP_GET_GLOBAL_PROPERTY: return debug_two_constant_instruction(debug, name, code, index);
+    case OP_GET_LOCAL: return debug_byte_instruction(debug, name, code, index);
+    case OP_GET_PROPERTY: return debug_constant_instruction(debug, name, code, index);
+    case OP_GET_LOCALS: return debug_three_byte_instruction(debug, name, code, index);
+    case OP_GREATER: return debug_instruction(debug, name, index);
+    case OP_GREATER_EQUAL: return debug_instruction(debug, name, index);
+    case OP_INCREMENT: return debug_byte_instruction(debug, name, code, index);
+    case OP_INCREMENT_LOCAL: return debug_three_byte_instruction(debug, name, code, index);
+    case OP_INCREMENT_LOCAL_AND_SET: return debug_three_byte_instruction(debug, name, code, index);
+    case OP_INCREMENT_LOOP: return debug_increment_loop_instruction(debug, name, code, index);
+    case OP_INDEX: return debug_instruction(debug, name, index);
+    case OP_SOURCE: return debug_instruction(debug, name, index);
+    case OP_JUMP: return debug_jump_instruction(debug, name, 1, code, index);
+    case OP_JUMP_IF_EQUAL: return debug_jump_instruction(debug, name, 1, code, index);
+    case OP_JUMP_IF_FALSE: return debug_jump_instruction(debug, name, 1, code, index);
+    case OP_JUMP_IF_GREATER: return debug_jump_instruction(debug, name, 1, code, index);
+    case OP_JUMP_IF_GREATER_LOCALS: return debug_register_jump_instruction(debug, name, code, index);
+    case OP_JUMP_IF_GREATER_EQUAL: return debug_jump_instruction(debug, name, 1, code, index);
+    case OP_JUMP_IF_LESS: return debug_jump_instruction(debug, name, 1, code, index);
+    case OP_JUMP_IF_LESS_EQUAL: return debug_jump_instruction(debug, name, 1, code, index);
+    case OP_JUMP_IF_NOT_EQUAL: return debug_jump_instruction(debug, name, 1, code, index);
+    case OP_JUMP_IF_TRUE: return debug_jump_instruction(debug, name, 1, code, index);
+    case OP_KEYS: return debug_instruction(debug, name, index);
+    case OP_LEN: return debug_instruction(debug, name, index);
+    case OP_LESS: return debug_instruction(debug, name, index);
+    case OP_LESS_EQUAL: return debug_instruction(debug, name, index);
+    case OP_LOOP: return debug_jump_instruction(debug, name, -1, code, index);
+    case OP_MODULO: return debug_instruction(debug, name, index);
+    case OP_MODULO_LOCALS: return debug_three_byte_instruction(debug, name, code, index);
+    case OP_MULTIPLY: return debug_instruction(debug, name, index);
+    case OP_NEGATE: return debug_instruction(debug, name, index);
+    case OP_NONE: return debug_instruction(debug, name, index);
+    case OP_NOT: return debug_instruction(debug, name, index);
+    case OP_NOT_EQUAL: return debug_instruction(debug, name, index);
+    case OP_POP: return debug_instruction(debug, name, index);
+    case OP_POP_N: return debug_byte_instruction(debug, name, code, index);
+    case OP_POP_TWO: return debug_instruction(debug, name, index);
+    case OP_PRINT: return debug_instruction(debug, name, index);
+    case OP_RETURN: return debug_instruction(debug, name, index);
+    case OP_VOID: return debug_instruction(debug, name, index);
+    case OP_YIELD: return debug_instruction(debug, name, index);
+    case OP_SET_DYNAMIC: return debug_instruction(debug, name, index);
+    case OP_SET_GLOBAL: return debug_constant_instruction(debug, name, code, index);
+    case OP_SET_LOCAL: return debug_byte_instruction(debug, name, code, index);
+    case OP_SET_PROPERTY: return debug_constant_instruction(debug, name, code, index);
+    case OP_SLICE: return debug_instruction(debug, name, index);
+    case OP_SUBTRACT: return debug_instruction(debug, name, index);
+    case OP_TAIL_CALL: return debug_byte_instruction(debug, name, code, index);
+    case OP_THROW: return debug_instruction(debug, name, index);
+    case OP_FLOAT: return debug_instruction(debug, name, index);
+    case OP_INT: return debug_instruction(debug, name, index);
+    case OP_STRING: return debug_instruction(debug, name, index);
+    case OP_TRUE: return debug_instruction(debug, name, index);
+    case OP_TYPE: return debug_instruction(debug, name, index);
+    case OP_USE: return debug_instruction(debug, name, index);
+        HYMN_SUPER_DISASSEMBLE
     default: *debug = string_append_format(*debug, "UNKNOWN_OPCODE %d\n", instruction); return index + 1;
     }
 }
@@ -5630,6 +7414,138 @@ static HymnString *disassemble_byte_code(HymnByteCode *code) {
     return debug;
 }
 
+#ifdef HYMN_OPCODE_COUNTS
+
+#define OPCODE_PAIRS_TABLE 40
+
+typedef struct OpcodeCount OpcodeCount;
+
+struct OpcodeCount {
+    uint8_t first;
+    uint8_t second;
+    char padding[6];
+    uint64_t count;
+};
+
+struct HymnOpcodeCounts {
+    uint64_t counts[OPCODES];
+    uint64_t pairs[OPCODES][OPCODES];
+    uint8_t previous;
+    char padding[7];
+};
+
+static HymnOpcodeCounts opcode_totals;
+
+static inline void count_opcode(HymnOpcodeCounts *opcodes, uint8_t instruction) {
+    opcodes->counts[instruction]++;
+    if (opcodes->previous < OPCODES) {
+        opcodes->pairs[opcodes->previous][instruction]++;
+    }
+    opcodes->previous = instruction;
+}
+
+static HymnOpcodeCounts *new_opcode_counts(void) {
+    HymnOpcodeCounts *opcodes = system_malloc(sizeof(HymnOpcodeCounts));
+    memset(opcodes, 0, sizeof(HymnOpcodeCounts));
+    opcodes->previous = OPCODES;
+    return opcodes;
+}
+
+static void opcode_counts_merge(HymnOpcodeCounts *opcodes) {
+    for (int i = 0; i < OPCODES; i++) {
+        if (opcodes->counts[i] == 0) {
+            continue;
+        }
+        ATOMIC_ADD_64(opcode_totals.counts[i], opcodes->counts[i]);
+        for (int k = 0; k < OPCODES; k++) {
+            if (opcodes->pairs[i][k] > 0) {
+                ATOMIC_ADD_64(opcode_totals.pairs[i][k], opcodes->pairs[i][k]);
+            }
+        }
+    }
+}
+
+static int opcode_count_compare(const void *a, const void *b) {
+    const OpcodeCount *x = (const OpcodeCount *)a;
+    const OpcodeCount *y = (const OpcodeCount *)b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    if (x->first != y->first) {
+        return (int)x->first - (int)y->first;
+    }
+    return (int)x->second - (int)y->second;
+}
+
+static int opcode_sorted(OpcodeCount *sorted, bool pairs) {
+    int count = 0;
+    for (int i = 0; i < OPCODES; i++) {
+        if (pairs) {
+            for (int k = 0; k < OPCODES; k++) {
+                if (opcode_totals.pairs[i][k] > 0) {
+                    sorted[count++] = (OpcodeCount){.first = (uint8_t)i, .second = (uint8_t)k, .count = opcode_totals.pairs[i][k]};
+                }
+            }
+        } else if (opcode_totals.counts[i] > 0) {
+            sorted[count++] = (OpcodeCount){.first = (uint8_t)i, .count = opcode_totals.counts[i]};
+        }
+    }
+    qsort(sorted, (size_t)count, sizeof(OpcodeCount), opcode_count_compare);
+    return count;
+}
+
+HymnString *hymn_opcode_counts(bool json) {
+    OpcodeCount *sorted = hymn_malloc_int(OPCODES * OPCODES, sizeof(OpcodeCount));
+    uint64_t total = 0;
+    for (int i = 0; i < OPCODES; i++) {
+        total += opcode_totals.counts[i];
+    }
+    double percent = total > 0 ? 100.0 / (double)total : 0.0;
+    HymnString *out = hymn_new_string(json ? "{\"total\": " : "");
+    if (json) {
+        out = string_append_format(out, "%" PRIu64 ", \"opcodes\": [", total);
+    } else {
+        out = string_append_format(out, "%-28s %14s %8s\n", "OPCODE", "COUNT", "PERCENT");
+    }
+    int count = opcode_sorted(sorted, false);
+    for (int i = 0; i < count; i++) {
+        const char *name = opcode_name(sorted[i].first);
+        if (json) {
+            out = string_append_format(out, "%s{\"opcode\": \"%s\", \"count\": %" PRIu64 "}", i == 0 ? "" : ", ", name, sorted[i].count);
+        } else {
+            out = string_append_format(out, "%-28s %14" PRIu64 " %7.2f%%\n", name, sorted[i].count, (double)sorted[i].count * percent);
+        }
+    }
+    if (json) {
+        out = hymn_string_append(out, "], \"pairs\": [");
+    } else {
+        out = string_append_format(out, "\n%-57s %14s %8s\n", "PAIR", "COUNT", "PERCENT");
+    }
+    count = opcode_sorted(sorted, true);
+    for (int i = 0; i < count; i++) {
+        const char *first = opcode_name(sorted[i].first);
+        const char *second = opcode_name(sorted[i].second);
+        if (json) {
+            out = string_append_format(out, "%s{\"first\": \"%s\", \"second\": \"%s\", \"count\": %" PRIu64 "}", i == 0 ? "" : ", ", first, second, sorted[i].count);
+        } else if (i < OPCODE_PAIRS_TABLE) {
+            HymnString *pair = hymn_string_format("%s %s", first, second);
+            out = string_append_format(out, "%-57s %14" PRIu64 " %7.2f%%\n", pair, sorted[i].count, (double)sorted[i].count * percent);
+            hymn_string_delete(pair);
+        }
+    }
+    if (json) {
+        out = hymn_string_append(out, "]}\n");
+    }
+    hymn_free(sorted);
+    return out;
+}
+
+void hymn_opcode_counts_clear(void) {
+    memset(&opcode_totals, 0, sizeof(opcode_totals));
+}
+
+#endif
+
 #define READ_BYTE(F) (*F->ip++)
 
 #define READ_SHORT(F) (F->ip += 2, (((int)F->ip[-2] << 8) | (int)F->ip[-1]))
@@ -5645,6 +7561,18 @@ static HymnString *disassemble_byte_code(HymnByteCode *code) {
     }                                      \
     goto dispatch;
 
+#define CHECK_INTERRUPT()                                     \
+    if (H->interrupt) {                                       \
+        const char *stop = NULL;                              \
+        enum Interrupt action = interrupt(H, &stop);          \
+        if (action == INTERRUPT_YIELD) {                      \
+            frame->ip--;                                      \
+            return;                                           \
+        } else if (action == INTERRUPT_THROW) {               \
+            THROW("%s", stop)                                 \
+        }                                                     \
+    }
+
 #define COMPARE_OP(compare)                                                                       \
     HymnValue b = pop(H);                                                                         \
     HymnValue a = pop(H);                                                                         \
@@ -5680,6 +7608,149 @@ static HymnString *disassemble_byte_code(HymnByteCode *code) {
         THROW("comparison '" #compare "' can't use %s and %s (expected numbers)", is_a, is_b)     \
     }
 
+#define THROW_OPERANDS(format, a, b)          \
+    frame = throw_operands(H, format, a, b); \
+    if (frame == NULL) {                     \
+        return;                              \
+    }                                        \
+    goto dispatch;
+
+#define POP_OP() hymn_dereference(H, pop(H));
+
+#define CONSTANT_OP()                          \
+    HymnValue constant = READ_CONSTANT(frame); \
+    hymn_reference(constant);                  \
+    push(H, constant);
+
+#define GET_LOCAL_OP()                    \
+    int slot = READ_BYTE(frame);          \
+    HymnValue value = frame->stack[slot]; \
+    hymn_reference(value);                \
+    push(H, value);
+
+#define SET_LOCAL_OP()                       \
+    int slot = READ_BYTE(frame);             \
+    HymnValue value = peek(H, 1);            \
+    hymn_dereference(H, frame->stack[slot]); \
+    frame->stack[slot] = value;              \
+    hymn_reference(value);
+
+#define GET_GLOBAL_OP()                                                 \
+    HymnObjectString *name = hymn_as_hymn_string(READ_CONSTANT(frame)); \
+    HymnValue get = table_get(&H->globals, name);                       \
+    if (hymn_is_undefined(get)) {                                       \
+        THROW("undefined global '%s'", name->string)                    \
+    }                                                                   \
+    hymn_reference(get);                                                \
+    push(H, get);
+
+#define GET_PROPERTY_OP()                                               \
+    HymnValue value = pop(H);                                           \
+    if (!hymn_is_table(value)) {                                        \
+        const char *is = hymn_value_type(value.is);                     \
+        hymn_dereference(H, value);                                     \
+        THROW("can't get property of %s (expected table)", is)          \
+    }                                                                   \
+    HymnTable *table = hymn_as_table(value);                            \
+    HymnObjectString *name = hymn_as_hymn_string(READ_CONSTANT(frame)); \
+    HymnValue get = table_get(table, name);                             \
+    if (hymn_is_undefined(get)) {                                       \
+        get.is = HYMN_VALUE_NONE;                                       \
+    } else {                                                            \
+        hymn_reference(get);                                            \
+    }                                                                   \
+    hymn_dereference(H, value);                                         \
+    push(H, get);
+
+#define EQUAL_OP(negate)                                    \
+    HymnValue b = pop(H);                                   \
+    HymnValue a = pop(H);                                   \
+    push(H, hymn_new_bool(negate hymn_values_equal(a, b))); \
+    hymn_dereference(H, a);                                 \
+    hymn_dereference(H, b);
+
+#define CONCAT_OP(a, b)                       \
+    if (!push_concat(H, a, b)) {              \
+        hymn_dereference(H, a);               \
+        hymn_dereference(H, b);               \
+        THROW("%s", allocation_failure(H))    \
+    }
+
+#define ADD_OP()                                        \
+    HymnValue b = pop(H);                               \
+    HymnValue a = pop(H);                               \
+    if (hymn_is_none(a)) {                              \
+        if (hymn_is_string(b)) {                        \
+            CONCAT_OP(a, b)                             \
+        } else {                                        \
+            THROW_OPERANDS("can't add %s and %s", a, b) \
+        }                                               \
+    } else if (hymn_is_bool(a)) {                       \
+        if (hymn_is_string(b)) {                        \
+            CONCAT_OP(a, b)                             \
+        } else {                                        \
+            THROW_OPERANDS("can't add %s and %s", a, b) \
+        }                                               \
+    } else if (hymn_is_int(a)) {                        \
+        if (hymn_is_int(b)) {                           \
+            a.as.i += b.as.i;                           \
+            push(H, a);                                 \
+        } else if (hymn_is_float(b)) {                  \
+            b.as.f += (HymnFloat)a.as.i;                \
+            push(H, a);                                 \
+        } else if (hymn_is_string(b)) {                 \
+            CONCAT_OP(a, b)                             \
+        } else {                                        \
+            THROW_OPERANDS("can't add %s and %s", a, b) \
+        }                                               \
+    } else if (hymn_is_float(a)) {                      \
+        if (hymn_is_int(b)) {                           \
+            a.as.f += (HymnFloat)b.as.i;                \
+            push(H, a);                                 \
+        } else if (hymn_is_float(b)) {                  \
+            a.as.f += b.as.f;                           \
+            push(H, a);                                 \
+        } else if (hymn_is_string(b)) {                 \
+            CONCAT_OP(a, b)                             \
+        } else {                                        \
+            THROW_OPERANDS("can't add %s and %s", a, b) \
+        }                                               \
+    } else if (hymn_is_string(a)) {                     \
+        CONCAT_OP(a, b)                                 \
+    } else {                                            \
+        THROW_OPERANDS("can't add %s and %s", a, b)     \
+    }                                                   \
+    hymn_dereference(H, a);                             \
+    hymn_dereference(H, b);
+
+#define SUBTRACT_OP()                                                           \
+    HymnValue b = pop(H);                                                       \
+    HymnValue a = pop(H);                                                       \
+    if (hymn_is_int(a)) {                                                       \
+        if (hymn_is_int(b)) {                                                   \
+            a.as.i -= b.as.i;                                                   \
+            push(H, a);                                                         \
+        } else if (hymn_is_float(b)) {                                          \
+            HymnValue new = hymn_new_float((HymnFloat)a.as.i);                  \
+            new.as.f -= b.as.f;                                                 \
+            push(H, new);                                                       \
+        } else {                                                                \
+            THROW_OPERANDS("can't subtract %s and %s (expected numbers)", a, b) \
+        }                                                                       \
+    } else if (hymn_is_float(a)) {                                              \
+        if (hymn_is_int(b)) {                                                   \
+            a.as.f -= (HymnFloat)b.as.i;                                        \
+            push(H, a);                                                         \
+        } else if (hymn_is_float(b)) {                                          \
+            a.as.f -= b.as.f;                                                   \
+            push(H, a);                                                         \
+        } else {                                                                \
+            THROW_OPERANDS("can't subtract %s and %s (expected numbers)", a, b) \
+        }                                                                       \
+    } else {                                                                    \
+        THROW_OPERANDS("can't subtract %s and %s (expected numbers)", a, b)     \
+    }
+
 #define JUMP_COMPARE_OP(compare)                                         \
     HymnValue b = pop(H);                                                \
     HymnValue a = pop(H);                                                \
@@ -5714,40 +7785,171 @@ static HymnString *disassemble_byte_code(HymnByteCode *code) {
         frame->ip += jump;                                               \
     }
 
-static void run(Hymn *H) {
+enum Interrupt {
+    INTERRUPT_NONE,
+    INTERRUPT_THROW,
+    INTERRUPT_YIELD,
+};
+
+static enum Interrupt interrupt(Hymn *H, const char **error) {
+    H->interrupt = 0;
+    if (H->sample) {
+        H->sample = 0;
+        if (H->sampler != NULL) {
+            H->sampler(H);
+        }
+    }
+    if (H->memory_exceeded && memory_over_limit(H)) {
+        *error = "memory limit exceeded";
+        return INTERRUPT_THROW;
+    }
+    enum HymnBudget budget = HYMN_BUDGET_CONTINUE;
+    if (H->interrupted) {
+        H->interrupted = 0;
+        *error = "interrupted";
+        budget = H->budget_callback != NULL ? H->budget_callback(H, H->budget_user) : HYMN_BUDGET_ABORT;
+    } else if (H->budget > 0 && --H->budget_left <= 0) {
+        H->budget_left = H->budget;
+        *error = "budget exceeded";
+        budget = H->budget_callback != NULL ? H->budget_callback(H, H->budget_user) : HYMN_BUDGET_ABORT;
+    }
+    if (H->budget > 0) {
+        H->interrupt = 1;
+    }
+    switch (budget) {
+    case HYMN_BUDGET_ABORT: return INTERRUPT_THROW;
+    case HYMN_BUDGET_YIELD:
+        if (H->coroutine == NULL) {
+            return INTERRUPT_THROW;
+        }
+        H->coroutine->preempted = true;
+        H->yielded = true;
+        push(H, hymn_new_none());
+        return INTERRUPT_YIELD;
+    default: return INTERRUPT_NONE;
+    }
+}
+
+typedef struct TraceFrame TraceFrame;
+typedef struct Trace Trace;
+
+struct TraceFrame {
+    HymnFunction *func;
+    int line;
+    int start;
+    int end;
+    char padding[4];
+};
+
+struct Trace {
+    TraceFrame *frames;
+    int count;
+    int capacity;
+    int base;
+    char padding[4];
+};
+
+static void trace_unwind(Hymn *H, Trace *trace, int depth) {
+    while (trace->count > depth) {
+        TraceFrame *top = &trace->frames[--trace->count];
+        if (H->tracer != NULL && (H->trace_events & HYMN_TRACE_RETURN)) {
+            H->tracer(H, HYMN_TRACE_RETURN, top->func, top->line, H->trace_user);
+        }
+        hymn_dereference(H, hymn_new_func_value(top->func));
+    }
+}
+
+static void trace_dispatch(Hymn *H, HymnFrame *frame, Trace *trace) {
+    int depth = H->frame_count - trace->base;
+    if (depth < 0) {
+        depth = 0;
+    }
+    if (depth < trace->count) {
+        trace_unwind(H, trace, depth);
+    }
+    if (depth > 0 && depth == trace->count && trace->frames[depth - 1].func != frame->func) {
+        trace_unwind(H, trace, depth - 1);
+    }
+    while (trace->count < depth) {
+        if (trace->count == trace->capacity) {
+            trace->capacity = trace->capacity == 0 ? 16 : trace->capacity * 2;
+            trace->frames = system_realloc(trace->frames, (size_t)trace->capacity * sizeof(TraceFrame));
+        }
+        HymnFrame *called = &H->frames[trace->base + trace->count];
+        TraceFrame *top = &trace->frames[trace->count++];
+        top->func = called->func;
+        top->line = 0;
+        top->start = 0;
+        top->end = 0;
+        hymn_reference(hymn_new_func_value(top->func));
+        if (H->tracer != NULL && (H->trace_events & HYMN_TRACE_CALL)) {
+            H->tracer(H, HYMN_TRACE_CALL, top->func, line_at(&top->func->code, 0), H->trace_user);
+        }
+    }
+    if (depth > 0) {
+        TraceFrame *top = &trace->frames[depth - 1];
+        int offset = (int)(frame->ip - frame->func->code.instructions);
+        if (offset >= top->start && offset < top->end) {
+            return;
+        }
+        int line = line_decode(&frame->func->code, offset, &top->start, &top->end);
+        if (line != top->line) {
+            top->line = line;
+            if (H->tracer != NULL && (H->trace_events & HYMN_TRACE_LINE)) {
+                H->tracer(H, HYMN_TRACE_LINE, top->func, line, H->trace_user);
+            }
+        }
+    }
+}
+
+static ALWAYS_INLINE void run_loop(Hymn *H, const bool traced, Trace *trace) {
     HymnFrame *frame = current_frame(H);
 
 dispatch:
+    if (traced) {
+        trace_dispatch(H, frame, trace);
+    }
+#ifdef HYMN_OPCODE_COUNTS
+    count_opcode(H->opcode_counts, *frame->ip);
+#endif
     switch (READ_BYTE(frame)) {
     case OP_VOID: {
         H->frame_count--;
-        bool done = H->frame_count == 0 || frame->func->name == NULL;
+        bool done = H->frame_count == H->frame_base || frame->func->name == NULL;
         while (H->stack_top != frame->stack) {
             hymn_dereference(H, pop(H));
         }
+        push(H, hymn_new_none());
         if (done) {
             return;
         }
-        push(H, hymn_new_none());
         frame = current_frame(H);
         goto dispatch;
     }
     case OP_RETURN: {
         HymnValue result = pop(H);
         H->frame_count--;
-        bool done = H->frame_count == 0 || frame->func->name == NULL;
+        bool done = H->frame_count == H->frame_base || frame->func->name == NULL;
         while (H->stack_top != frame->stack) {
             hymn_dereference(H, pop(H));
         }
+        push(H, result);
         if (done) {
             return;
         }
-        push(H, result);
         frame = current_frame(H);
         goto dispatch;
     }
+    case OP_YIELD: {
+        if (H->coroutine == NULL) {
+            hymn_dereference(H, pop(H));
+            THROW("can't yield outside a coroutine")
+        }
+        H->yielded = true;
+        return;
+    }
     case OP_POP: {
-        hymn_dereference(H, pop(H));
+        POP_OP()
         goto dispatch;
     }
     case OP_POP_TWO: {
@@ -5775,6 +7977,7 @@ dispatch:
         goto dispatch;
     }
     case OP_CALL: {
+        CHECK_INTERRUPT()
         int count = READ_BYTE(frame);
         HymnValue value = peek(H, count + 1);
         frame = call_value(H, value, count);
@@ -5784,18 +7987,22 @@ dispatch:
         goto dispatch;
     }
     case OP_TAIL_CALL: {
+        CHECK_INTERRUPT()
         int count = READ_BYTE(frame);
         HymnValue value = peek(H, count + 1);
         if (!hymn_is_func(value)) {
             frame = call_value(H, value, count);
         } else {
             HymnFunction *func = hymn_as_func(value);
+            char *error = NULL;
             if (count != func->arity) {
                 if (count < func->arity) frame = throw_error(H, "not enough arguments in call to '%s' (expected %d)", func->name, func->arity);
                 frame = throw_error(H, "too many arguments in call to '%s' (expected %d)", func->name, func->arity);
                 if (frame == NULL) {
                     return;
                 }
+            } else if (func->code.instructions == NULL && (error = compile_deferred(H, func)) != NULL) {
+                frame = throw_existing_error(H, error);
             } else {
                 HymnValue *top = H->stack_top;
                 HymnValue *new_frame = top - count - 1;
@@ -5929,11 +8136,13 @@ dispatch:
         goto dispatch;
     }
     case OP_LOOP: {
+        CHECK_INTERRUPT()
         int jump = READ_SHORT(frame);
         frame->ip -= jump;
         goto dispatch;
     }
     case OP_INCREMENT_LOOP: {
+        CHECK_INTERRUPT()
         int slot = READ_BYTE(frame);
         int increment = READ_BYTE(frame);
         int jump = READ_SHORT(frame);
@@ -5992,6 +8201,7 @@ dispatch:
         goto dispatch;
     }
     case OP_FOR_LOOP: {
+        CHECK_INTERRUPT()
         int slot = READ_BYTE(frame);
         HymnValue object = frame->stack[slot];
         int index = slot + 1;
@@ -6030,19 +8240,11 @@ dispatch:
         goto dispatch;
     }
     case OP_EQUAL: {
-        HymnValue b = pop(H);
-        HymnValue a = pop(H);
-        push(H, hymn_new_bool(hymn_values_equal(a, b)));
-        hymn_dereference(H, a);
-        hymn_dereference(H, b);
+        EQUAL_OP()
         goto dispatch;
     }
     case OP_NOT_EQUAL: {
-        HymnValue b = pop(H);
-        HymnValue a = pop(H);
-        push(H, hymn_new_bool(!hymn_values_equal(a, b)));
-        hymn_dereference(H, a);
-        hymn_dereference(H, b);
+        EQUAL_OP(!)
         goto dispatch;
     }
     case OP_LESS: {
@@ -6062,19 +8264,23 @@ dispatch:
         goto dispatch;
     }
     case OP_ADD: {
-        HymnValue b = pop(H);
-        HymnValue a = pop(H);
+        ADD_OP()
+        goto dispatch;
+    }
+    case OP_ADD_LOCALS: {
+        HymnValue a = frame->stack[READ_BYTE(frame)];
+        HymnValue b = frame->stack[READ_BYTE(frame)];
         if (hymn_is_none(a)) {
             if (hymn_is_string(b)) {
-                push_string(H, value_concat(a, b));
+                if (!push_concat(H, a, b)) goto bad_concat_two;
             } else {
-                goto bad_add;
+                goto bad_add_two;
             }
         } else if (hymn_is_bool(a)) {
             if (hymn_is_string(b)) {
-                push_string(H, value_concat(a, b));
+                if (!push_concat(H, a, b)) goto bad_concat_two;
             } else {
-                goto bad_add;
+                goto bad_add_two;
             }
         } else if (hymn_is_int(a)) {
             if (hymn_is_int(b)) {
@@ -6084,9 +8290,9 @@ dispatch:
                 b.as.f += (HymnFloat)a.as.i;
                 push(H, a);
             } else if (hymn_is_string(b)) {
-                push_string(H, value_concat(a, b));
+                if (!push_concat(H, a, b)) goto bad_concat_two;
             } else {
-                goto bad_add;
+                goto bad_add_two;
             }
         } else if (hymn_is_float(a)) {
             if (hymn_is_int(b)) {
@@ -6096,84 +8302,32 @@ dispatch:
                 a.as.f += b.as.f;
                 push(H, a);
             } else if (hymn_is_string(b)) {
-                push_string(H, value_concat(a, b));
+                if (!push_concat(H, a, b)) goto bad_concat_two;
             } else {
-                goto bad_add;
+                goto bad_add_two;
             }
         } else if (hymn_is_string(a)) {
-            push_string(H, value_concat(a, b));
+            if (!push_concat(H, a, b)) goto bad_concat_two;
         } else {
-            goto bad_add;
+            goto bad_add_two;
         }
-        hymn_dereference(H, a);
-        hymn_dereference(H, b);
         goto dispatch;
-    bad_add:;
+    bad_concat_two:
+        THROW("%s", allocation_failure(H))
+    bad_add_two:;
         const char *is_a = hymn_value_type(a.is);
         const char *is_b = hymn_value_type(b.is);
         hymn_dereference(H, a);
         hymn_dereference(H, b);
         THROW("can't add %s and %s", is_a, is_b)
     }
-    case OP_ADD_LOCALS: {
-        HymnValue a = frame->stack[READ_BYTE(frame)];
-        HymnValue b = frame->stack[READ_BYTE(frame)];
+    case OP_INCREMENT: {
+        HymnValue a = pop(H);
+        HymnInt increment = READ_BYTE(frame);
         if (hymn_is_none(a)) {
-            if (hymn_is_string(b)) {
-                push_string(H, value_concat(a, b));
-            } else {
-                goto bad_add_two;
-            }
+            goto bad_increment;
         } else if (hymn_is_bool(a)) {
-            if (hymn_is_string(b)) {
-                push_string(H, value_concat(a, b));
-            } else {
-                goto bad_add_two;
-            }
-        } else if (hymn_is_int(a)) {
-            if (hymn_is_int(b)) {
-                a.as.i += b.as.i;
-                push(H, a);
-            } else if (hymn_is_float(b)) {
-                b.as.f += (HymnFloat)a.as.i;
-                push(H, a);
-            } else if (hymn_is_string(b)) {
-                push_string(H, value_concat(a, b));
-            } else {
-                goto bad_add_two;
-            }
-        } else if (hymn_is_float(a)) {
-            if (hymn_is_int(b)) {
-                a.as.f += (HymnFloat)b.as.i;
-                push(H, a);
-            } else if (hymn_is_float(b)) {
-                a.as.f += b.as.f;
-                push(H, a);
-            } else if (hymn_is_string(b)) {
-                push_string(H, value_concat(a, b));
-            } else {
-                goto bad_add_two;
-            }
-        } else if (hymn_is_string(a)) {
-            push_string(H, value_concat(a, b));
-        } else {
-            goto bad_add_two;
-        }
-        goto dispatch;
-    bad_add_two:;
-        const char *is_a = hymn_value_type(a.is);
-        const char *is_b = hymn_value_type(b.is);
-        hymn_dereference(H, a);
-        hymn_dereference(H, b);
-        THROW("can't add %s and %s", is_a, is_b)
-    }
-    case OP_INCREMENT: {
-        HymnValue a = pop(H);
-        HymnInt increment = READ_BYTE(frame);
-        if (hymn_is_none(a)) {
-            goto bad_increment;
-        } else if (hymn_is_bool(a)) {
-            goto bad_increment;
+            goto bad_increment;
         } else if (hymn_is_int(a)) {
             a.as.i += increment;
             push(H, a);
@@ -6181,7 +8335,10 @@ dispatch:
             a.as.f += (HymnFloat)increment;
             push(H, a);
         } else if (hymn_is_string(a)) {
-            push_string(H, value_concat(a, hymn_new_int(increment)));
+            if (!push_concat(H, a, hymn_new_int(increment))) {
+                hymn_dereference(H, a);
+                THROW("%s", allocation_failure(H))
+            }
         } else {
             goto bad_increment;
         }
@@ -6193,39 +8350,8 @@ dispatch:
         THROW("can't increment %s", is)
     }
     case OP_SUBTRACT: {
-        HymnValue b = pop(H);
-        HymnValue a = pop(H);
-        if (hymn_is_int(a)) {
-            if (hymn_is_int(b)) {
-                a.as.i -= b.as.i;
-                push(H, a);
-            } else if (hymn_is_float(b)) {
-                HymnValue new = hymn_new_float((HymnFloat)a.as.i);
-                new.as.f -= b.as.f;
-                push(H, new);
-            } else {
-                goto bad_subtract;
-            }
-        } else if (hymn_is_float(a)) {
-            if (hymn_is_int(b)) {
-                a.as.f -= (HymnFloat)b.as.i;
-                push(H, a);
-            } else if (hymn_is_float(b)) {
-                a.as.f -= b.as.f;
-                push(H, a);
-            } else {
-                goto bad_subtract;
-            }
-        } else {
-            goto bad_subtract;
-        }
+        SUBTRACT_OP()
         goto dispatch;
-    bad_subtract:;
-        const char *is_a = hymn_value_type(a.is);
-        const char *is_b = hymn_value_type(b.is);
-        hymn_dereference(H, a);
-        hymn_dereference(H, b);
-        THROW("can't subtract %s and %s (expected numbers)", is_a, is_b)
     }
     case OP_MULTIPLY: {
         HymnValue b = pop(H);
@@ -6451,9 +8577,7 @@ dispatch:
         goto dispatch;
     }
     case OP_CONSTANT: {
-        HymnValue constant = READ_CONSTANT(frame);
-        hymn_reference(constant);
-        push(H, constant);
+        CONSTANT_OP()
         goto dispatch;
     }
     case OP_NEW_ARRAY: {
@@ -6494,13 +8618,7 @@ dispatch:
         goto dispatch;
     }
     case OP_GET_GLOBAL: {
-        HymnObjectString *name = hymn_as_hymn_string(READ_CONSTANT(frame));
-        HymnValue get = table_get(&H->globals, name);
-        if (hymn_is_undefined(get)) {
-            THROW("undefined global '%s'", name->string)
-        }
-        hymn_reference(get);
-        push(H, get);
+        GET_GLOBAL_OP()
         goto dispatch;
     }
     case OP_GET_GLOBAL_PROPERTY: {
@@ -6524,18 +8642,11 @@ dispatch:
         goto dispatch;
     }
     case OP_SET_LOCAL: {
-        int slot = READ_BYTE(frame);
-        HymnValue value = peek(H, 1);
-        hymn_dereference(H, frame->stack[slot]);
-        frame->stack[slot] = value;
-        hymn_reference(value);
+        SET_LOCAL_OP()
         goto dispatch;
     }
     case OP_GET_LOCAL: {
-        int slot = READ_BYTE(frame);
-        HymnValue value = frame->stack[slot];
-        hymn_reference(value);
-        push(H, value);
+        GET_LOCAL_OP()
         goto dispatch;
     }
     case OP_GET_LOCALS: {
@@ -6589,6 +8700,16 @@ dispatch:
             THROW("can't set property of %s (expected table)", is)
         }
         HymnTable *table = hymn_as_table(table_value);
+        if (table->frozen) {
+            hymn_dereference(H, value);
+            hymn_dereference(H, table_value);
+            THROW("can't set property of frozen table")
+        }
+        if (!table_reserve(table)) {
+            hymn_dereference(H, value);
+            hymn_dereference(H, table_value);
+            THROW("%s", allocation_failure(H))
+        }
         HymnObjectString *name = hymn_as_hymn_string(READ_CONSTANT(frame));
         hymn_set_property(H, table, name, value);
         push(H, value);
@@ -6596,22 +8717,7 @@ dispatch:
         goto dispatch;
     }
     case OP_GET_PROPERTY: {
-        HymnValue value = pop(H);
-        if (!hymn_is_table(value)) {
-            const char *is = hymn_value_type(value.is);
-            hymn_dereference(H, value);
-            THROW("can't get property of %s (expected table)", is)
-        }
-        HymnTable *table = hymn_as_table(value);
-        HymnObjectString *name = hymn_as_hymn_string(READ_CONSTANT(frame));
-        HymnValue get = table_get(table, name);
-        if (hymn_is_undefined(get)) {
-            get.is = HYMN_VALUE_NONE;
-        } else {
-            hymn_reference(get);
-        }
-        hymn_dereference(H, value);
-        push(H, get);
+        GET_PROPERTY_OP()
         goto dispatch;
     }
     case OP_EXISTS: {
@@ -6631,7 +8737,7 @@ dispatch:
         }
         HymnTable *table = hymn_as_table(object);
         HymnObjectString *name = hymn_as_hymn_string(value);
-        HymnValue g = table_get(table, name);
+        HymnValue g = name->frozen ? hymn_table_get(table, name->string) : table_get(table, name);
         if (hymn_is_undefined(g)) {
             push(H, hymn_new_bool(false));
         } else {
@@ -6654,6 +8760,11 @@ dispatch:
                 THROW("array assignment index can't be %s (expected integer)", is)
             }
             HymnArray *array = hymn_as_array(object);
+            if (array->frozen) {
+                hymn_dereference(H, value);
+                hymn_dereference(H, object);
+                THROW("can't assign value to frozen array")
+            }
             HymnInt size = array->length;
             HymnInt index = hymn_as_int(property);
             if (index > size) {
@@ -6672,6 +8783,11 @@ dispatch:
                 }
             }
             if (index == size) {
+                if (!array_reserve(array, size + 1)) {
+                    hymn_dereference(H, value);
+                    hymn_dereference(H, object);
+                    THROW("%s", allocation_failure(H))
+                }
                 hymn_array_push(array, value);
             } else {
                 hymn_dereference(H, array->items[index]);
@@ -6686,7 +8802,23 @@ dispatch:
                 THROW("table assignment key can't be %s (expected string)", is)
             }
             HymnTable *table = hymn_as_table(object);
+            if (table->frozen) {
+                hymn_dereference(H, value);
+                hymn_dereference(H, property);
+                hymn_dereference(H, object);
+                THROW("can't assign value to frozen table")
+            }
+            if (!table_reserve(table)) {
+                hymn_dereference(H, value);
+                hymn_dereference(H, property);
+                hymn_dereference(H, object);
+                THROW("%s", allocation_failure(H))
+            }
             HymnObjectString *name = hymn_as_hymn_string(property);
+            if (name->frozen) {
+                name = hymn_intern_string(H, hymn_string_copy(name->string));
+                hymn_dereference(H, property);
+            }
             HymnValue previous = table_put(table, name, value);
             if (hymn_is_undefined(previous)) {
                 hymn_reference_string(name);
@@ -6775,7 +8907,7 @@ dispatch:
             }
             HymnTable *table = hymn_as_table(v);
             HymnObjectString *name = hymn_as_hymn_string(i);
-            HymnValue g = table_get(table, name);
+            HymnValue g = name->frozen ? hymn_table_get(table, name->string) : table_get(table, name);
             if (hymn_is_undefined(g)) {
                 g.is = HYMN_VALUE_NONE;
             } else {
@@ -6828,6 +8960,9 @@ dispatch:
             const char *is = hymn_value_type(a.is);
             hymn_dereference(H, a);
             THROW("call to 'pop' can't use %s (expected array)", is)
+        } else if (hymn_as_array(a)->frozen) {
+            hymn_dereference(H, a);
+            THROW("call to 'pop' can't modify frozen array")
         } else {
             HymnValue value = hymn_array_pop(hymn_as_array(a));
             push(H, value);
@@ -6843,6 +8978,14 @@ dispatch:
             hymn_dereference(H, array);
             hymn_dereference(H, value);
             THROW("call to 'push' can't use %s for 1st argument (expected array)", is)
+        } else if (hymn_as_array(array)->frozen) {
+            hymn_dereference(H, array);
+            hymn_dereference(H, value);
+            THROW("call to 'push' can't modify frozen array")
+        } else if (!array_reserve(hymn_as_array(array), hymn_as_array(array)->length + 1)) {
+            hymn_dereference(H, array);
+            hymn_dereference(H, value);
+            THROW("%s", allocation_failure(H))
         } else {
             hymn_array_push(hymn_as_array(array), value);
             hymn_dereference(H, array);
@@ -6854,6 +8997,10 @@ dispatch:
         if (!hymn_is_array(array)) {
             const char *is = hymn_value_type(array.is);
             THROW("call to 'push' can't use %s for 1st argument (expected array)", is)
+        } else if (hymn_as_array(array)->frozen) {
+            THROW("call to 'push' can't modify frozen array")
+        } else if (!array_reserve(hymn_as_array(array), hymn_as_array(array)->length + 1)) {
+            THROW("%s", allocation_failure(H))
         } else {
             HymnValue value = frame->stack[READ_BYTE(frame)];
             hymn_array_push(hymn_as_array(array), value);
@@ -6873,6 +9020,11 @@ dispatch:
                 THROW("call to 'insert' can't use %s for 2nd argument (expected integer)", is)
             }
             HymnArray *array = hymn_as_array(v);
+            if (array->frozen) {
+                hymn_dereference(H, p);
+                hymn_dereference(H, v);
+                THROW("call to 'insert' can't modify frozen array")
+            }
             HymnInt size = array->length;
             HymnInt index = hymn_as_int(i);
             if (index > size) {
@@ -6890,6 +9042,11 @@ dispatch:
                     THROW("negative index in 'insert' call: %d", index)
                 }
             }
+            if (!array_reserve(array, size + 1)) {
+                hymn_dereference(H, p);
+                hymn_dereference(H, v);
+                THROW("%s", allocation_failure(H))
+            }
             if (index == size) {
                 hymn_array_push(array, p);
             } else {
@@ -6916,6 +9073,10 @@ dispatch:
                 THROW("call to 'delete' can't use %s for 2nd argument (expected integer)", is)
             }
             HymnArray *array = hymn_as_array(v);
+            if (array->frozen) {
+                hymn_dereference(H, v);
+                THROW("call to 'delete' can't modify frozen array")
+            }
             HymnInt size = array->length;
             HymnInt index = hymn_as_int(i);
             if (index >= size) {
@@ -6942,7 +9103,17 @@ dispatch:
                 THROW("call to 'delete' can't use %s for 2nd argument (expected string)", is)
             }
             HymnTable *table = hymn_as_table(v);
+            if (table->frozen) {
+                hymn_dereference(H, i);
+                hymn_dereference(H, v);
+                THROW("call to 'delete' can't modify frozen table")
+            }
             HymnObjectString *name = hymn_as_hymn_string(i);
+            if (name->frozen) {
+                name = hymn_intern_string(H, hymn_string_copy(name->string));
+                hymn_reference_string(name);
+                hymn_dereference(H, i);
+            }
             HymnValue value = table_remove(table, name);
             if (hymn_is_undefined(value)) {
                 value.is = HYMN_VALUE_NONE;
@@ -6970,9 +9141,14 @@ dispatch:
         case HYMN_VALUE_STRING:
         case HYMN_VALUE_FUNC:
         case HYMN_VALUE_FUNC_NATIVE:
+        case HYMN_VALUE_COROUTINE:
             push(H, value);
             break;
         case HYMN_VALUE_ARRAY: {
+            if (memory_refuse(H, (size_t)hymn_as_array(value)->length * sizeof(HymnValue), 0)) {
+                hymn_dereference(H, value);
+                THROW("%s", allocation_failure(H))
+            }
             HymnArray *copy = new_array_copy(hymn_as_array(value));
             HymnValue new = hymn_new_array_value(copy);
             push(H, new);
@@ -6981,7 +9157,12 @@ dispatch:
             break;
         }
         case HYMN_VALUE_TABLE: {
-            HymnTable *copy = new_table_copy(hymn_as_table(value));
+            HymnTable *table = hymn_as_table(value);
+            if (memory_refuse(H, table->bins * sizeof(HymnTableItem *) + (size_t)table->size * sizeof(HymnTableItem), 0)) {
+                hymn_dereference(H, value);
+                THROW("%s", allocation_failure(H))
+            }
+            HymnTable *copy = new_table_copy(H, table);
             HymnValue new = hymn_new_table_value(copy);
             push(H, new);
             hymn_reference(new);
@@ -6993,6 +9174,19 @@ dispatch:
         }
         goto dispatch;
     }
+    case OP_FREEZE: {
+        HymnValue value = pop(H);
+        const char *error = NULL;
+        HymnValue frozen = freeze(H, value, &error);
+        if (error != NULL) {
+            hymn_dereference(H, value);
+            THROW("%s", error)
+        }
+        hymn_reference(frozen);
+        push(H, frozen);
+        hymn_dereference(H, value);
+        goto dispatch;
+    }
     case OP_SLICE: {
         HymnValue b = pop(H);
         HymnValue a = pop(H);
@@ -7047,6 +9241,12 @@ dispatch:
                 hymn_dereference(H, v);
                 THROW("slice out of range: %d >= %d", start, end)
             }
+            if (memory_refuse(H, sizeof(HymnStringHead) + (size_t)(end - start) + 1, 0)) {
+                hymn_dereference(H, a);
+                hymn_dereference(H, b);
+                hymn_dereference(H, v);
+                THROW("%s", allocation_failure(H))
+            }
             HymnString *sub = hymn_substring(original, (size_t)start, (size_t)end);
             push_string(H, sub);
         } else if (hymn_is_array(v)) {
@@ -7085,6 +9285,12 @@ dispatch:
                 hymn_dereference(H, v);
                 THROW("slice out of range: %d >= %d", start, end)
             }
+            if (memory_refuse(H, (size_t)(end - start) * sizeof(HymnValue), 0)) {
+                hymn_dereference(H, a);
+                hymn_dereference(H, b);
+                hymn_dereference(H, v);
+                THROW("%s", allocation_failure(H))
+            }
             HymnArray *copy = new_array_slice(array, start, end);
             HymnValue new = hymn_new_array_value(copy);
             hymn_reference(new);
@@ -7116,12 +9322,20 @@ dispatch:
             break;
         case HYMN_VALUE_ARRAY: {
             HymnArray *array = hymn_as_array(value);
+            if (array->frozen) {
+                hymn_dereference(H, value);
+                THROW("call to 'clear' can't modify frozen array")
+            }
             hymn_array_clear(H, array);
             push(H, value);
             break;
         }
         case HYMN_VALUE_TABLE: {
             HymnTable *table = hymn_as_table(value);
+            if (table->frozen) {
+                hymn_dereference(H, value);
+                THROW("call to 'clear' can't modify frozen table")
+            }
             table_clear(H, table);
             push(H, value);
             break;
@@ -7133,6 +9347,10 @@ dispatch:
         case HYMN_VALUE_POINTER:
             push(H, hymn_new_none());
             break;
+        case HYMN_VALUE_COROUTINE:
+            hymn_dereference(H, value);
+            push(H, hymn_new_none());
+            break;
         default:
             break;
         }
@@ -7301,7 +9519,12 @@ dispatch:
         HymnString *debug = NULL;
         if (hymn_is_func(value)) {
             HymnFunction *func = hymn_as_func(value);
-            debug = disassemble_byte_code(&func->code);
+            if (func->code.instructions == NULL) {
+                free(compile_deferred(H, func));
+            }
+            if (func->code.instructions != NULL) {
+                debug = disassemble_byte_code(&func->code);
+            }
         }
         if (debug == NULL) debug = hymn_value_to_string(value);
         push_string(H, debug);
@@ -7343,6 +9566,9 @@ dispatch:
         case HYMN_VALUE_FUNC_NATIVE:
             count = ((HymnNativeFunction *)value.as.o)->count;
             break;
+        case HYMN_VALUE_COROUTINE:
+            count = ((HymnCoroutine *)value.as.o)->count;
+            break;
         default:
             break;
         }
@@ -7398,13 +9624,30 @@ dispatch:
         }
         goto dispatch;
     }
+        HYMN_SUPER_RUN
     default:
         UNREACHABLE();
     }
 }
 
-static char *interpret(Hymn *H) {
-    run(H);
+static void run_traced(Hymn *H) {
+    Trace trace;
+    memset(&trace, 0, sizeof(Trace));
+    trace.base = H->frame_count - 1;
+    run_loop(H, true, &trace);
+    trace_unwind(H, &trace, 0);
+    free(trace.frames);
+}
+
+static void run(Hymn *H) {
+    if (H->tracer != NULL) {
+        run_traced(H);
+    } else {
+        run_loop(H, false, NULL);
+    }
+}
+
+static char *pending_error(Hymn *H) {
     char *error = NULL;
     if (H->error) {
         error = string_to_chars(H->error);
@@ -7414,6 +9657,11 @@ static char *interpret(Hymn *H) {
     return error;
 }
 
+static char *interpret(Hymn *H) {
+    run(H);
+    return pending_error(H);
+}
+
 static void print_stdout(const char *format, ...) {
     va_list args;
 
@@ -7430,8 +9678,181 @@ static void print_stderr(const char *format, ...) {
     va_end(args);
 }
 
-Hymn *new_hymn(void) {
-    Hymn *H = hymn_calloc(1, sizeof(Hymn));
+static void coroutine_swap(Hymn *H, HymnCoroutine *coroutine) {
+    HymnValue *stack = H->stack;
+    HymnValue *stack_top = H->stack_top;
+    HymnFrame *frames = H->frames;
+    int stack_capacity = H->stack_capacity;
+    int frame_count = H->frame_count;
+    int frame_capacity = H->frame_capacity;
+    H->stack = coroutine->stack;
+    H->stack_top = coroutine->stack_top;
+    H->frames = coroutine->frames;
+    H->stack_capacity = coroutine->stack_capacity;
+    H->frame_count = coroutine->frame_count;
+    H->frame_capacity = coroutine->frame_capacity;
+    coroutine->stack = stack;
+    coroutine->stack_top = stack_top;
+    coroutine->frames = frames;
+    coroutine->stack_capacity = stack_capacity;
+    coroutine->frame_count = frame_count;
+    coroutine->frame_capacity = frame_capacity;
+}
+
+static HymnValue coroutine_new(Hymn *H, int count, HymnValue *arguments) {
+    if (count < 1) {
+        return hymn_new_exception(H, "missing function");
+    } else if (!hymn_is_func(arguments[0])) {
+        return hymn_type_exception(H, HYMN_VALUE_FUNC, arguments[0].is);
+    }
+    ALLOCATION_KIND("coroutine");
+    HymnCoroutine *coroutine = hymn_calloc(1, sizeof(HymnCoroutine));
+    coroutine->status = COROUTINE_NEW;
+    coroutine->function = arguments[0];
+    coroutine->value = hymn_new_none();
+    hymn_reference(coroutine->function);
+    return (HymnValue){.is = HYMN_VALUE_COROUTINE, .as = {.o = (void *)coroutine}};
+}
+
+static HymnValue coroutine_resume(Hymn *H, int count, HymnValue *arguments) {
+    if (count < 1) {
+        return hymn_new_exception(H, "missing coroutine");
+    } else if (!hymn_is_coroutine(arguments[0])) {
+        return hymn_type_exception(H, HYMN_VALUE_COROUTINE, arguments[0].is);
+    }
+    HymnCoroutine *coroutine = hymn_as_coroutine(arguments[0]);
+    if (coroutine->status == COROUTINE_DEAD) {
+        return hymn_new_exception(H, "can't resume a dead coroutine");
+    } else if (coroutine->status == COROUTINE_RUNNING) {
+        return hymn_new_exception(H, "can't resume a running coroutine");
+    }
+
+    HymnCoroutine *parent = H->coroutine;
+    bool start = coroutine->status == COROUTINE_NEW;
+
+    if (start && count - 1 > UINT8_MAX) {
+        HymnFunction *func = hymn_as_func(coroutine->function);
+        HymnString *message = hymn_string_format("too many arguments in call to '%s' (expected %d)", func->name, func->arity);
+        HymnValue exception = hymn_new_exception(H, message);
+        hymn_string_delete(message);
+        return exception;
+    }
+
+    if (start) {
+        coroutine->stack_capacity = FRAME_STACK;
+        ALLOCATION_KIND("coroutine");
+        coroutine->stack = hymn_calloc_int(coroutine->stack_capacity, sizeof(HymnValue));
+        coroutine->stack_top = coroutine->stack;
+        coroutine->frame_capacity = 8;
+        ALLOCATION_KIND("coroutine");
+        coroutine->frames = hymn_calloc_int(coroutine->frame_capacity, sizeof(HymnFrame));
+    }
+
+    coroutine_swap(H, coroutine);
+    H->coroutine = coroutine;
+    coroutine->status = COROUTINE_RUNNING;
+    int base = H->frame_base;
+    H->frame_base = 0;
+
+    bool ready = true;
+    if (start) {
+        push(H, coroutine->function);
+        hymn_reference(coroutine->function);
+        for (int i = 1; i < count; i++) {
+            push(H, arguments[i]);
+            hymn_reference(arguments[i]);
+        }
+        ready = call(H, hymn_as_func(coroutine->function), count - 1) != NULL;
+    } else if (coroutine->preempted) {
+        coroutine->preempted = false;
+    } else {
+        HymnValue value = count >= 2 ? arguments[1] : hymn_new_none();
+        push(H, value);
+        hymn_reference(value);
+    }
+
+    if (ready) {
+        run(H);
+    }
+
+    HymnValue result = hymn_new_none();
+    if (H->error == NULL) {
+        result = pop(H);
+    }
+
+    if (H->yielded) {
+        H->yielded = false;
+        coroutine->status = COROUTINE_SUSPENDED;
+    } else {
+        while (H->stack_top != H->stack) {
+            hymn_dereference(H, pop(H));
+        }
+        H->frame_count = 0;
+        coroutine->status = COROUTINE_DEAD;
+    }
+
+    coroutine_swap(H, coroutine);
+    H->coroutine = parent;
+    H->frame_base = base;
+
+    hymn_dereference(H, coroutine->value);
+    coroutine->value = result;
+
+    if (H->error != NULL) {
+        HymnString *error = H->error;
+        H->error = NULL;
+        HymnValue exception = hymn_new_exception(H, error);
+        hymn_string_delete(error);
+        return exception;
+    }
+
+    return result;
+}
+
+static HymnValue coroutine_status(Hymn *H, int count, HymnValue *arguments) {
+    if (count < 1) {
+        return hymn_new_exception(H, "missing coroutine");
+    } else if (!hymn_is_coroutine(arguments[0])) {
+        return hymn_type_exception(H, HYMN_VALUE_COROUTINE, arguments[0].is);
+    }
+    switch (hymn_as_coroutine(arguments[0])->status) {
+    case COROUTINE_RUNNING: return hymn_new_string_value(hymn_new_intern_string(H, "running"));
+    case COROUTINE_DEAD: return hymn_new_string_value(hymn_new_intern_string(H, "dead"));
+    default: return hymn_new_string_value(hymn_new_intern_string(H, "suspended"));
+    }
+}
+
+Hymn *new_hymn_with_allocator(HymnAllocator *allocator) {
+    Hymn *H;
+    if (allocator != NULL) {
+        H = allocator->allocate(allocator->user, sizeof(Hymn));
+        if (H == NULL) {
+            fprintf(stderr, "malloc failed.\n");
+            exit(1);
+        }
+        memset(H, 0, sizeof(Hymn));
+        H->allocator = *allocator;
+    } else {
+        H = calloc(1, sizeof(Hymn));
+        if (H == NULL) {
+            fprintf(stderr, "calloc failed.\n");
+            exit(1);
+        }
+    }
+
+    Hymn *previous = active;
+    active = H;
+
+#ifdef HYMN_OPCODE_COUNTS
+    H->opcode_counts = new_opcode_counts();
+#endif
+
+    H->stack_capacity = FRAME_STACK;
+    H->stack = hymn_malloc_int(H->stack_capacity, sizeof(HymnValue));
+    H->frame_capacity = 8;
+    H->frames = hymn_malloc_int(H->frame_capacity, sizeof(HymnFrame));
+    H->frame_limit = HYMN_FRAMES_MAX;
+
     reset_stack(H);
 
     // STRINGS
@@ -7510,13 +9931,249 @@ Hymn *new_hymn(void) {
     hymn_reference(imports_value);
     hymn_reference(imports_value);
 
+    table_init(&H->precompiled);
+
+    // COROUTINE
+
+    HymnTable *coroutine = hymn_new_table();
+    hymn_add_function_to_table(H, coroutine, "new", coroutine_new);
+    hymn_add_function_to_table(H, coroutine, "resume", coroutine_resume);
+    hymn_add_function_to_table(H, coroutine, "status", coroutine_status);
+    hymn_add_table(H, "coroutine", coroutine);
+
     H->print = print_stdout;
     H->print_error = print_stderr;
 
+    active = previous;
+
     return H;
 }
 
+Hymn *new_hymn(void) {
+    return new_hymn_with_allocator(NULL);
+}
+
+static void snapshot_delete(Hymn *H, HymnSnapshot *snapshot) {
+    table_delete(H, snapshot->globals);
+    hymn_array_delete(H, snapshot->objects);
+    hymn_array_delete(H, snapshot->copies);
+    hymn_free(snapshot);
+}
+
+void hymn_set_tracer(Hymn *H, void (*tracer)(Hymn *H, enum HymnTrace event, HymnFunction *func, int line, void *user), int events, void *user) {
+    H->tracer = tracer;
+    H->trace_events = events;
+    H->trace_user = user;
+}
+
+void hymn_set_budget(Hymn *H, int64_t checks, enum HymnBudget (*callback)(Hymn *H, void *user), void *user) {
+    H->budget = checks;
+    H->budget_left = checks;
+    H->budget_callback = callback;
+    H->budget_user = user;
+    if (checks > 0) {
+        H->interrupt = 1;
+    }
+}
+
+void hymn_interrupt(Hymn *H) {
+    H->interrupted = 1;
+    H->interrupt = 1;
+}
+
+void hymn_add_finalizer(Hymn *H, void (*finalize)(Hymn *H, void *user), void *user) {
+    HymnFinalizer *finalizer = system_malloc(sizeof(HymnFinalizer));
+    finalizer->finalize = finalize;
+    finalizer->user = user;
+    finalizer->next = H->finalizers;
+    H->finalizers = finalizer;
+}
+
+void *hymn_finalizer_user(Hymn *H, void (*finalize)(Hymn *H, void *user)) {
+    for (HymnFinalizer *finalizer = H->finalizers; finalizer != NULL; finalizer = finalizer->next) {
+        if (finalizer->finalize == finalize) {
+            return finalizer->user;
+        }
+    }
+    return NULL;
+}
+
+static void snapshot_walk(Hymn *H, HymnSnapshot *snapshot, HymnValue value, struct PointerSet *visited) {
+    HymnValue copy;
+    if (hymn_is_table(value)) {
+        HymnTable *table = hymn_as_table(value);
+        if (table->frozen || table == &H->globals || pointer_set_has(visited, table)) {
+            return;
+        }
+        pointer_set_add(visited, table);
+        copy = hymn_new_table_value(new_table_copy(H, table));
+    } else if (hymn_is_array(value)) {
+        HymnArray *array = hymn_as_array(value);
+        if (array->frozen || pointer_set_has(visited, array)) {
+            return;
+        }
+        pointer_set_add(visited, array);
+        copy = hymn_new_array_value(new_array_copy(array));
+    } else {
+        return;
+    }
+    hymn_reference(value);
+    hymn_array_push(snapshot->objects, value);
+    hymn_reference(copy);
+    hymn_array_push(snapshot->copies, copy);
+    if (hymn_is_table(value)) {
+        HymnTable *table = hymn_as_table(value);
+        for (unsigned int i = 0; i < table->bins; i++) {
+            for (HymnTableItem *item = table->items[i]; item != NULL; item = item->next) {
+                snapshot_walk(H, snapshot, item->value, visited);
+            }
+        }
+    } else {
+        HymnArray *array = hymn_as_array(value);
+        for (HymnInt i = 0; i < array->length; i++) {
+            snapshot_walk(H, snapshot, array->items[i], visited);
+        }
+    }
+}
+
+void hymn_capture(Hymn *H) {
+    Hymn *previous = active;
+    active = H;
+
+    if (H->snapshot != NULL) {
+        snapshot_delete(H, H->snapshot);
+    }
+
+    HymnSnapshot *snapshot = hymn_calloc(1, sizeof(HymnSnapshot));
+    snapshot->globals = new_table_copy(H, &H->globals);
+    snapshot->objects = hymn_new_array(0);
+    snapshot->copies = hymn_new_array(0);
+    snapshot->budget_left = H->budget_left;
+
+    struct PointerSet visited = {.count = 0, .capacity = 0, .items = NULL};
+    unsigned int bins = H->globals.bins;
+    for (unsigned int i = 0; i < bins; i++) {
+        for (HymnTableItem *item = H->globals.items[i]; item != NULL; item = item->next) {
+            snapshot_walk(H, snapshot, item->value, &visited);
+        }
+    }
+    hymn_free(visited.items);
+
+    H->snapshot = snapshot;
+
+    active = previous;
+}
+
+static void table_restore(Hymn *H, HymnTable *table, HymnTable *from) {
+    unsigned int bins = table->bins;
+    for (unsigned int i = 0; i < bins; i++) {
+        HymnTableItem *item = table->items[i];
+        HymnTableItem *before = NULL;
+        while (item != NULL) {
+            HymnTableItem *next = item->next;
+            if (hymn_is_undefined(table_get(from, item->key))) {
+                if (before == NULL) {
+                    table->items[i] = next;
+                } else {
+                    before->next = next;
+                }
+                table->size--;
+                hymn_dereference(H, item->value);
+                hymn_dereference_string(H, item->key);
+                hymn_free(item);
+            } else {
+                before = item;
+            }
+            item = next;
+        }
+    }
+    bins = from->bins;
+    for (unsigned int i = 0; i < bins; i++) {
+        HymnTableItem *item = from->items[i];
+        while (item != NULL) {
+            HymnValue current = table_get(table, item->key);
+            if (!hymn_match_values(current, item->value)) {
+                hymn_set_property(H, table, item->key, item->value);
+            }
+            item = item->next;
+        }
+    }
+}
+
+static void array_restore(Hymn *H, HymnArray *array, HymnArray *from) {
+    bool same = array->length == from->length;
+    for (HymnInt i = 0; same && i < from->length; i++) {
+        same = hymn_match_values(array->items[i], from->items[i]);
+    }
+    if (!same) {
+        hymn_array_clear(H, array);
+        for (HymnInt i = 0; i < from->length; i++) {
+            hymn_reference(from->items[i]);
+            hymn_array_push(array, from->items[i]);
+        }
+    }
+}
+
+void hymn_reset(Hymn *H) {
+    HymnSnapshot *snapshot = H->snapshot;
+    if (snapshot == NULL) {
+        return;
+    }
+
+    Hymn *previous = active;
+    active = H;
+
+    while (H->stack_top != H->stack) {
+        hymn_dereference(H, pop(H));
+    }
+    reset_stack(H);
+
+    hymn_string_delete(H->error);
+    H->error = NULL;
+    hymn_string_delete(H->exception);
+    H->exception = NULL;
+    H->coroutine = NULL;
+    H->yielded = false;
+    H->memory_exceeded = false;
+    H->budget_left = snapshot->budget_left;
+    H->interrupted = 0;
+    H->interrupt = H->budget > 0 || H->sample ? 1 : 0;
+
+    table_restore(H, &H->globals, snapshot->globals);
+
+    HymnArray *objects = snapshot->objects;
+    HymnArray *copies = snapshot->copies;
+    for (HymnInt i = 0; i < objects->length; i++) {
+        HymnValue object = objects->items[i];
+        HymnValue copy = copies->items[i];
+        if (hymn_is_table(object)) {
+            table_restore(H, hymn_as_table(object), hymn_as_table(copy));
+        } else {
+            array_restore(H, hymn_as_array(object), hymn_as_array(copy));
+        }
+    }
+
+    active = previous;
+}
+
 void hymn_delete(Hymn *H) {
+    Hymn *previous = active;
+    active = H;
+
+    while (H->finalizers != NULL) {
+        HymnFinalizer *finalizer = H->finalizers;
+        H->finalizers = finalizer->next;
+        finalizer->finalize(H, finalizer->user);
+        free(finalizer);
+    }
+
+    hymn_census_track(H, false);
+    hymn_compile_stats_track(H, false);
+
+    if (H->snapshot != NULL) {
+        snapshot_delete(H, H->snapshot);
+    }
+
     {
         HymnTable *globals_table = &H->globals;
         HymnObjectString *globals = hymn_new_intern_string(H, "GLOBALS");
@@ -7530,6 +10187,12 @@ void hymn_delete(Hymn *H) {
     hymn_array_delete(H, H->paths);
     table_delete(H, H->imports);
 
+    if (H->import_cache != NULL) {
+        import_cache_delete(H, H->import_cache);
+    }
+
+    table_release(H, &H->precompiled);
+
     HymnSet *strings = &H->strings;
     {
         unsigned int bins = strings->bins;
@@ -7542,85 +10205,681 @@ void hymn_delete(Hymn *H) {
             }
         }
     }
-    assert(strings->size == 0);
-    free(strings->items);
+    assert(strings->size == 0);
+    hymn_free(strings->items);
+
+    hymn_string_delete(H->error);
+
+    hymn_free(H->stack);
+    hymn_free(H->frames);
+
+#ifndef HYMN_NO_DYNAMIC_LIBS
+    HymnLibList *lib = H->libraries;
+    while (lib != NULL) {
+        hymn_close_dlib(lib->lib);
+        HymnLibList *next = lib->next;
+        hymn_free(lib);
+        lib = next;
+    }
+#endif
+
+    active = previous == H ? NULL : previous;
+
+#ifdef HYMN_OPCODE_COUNTS
+    opcode_counts_merge(H->opcode_counts);
+    free(H->opcode_counts);
+#endif
+
+    if (H->allocator.release != NULL) {
+        H->allocator.release(H->allocator.user, H);
+    } else {
+        free(H);
+    }
+}
+
+HymnValue hymn_get(Hymn *H, const char *name) {
+    return hymn_table_get(&H->globals, name);
+}
+
+Hymn *hymn_activate(Hymn *H) {
+    Hymn *previous = active;
+    active = H;
+    return previous;
+}
+
+void hymn_add(Hymn *H, const char *name, HymnValue value) {
+    Hymn *previous_active = hymn_activate(H);
+    HymnObjectString *string = hymn_new_intern_string(H, name);
+    HymnValue previous = table_put(&H->globals, string, value);
+    if (hymn_is_undefined(previous)) {
+        hymn_reference_string(string);
+    } else {
+        hymn_dereference(H, previous);
+    }
+    hymn_reference(value);
+    active = previous_active;
+}
+
+void hymn_add_string(Hymn *H, const char *name, const char *string) {
+    Hymn *previous = hymn_activate(H);
+    HymnObjectString *object = hymn_new_intern_string(H, string);
+    hymn_add(H, name, hymn_new_string_value(object));
+    active = previous;
+}
+
+void hymn_add_table(Hymn *H, const char *name, HymnTable *table) {
+    hymn_add(H, name, hymn_new_table_value(table));
+}
+
+void hymn_add_pointer(Hymn *H, const char *name, void *pointer) {
+    hymn_add(H, name, hymn_new_pointer(pointer));
+}
+
+void hymn_add_string_to_table(Hymn *H, HymnTable *table, const char *name, const char *string) {
+    Hymn *previous = hymn_activate(H);
+    HymnObjectString *object = hymn_new_intern_string(H, string);
+    hymn_set_property_const(H, table, name, hymn_new_string_value(object));
+    active = previous;
+}
+
+void hymn_add_function_to_table(Hymn *H, HymnTable *table, const char *name, HymnNativeCall func) {
+    Hymn *previous = hymn_activate(H);
+    HymnObjectString *string = hymn_new_intern_string(H, name);
+    HymnNativeFunction *native = new_native_function(string, func);
+    HymnValue value = hymn_new_native(native);
+    hymn_set_property(H, table, string, value);
+    active = previous;
+}
+
+void hymn_add_function(Hymn *H, const char *name, HymnNativeCall func) {
+    hymn_add_function_to_table(H, &H->globals, name, func);
+}
+
+void hymn_add_function_typed_to_table(Hymn *H, HymnTable *table, const char *name, HymnNativeCall func, const char *signature) {
+    Hymn *previous = hymn_activate(H);
+    HymnObjectString *string = hymn_new_intern_string(H, name);
+    HymnNativeFunction *native = new_native_function(string, func);
+    native_signature(native, signature);
+    HymnValue value = hymn_new_native(native);
+    hymn_set_property(H, table, string, value);
+    active = previous;
+}
+
+void hymn_add_function_typed(Hymn *H, const char *name, HymnNativeCall func, const char *signature) {
+    hymn_add_function_typed_to_table(H, &H->globals, name, func, signature);
+}
+
+char *hymn_call(Hymn *H, const char *name, int arguments) {
+    HymnValue function = hymn_table_get(&H->globals, name);
+    if (hymn_is_undefined(function)) {
+        return NULL;
+    }
+
+    Hymn *previous = active;
+    active = H;
+
+    hymn_reference(function);
+
+    push(H, function);
+    call_value(H, function, arguments);
+
+    char *error = interpret(H);
+    active = previous;
+    if (error != NULL) return error;
+
+    hymn_dereference(H, pop(H));
+
+    assert(H->stack_top == H->stack);
+    reset_stack(H);
+
+    return NULL;
+}
+
+char *hymn_call_value(Hymn *H, HymnValue function, int count, HymnValue *arguments, HymnValue *result) {
+    *result = hymn_new_none();
+
+    if (count > UINT8_MAX) {
+        HymnString *format = hymn_new_string("too many arguments");
+        char *error = string_to_chars(format);
+        hymn_string_delete(format);
+        return error;
+    }
+
+    Hymn *previous = active;
+    active = H;
+
+    // when called from a running native, continue on the same stack above
+    // the caller and stop unwinding at the frames it already has
+    HymnCoroutine *coroutine = H->coroutine;
+    H->coroutine = NULL;
+    int base = H->frame_base;
+    H->frame_base = H->frame_count;
+    ptrdiff_t top = H->stack_top - H->stack;
+
+    char *error = NULL;
+
+    if (hymn_is_native(function)) {
+        HymnNativeFunction *native = hymn_as_native(function);
+        HymnValue value = hymn_new_none();
+        if (native->arity < 0 || native_arguments(H, native, count, arguments)) {
+            value = native->func(H, count, arguments);
+        }
+        if (H->exception != NULL) {
+            error = string_to_chars(H->exception);
+            hymn_string_delete(H->exception);
+            H->exception = NULL;
+        } else {
+            hymn_reference(value);
+            *result = value;
+        }
+    } else if (hymn_is_func(function)) {
+        ptrdiff_t offset = -1;
+        if (arguments >= H->stack && arguments < H->stack_top) {
+            offset = arguments - H->stack;
+        }
+        stack_reserve(H, H->stack_top, count + 1);
+        if (offset >= 0) {
+            arguments = H->stack + offset;
+        }
+        hymn_reference(function);
+        push(H, function);
+        for (int i = 0; i < count; i++) {
+            hymn_reference(arguments[i]);
+            push(H, arguments[i]);
+        }
+        if (call(H, hymn_as_func(function), count) != NULL) {
+            run(H);
+        }
+        error = pending_error(H);
+        if (error == NULL) {
+            *result = pop(H);
+        }
+        while (H->stack_top != H->stack + top) {
+            hymn_dereference(H, pop(H));
+        }
+        H->frame_count = H->frame_base;
+    } else {
+        HymnString *format = hymn_string_format("can't call %s (expected function)", hymn_value_type(function.is));
+        error = string_to_chars(format);
+        hymn_string_delete(format);
+    }
+
+    H->frame_base = base;
+    H->coroutine = coroutine;
+
+    active = previous;
+
+    return error;
+}
+
+HymnHandle *hymn_handle(Hymn *H, const char *name) {
+    return hymn_handle_value(H, hymn_table_get(&H->globals, name));
+}
+
+HymnHandle *hymn_handle_value(Hymn *H, HymnValue function) {
+    if (!hymn_is_func(function) && !hymn_is_native(function)) {
+        return NULL;
+    }
+    HymnHandle *handle = hymn_calloc(1, sizeof(HymnHandle));
+    handle->H = H;
+    handle->function = function;
+    handle->result = hymn_new_none();
+    hymn_reference(function);
+    return handle;
+}
+
+bool hymn_handle_push(HymnHandle *handle, HymnValue value) {
+    if (handle->count == HYMN_HANDLE_ARGUMENTS) {
+        handle->overflow = true;
+        return false;
+    }
+    hymn_reference(value);
+    handle->arguments[handle->count++] = value;
+    return true;
+}
+
+bool hymn_handle_push_int(HymnHandle *handle, HymnInt value) {
+    return hymn_handle_push(handle, hymn_new_int(value));
+}
+
+bool hymn_handle_push_float(HymnHandle *handle, HymnFloat value) {
+    return hymn_handle_push(handle, hymn_new_float(value));
+}
+
+bool hymn_handle_push_bool(HymnHandle *handle, bool value) {
+    return hymn_handle_push(handle, hymn_new_bool(value));
+}
+
+bool hymn_handle_push_string(HymnHandle *handle, const char *value) {
+    if (handle->count == HYMN_HANDLE_ARGUMENTS) {
+        handle->overflow = true;
+        return false;
+    }
+    return hymn_handle_push(handle, hymn_new_string_value(hymn_new_intern_string(handle->H, value)));
+}
+
+static void handle_clear(HymnHandle *handle) {
+    Hymn *H = handle->H;
+    for (int i = 0; i < handle->count; i++) {
+        hymn_dereference(H, handle->arguments[i]);
+    }
+    handle->count = 0;
+    handle->overflow = false;
+}
+
+char *hymn_handle_call(HymnHandle *handle) {
+    Hymn *H = handle->H;
+    if (handle->overflow) {
+        handle_clear(handle);
+        HymnString *format = hymn_string_format("handle call has more than %d arguments", HYMN_HANDLE_ARGUMENTS);
+        char *error = string_to_chars(format);
+        hymn_string_delete(format);
+        return error;
+    }
+    HymnValue result;
+    char *error = hymn_call_value(H, handle->function, handle->count, handle->arguments, &result);
+    handle_clear(handle);
+    hymn_dereference(H, handle->result);
+    handle->result = result;
+    return error;
+}
+
+char *hymn_handle_call_batch(HymnHandle *handle, int count, int arity, HymnValue *arguments, HymnValue *results) {
+    Hymn *H = handle->H;
+    if (handle->count > 0 || handle->overflow) {
+        handle_clear(handle);
+        HymnString *format = hymn_new_string("handle batch call with pushed arguments");
+        char *error = string_to_chars(format);
+        hymn_string_delete(format);
+        return error;
+    }
+    for (int i = 0; i < count; i++) {
+        HymnValue result;
+        char *error = hymn_call_value(H, handle->function, arity, &arguments[i * arity], &result);
+        if (error != NULL) {
+            hymn_dereference(H, result);
+            if (results != NULL) {
+                for (int r = 0; r < i; r++) {
+                    hymn_dereference(H, results[r]);
+                    results[r] = hymn_new_none();
+                }
+            }
+            return error;
+        }
+        if (results != NULL) {
+            results[i] = result;
+        } else {
+            hymn_dereference(H, result);
+        }
+    }
+    return NULL;
+}
 
-    hymn_string_delete(H->error);
+HymnValue hymn_handle_result(HymnHandle *handle) {
+    return handle->result;
+}
 
-#ifndef HYMN_NO_DYNAMIC_LIBS
-    HymnLibList *lib = H->libraries;
-    while (lib != NULL) {
-        hymn_close_dlib(lib->lib);
-        HymnLibList *next = lib->next;
-        free(lib);
-        lib = next;
-    }
-#endif
+void hymn_handle_delete(HymnHandle *handle) {
+    Hymn *H = handle->H;
+    handle_clear(handle);
+    hymn_dereference(H, handle->result);
+    hymn_dereference(H, handle->function);
+    hymn_free(handle);
+}
+
+enum SerialType {
+    SERIAL_NONE,
+    SERIAL_TRUE,
+    SERIAL_FALSE,
+    SERIAL_INTEGER,
+    SERIAL_FLOAT,
+    SERIAL_STRING,
+    SERIAL_ARRAY,
+    SERIAL_TABLE,
+    SERIAL_FUNC,
+    SERIAL_FUNC_NATIVE,
+    SERIAL_POINTER,
+    SERIAL_FROZEN,
+};
 
-    free(H);
+static HymnString *serialize_bytes(HymnString *out, const void *data, size_t size) {
+    if (size == 0) return out;
+    return hymn_string_append_substring(out, (const char *)data, 0, size);
 }
 
-HymnValue hymn_get(Hymn *H, const char *name) {
-    return hymn_table_get(&H->globals, name);
+static HymnString *serialize_int(HymnString *out, int64_t number) {
+    return serialize_bytes(out, &number, sizeof(number));
 }
 
-void hymn_add(Hymn *H, const char *name, HymnValue value) {
-    HymnObjectString *string = hymn_new_intern_string(H, name);
-    HymnValue previous = table_put(&H->globals, string, value);
-    if (hymn_is_undefined(previous)) {
-        hymn_reference_string(string);
-    } else {
-        hymn_dereference(H, previous);
+static HymnString *serialize_string(HymnString *out, HymnString *string) {
+    if (string == NULL) {
+        return serialize_int(out, -1);
     }
-    hymn_reference(value);
+    size_t len = hymn_string_len(string);
+    out = serialize_int(out, (int64_t)len);
+    return serialize_bytes(out, string, len);
+}
+
+static HymnString *serialize_value(HymnString *out, HymnValue value, struct PointerSet *parents, bool *ok);
+
+static HymnString *serialize_function(HymnString *out, HymnFunction *func, struct PointerSet *parents, bool *ok) {
+    HymnByteCode *code = &func->code;
+    out = serialize_int(out, func->arity);
+    out = serialize_string(out, func->name);
+    out = serialize_string(out, func->script);
+    out = serialize_string(out, func->source);
+    out = serialize_int(out, func->row);
+    out = serialize_int(out, func->column);
+    out = serialize_int(out, code->count);
+    out = serialize_bytes(out, code->instructions, (size_t)code->count * sizeof(uint8_t));
+    out = serialize_int(out, (int64_t)code->line_size);
+    out = serialize_bytes(out, code->lines, code->line_size);
+    HymnValuePool *constants = &code->constants;
+    out = serialize_int(out, constants->count);
+    for (int i = 0; i < constants->count; i++) {
+        out = serialize_value(out, constants->values[i], parents, ok);
+    }
+    int64_t excepts = 0;
+    for (HymnExceptList *except = func->except; except != NULL; except = except->next) {
+        excepts++;
+    }
+    out = serialize_int(out, excepts);
+    for (HymnExceptList *except = func->except; except != NULL; except = except->next) {
+        out = serialize_int(out, except->start);
+        out = serialize_int(out, except->end);
+        out = serialize_int(out, except->locals);
+    }
+    return out;
 }
 
-void hymn_add_string(Hymn *H, const char *name, const char *string) {
-    HymnObjectString *object = hymn_new_intern_string(H, string);
-    hymn_add(H, name, hymn_new_string_value(object));
+static bool is_frozen(HymnValue value) {
+    switch (value.is) {
+    case HYMN_VALUE_STRING: return hymn_as_hymn_string(value)->frozen;
+    case HYMN_VALUE_ARRAY: return hymn_as_array(value)->frozen;
+    case HYMN_VALUE_TABLE: return hymn_as_table(value)->frozen;
+    default: return false;
+    }
 }
 
-void hymn_add_table(Hymn *H, const char *name, HymnTable *table) {
-    hymn_add(H, name, hymn_new_table_value(table));
+static HymnString *serialize_value(HymnString *out, HymnValue value, struct PointerSet *parents, bool *ok) {
+    if (is_frozen(value)) {
+        hymn_reference(value);
+        out = serialize_int(out, SERIAL_FROZEN);
+        return serialize_bytes(out, &value, sizeof(value));
+    }
+    switch (value.is) {
+    case HYMN_VALUE_BOOL: return serialize_int(out, hymn_as_bool(value) ? SERIAL_TRUE : SERIAL_FALSE);
+    case HYMN_VALUE_INTEGER: {
+        out = serialize_int(out, SERIAL_INTEGER);
+        return serialize_int(out, hymn_as_int(value));
+    }
+    case HYMN_VALUE_FLOAT: {
+        HymnFloat number = hymn_as_float(value);
+        out = serialize_int(out, SERIAL_FLOAT);
+        return serialize_bytes(out, &number, sizeof(number));
+    }
+    case HYMN_VALUE_STRING: {
+        out = serialize_int(out, SERIAL_STRING);
+        return serialize_string(out, hymn_as_string(value));
+    }
+    case HYMN_VALUE_ARRAY: {
+        HymnArray *array = hymn_as_array(value);
+        if (pointer_set_has(parents, array)) {
+            *ok = false;
+            return out;
+        }
+        pointer_set_add(parents, array);
+        out = serialize_int(out, SERIAL_ARRAY);
+        out = serialize_int(out, array->length);
+        for (HymnInt i = 0; i < array->length; i++) {
+            out = serialize_value(out, array->items[i], parents, ok);
+        }
+        parents->count--;
+        return out;
+    }
+    case HYMN_VALUE_TABLE: {
+        HymnTable *table = hymn_as_table(value);
+        if (pointer_set_has(parents, table)) {
+            *ok = false;
+            return out;
+        }
+        pointer_set_add(parents, table);
+        out = serialize_int(out, SERIAL_TABLE);
+        out = serialize_int(out, table->size);
+        HymnTableItem *item = NULL;
+        while ((item = table_next(table, item == NULL ? NULL : item->key)) != NULL) {
+            out = serialize_string(out, item->key->string);
+            out = serialize_value(out, item->value, parents, ok);
+        }
+        parents->count--;
+        return out;
+    }
+    case HYMN_VALUE_FUNC: {
+        out = serialize_int(out, SERIAL_FUNC);
+        return serialize_function(out, hymn_as_func(value), parents, ok);
+    }
+    case HYMN_VALUE_FUNC_NATIVE: {
+        HymnNativeFunction *native = hymn_as_native(value);
+        out = serialize_int(out, SERIAL_FUNC_NATIVE);
+        out = serialize_string(out, native->name->string);
+        out = serialize_bytes(out, &native->func, sizeof(native->func));
+        out = serialize_int(out, native->arity);
+        out = serialize_bytes(out, native->types, sizeof(native->types));
+        return serialize_int(out, native->scalar);
+    }
+    case HYMN_VALUE_POINTER: {
+        void *pointer = hymn_as_pointer(value);
+        out = serialize_int(out, SERIAL_POINTER);
+        return serialize_bytes(out, &pointer, sizeof(pointer));
+    }
+    default:
+        return serialize_int(out, SERIAL_NONE);
+    }
 }
 
-void hymn_add_pointer(Hymn *H, const char *name, void *pointer) {
-    hymn_add(H, name, hymn_new_pointer(pointer));
+HymnString *hymn_serialize(HymnValue value) {
+    Hymn *previous = active;
+    active = NULL;
+    struct PointerSet parents = {.count = 0, .capacity = 0, .items = NULL};
+    bool ok = true;
+    HymnString *out = serialize_value(hymn_new_string_with_capacity(64), value, &parents, &ok);
+    hymn_free(parents.items);
+    if (!ok) {
+        hymn_string_delete(out);
+        out = NULL;
+    }
+    active = previous;
+    return out;
 }
 
-void hymn_add_string_to_table(Hymn *H, HymnTable *table, const char *name, const char *string) {
-    HymnObjectString *object = hymn_new_intern_string(H, string);
-    hymn_set_property_const(H, table, name, hymn_new_string_value(object));
-}
+typedef struct Serial Serial;
 
-void hymn_add_function_to_table(Hymn *H, HymnTable *table, const char *name, HymnNativeCall func) {
-    HymnObjectString *string = hymn_new_intern_string(H, name);
-    HymnNativeFunction *native = new_native_function(string, func);
-    HymnValue value = hymn_new_native(native);
-    hymn_set_property(H, table, string, value);
+struct Serial {
+    Hymn *H;
+    HymnString *data;
+    size_t position;
+};
+
+static void deserialize_bytes(Serial *S, void *data, size_t size) {
+    if (size == 0) return;
+    memcpy(data, &S->data[S->position], size);
+    S->position += size;
 }
 
-void hymn_add_function(Hymn *H, const char *name, HymnNativeCall func) {
-    hymn_add_function_to_table(H, &H->globals, name, func);
+static int64_t deserialize_int(Serial *S) {
+    int64_t number;
+    deserialize_bytes(S, &number, sizeof(number));
+    return number;
 }
 
-char *hymn_call(Hymn *H, const char *name, int arguments) {
-    HymnValue function = hymn_table_get(&H->globals, name);
-    if (hymn_is_undefined(function)) {
+static HymnString *deserialize_string(Serial *S) {
+    int64_t len = deserialize_int(S);
+    if (len < 0) {
         return NULL;
     }
-    hymn_reference(function);
+    HymnString *string = hymn_new_string_with_length(&S->data[S->position], (size_t)len);
+    S->position += (size_t)len;
+    return string;
+}
 
-    push(H, function);
-    call_value(H, function, arguments);
+static HymnValue deserialize_value(Serial *S);
+
+static HymnFunction *deserialize_function(Serial *S, HymnFunction *parent) {
+    ALLOCATION_KIND("function");
+    HymnFunction *func = hymn_calloc(1, sizeof(HymnFunction));
+    func->arity = (int)deserialize_int(S);
+    func->name = deserialize_string(S);
+    func->script = deserialize_string(S);
+    func->source = deserialize_string(S);
+    func->row = (int)deserialize_int(S);
+    func->column = (int)deserialize_int(S);
+    func->parent = parent;
+    HymnByteCode *code = &func->code;
+    code->count = (int)deserialize_int(S);
+    code->capacity = code->count;
+    bool deferred = code->count == 0;
+    code->instructions = deferred ? NULL : hymn_malloc_int(code->count, sizeof(uint8_t));
+    deserialize_bytes(S, code->instructions, (size_t)code->count * sizeof(uint8_t));
+    code->rows = NULL;
+    code->line_size = (size_t)deserialize_int(S);
+    code->lines = deferred ? NULL : hymn_malloc(code->line_size > 0 ? code->line_size : 1);
+    deserialize_bytes(S, code->lines, code->line_size);
+    HymnValuePool *constants = &code->constants;
+    constants->count = (int)deserialize_int(S);
+    constants->capacity = deferred ? 0 : (constants->count > 0 ? constants->count : 1);
+    constants->values = deferred ? NULL : hymn_malloc_int(constants->capacity, sizeof(HymnValue));
+    for (int i = 0; i < constants->count; i++) {
+        int64_t type = deserialize_int(S);
+        if (type == SERIAL_FUNC) {
+            constants->values[i] = hymn_new_func_value(deserialize_function(S, func));
+        } else if (type == SERIAL_STRING) {
+            constants->values[i] = compile_intern_string(S->H, deserialize_string(S));
+        } else {
+            S->position -= sizeof(int64_t);
+            constants->values[i] = deserialize_value(S);
+        }
+    }
+    int64_t excepts = deserialize_int(S);
+    HymnExceptList *tail = NULL;
+    for (int64_t e = 0; e < excepts; e++) {
+        HymnExceptList *except = hymn_calloc(1, sizeof(HymnExceptList));
+        except->start = (int)deserialize_int(S);
+        except->end = (int)deserialize_int(S);
+        except->locals = (int)deserialize_int(S);
+        if (tail == NULL) {
+            func->except = except;
+        } else {
+            tail->next = except;
+        }
+        tail = except;
+    }
+    return func;
+}
 
-    char *error = interpret(H);
-    if (error != NULL) return error;
+static HymnValue deserialize_value(Serial *S) {
+    Hymn *H = S->H;
+    switch (deserialize_int(S)) {
+    case SERIAL_TRUE: return hymn_new_bool(true);
+    case SERIAL_FALSE: return hymn_new_bool(false);
+    case SERIAL_INTEGER: return hymn_new_int(deserialize_int(S));
+    case SERIAL_FLOAT: {
+        HymnFloat number;
+        deserialize_bytes(S, &number, sizeof(number));
+        return hymn_new_float(number);
+    }
+    case SERIAL_STRING: return hymn_new_string_value(hymn_intern_string(H, deserialize_string(S)));
+    case SERIAL_ARRAY: {
+        HymnInt length = deserialize_int(S);
+        HymnArray *array = hymn_new_array(length);
+        for (HymnInt i = 0; i < length; i++) {
+            HymnValue item = deserialize_value(S);
+            hymn_reference(item);
+            array->items[i] = item;
+        }
+        return hymn_new_array_value(array);
+    }
+    case SERIAL_TABLE: {
+        int64_t size = deserialize_int(S);
+        HymnTable *table = hymn_new_table();
+        for (int64_t i = 0; i < size; i++) {
+            HymnObjectString *key = hymn_intern_string(H, deserialize_string(S));
+            hymn_set_property(H, table, key, deserialize_value(S));
+        }
+        return hymn_new_table_value(table);
+    }
+    case SERIAL_FUNC: return hymn_new_func_value(deserialize_function(S, NULL));
+    case SERIAL_FUNC_NATIVE: {
+        HymnObjectString *name = hymn_intern_string(H, deserialize_string(S));
+        HymnNativeCall func;
+        deserialize_bytes(S, &func, sizeof(func));
+        HymnNativeFunction *native = new_native_function(name, func);
+        native->arity = (int)deserialize_int(S);
+        deserialize_bytes(S, native->types, sizeof(native->types));
+        native->scalar = deserialize_int(S) != 0;
+        return hymn_new_native(native);
+    }
+    case SERIAL_POINTER: {
+        void *pointer;
+        deserialize_bytes(S, &pointer, sizeof(pointer));
+        return hymn_new_pointer(pointer);
+    }
+    case SERIAL_FROZEN: {
+        HymnValue value;
+        deserialize_bytes(S, &value, sizeof(value));
+        switch (value.is) {
+        case HYMN_VALUE_STRING: ATOMIC_DECREMENT(hymn_as_hymn_string(value)->count); break;
+        case HYMN_VALUE_ARRAY: ATOMIC_DECREMENT(hymn_as_array(value)->count); break;
+        case HYMN_VALUE_TABLE: ATOMIC_DECREMENT(hymn_as_table(value)->count); break;
+        default: break;
+        }
+        return value;
+    }
+    default:
+        return hymn_new_none();
+    }
+}
 
-    assert(H->stack_top == H->stack);
-    reset_stack(H);
+HymnValue hymn_deserialize(Hymn *H, HymnString *data) {
+    Hymn *previous = active;
+    active = H;
+    Serial S = {.H = H, .data = data, .position = 0};
+    HymnValue value = deserialize_value(&S);
+    active = previous;
+    return value;
+}
 
-    return NULL;
+static void function_globals(Hymn *H, HymnFunction *func, HymnTable *globals) {
+    if (func->code.instructions == NULL) {
+        free(compile_deferred(H, func));
+    }
+    HymnValuePool *constants = &func->code.constants;
+    for (int i = 0; i < constants->count; i++) {
+        HymnValue constant = constants->values[i];
+        if (hymn_is_func(constant)) {
+            function_globals(H, hymn_as_func(constant), globals);
+        } else if (hymn_is_string(constant)) {
+            HymnObjectString *name = hymn_as_hymn_string(constant);
+            HymnValue value = table_get(&H->globals, name);
+            if (hymn_is_undefined(value) || !hymn_is_undefined(table_get(globals, name))) {
+                continue;
+            }
+            table_put(globals, name, value);
+            hymn_reference_string(name);
+            hymn_reference(value);
+            if (hymn_is_func(value)) {
+                function_globals(H, hymn_as_func(value), globals);
+            }
+        }
+    }
+}
+
+HymnTable *hymn_function_globals(Hymn *H, HymnFunction *func) {
+    Hymn *previous = active;
+    active = H;
+    HymnTable *globals = hymn_new_table();
+    function_globals(H, func, globals);
+    active = previous;
+    return globals;
 }
 
 char *hymn_debug(Hymn *H, const char *script, const char *source) {
@@ -7637,10 +10896,14 @@ char *hymn_debug(Hymn *H, const char *script, const char *source) {
         code = hymn_new_string(source);
     }
 
+    Hymn *previous = active;
+    active = H;
+
     CompileResult result = compile(H, script, code, TYPE_SCRIPT);
 
     char *error = result.error;
     if (error != NULL) {
+        active = previous;
         hymn_string_delete(code);
         return error;
     }
@@ -7666,6 +10929,9 @@ char *hymn_debug(Hymn *H, const char *script, const char *source) {
     }
 
     function_delete(main);
+
+    active = previous;
+
     hymn_string_delete(code);
 
     assert(H->stack_top == H->stack);
@@ -7674,11 +10940,32 @@ char *hymn_debug(Hymn *H, const char *script, const char *source) {
     return NULL;
 }
 
+char *hymn_compile(Hymn *H, const char *script, const char *source) {
+    Hymn *previous = active;
+    active = H;
+
+    CompileResult result = compile(H, script, source, TYPE_SCRIPT);
+
+    if (result.func != NULL) {
+        function_delete(result.func);
+    }
+
+    active = previous;
+
+    return result.error;
+}
+
 static char *exec(Hymn *H, const char *script, const char *source, enum FunctionType type) {
+    Hymn *previous = active;
+    active = H;
+
     CompileResult result = compile(H, script, source, type);
 
     char *error = result.error;
-    if (error != NULL) return error;
+    if (error != NULL) {
+        active = previous;
+        return error;
+    }
 
     HymnFunction *func = result.func;
     HymnValue function = hymn_new_func_value(func);
@@ -7688,8 +10975,11 @@ static char *exec(Hymn *H, const char *script, const char *source, enum Function
     call(H, func, 0);
 
     error = interpret(H);
+    active = previous;
     if (error != NULL) return error;
 
+    hymn_dereference(H, pop(H));
+
     assert(H->stack_top == H->stack);
     reset_stack(H);
 
@@ -7718,9 +11008,283 @@ char *hymn_script(Hymn *H, const char *script) {
     }
     char *error = exec(H, script, source, TYPE_SCRIPT);
     hymn_string_delete(source);
+    table_clear(H, &H->precompiled);
     return error;
 }
 
+#ifndef _MSC_VER
+#include <pthread.h>
+#endif
+
+typedef struct Precompile Precompile;
+typedef struct PrecompileJob PrecompileJob;
+
+struct PrecompileJob {
+    HymnObjectString *module;
+    HymnFunction *func;
+    HymnString *serial;
+    ImportList uses;
+    HymnInt stamp[2];
+    bool done;
+    char padding[7];
+};
+
+struct Precompile {
+    PrecompileJob *jobs;
+    int count;
+    int capacity;
+    int next;
+    bool closed;
+    char padding[3];
+#ifndef _MSC_VER
+    pthread_mutex_t lock;
+    pthread_cond_t signal;
+#endif
+};
+
+static bool precompile_queued(Hymn *H, Precompile *P, HymnObjectString *module) {
+    if (!hymn_is_undefined(table_get(H->imports, module)) || !hymn_is_undefined(table_get(&H->precompiled, module))) {
+        return true;
+    }
+    for (int i = 0; i < P->count; i++) {
+        if (P->jobs[i].module == module) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void precompile_queue(Hymn *H, Precompile *P, HymnString *use, HymnString *parent) {
+    HymnString *look = hymn_path_convert(use);
+    ImportResolution *resolution = import_resolve(H, look, parent);
+    hymn_string_delete(look);
+
+    if (resolution->found < 0) {
+        return;
+    }
+
+    HymnObjectString *module = resolution->candidates[resolution->found];
+
+#ifndef HYMN_NO_DYNAMIC_LIBS
+    size_t len = hymn_string_len(module->string);
+    size_t lib_len = strlen(HYMN_DLIB_EXTENSION);
+    if (len > lib_len && memcmp(&module->string[len - lib_len], HYMN_DLIB_EXTENSION, lib_len) == 0) {
+        return;
+    }
+#endif
+
+    HymnInt stamp[2];
+    if (precompile_queued(H, P, module) || !file_stamp(module->string, stamp)) {
+        return;
+    }
+
+    hymn_reference_string(module);
+
+#ifndef _MSC_VER
+    pthread_mutex_lock(&P->lock);
+#endif
+    if (P->count == P->capacity) {
+        P->capacity = P->capacity == 0 ? 8 : P->capacity * 2;
+        P->jobs = hymn_realloc_int(P->jobs, P->capacity, sizeof(PrecompileJob));
+    }
+    PrecompileJob *job = &P->jobs[P->count++];
+    memset(job, 0, sizeof(PrecompileJob));
+    job->module = module;
+    job->stamp[0] = stamp[0];
+    job->stamp[1] = stamp[1];
+#ifndef _MSC_VER
+    pthread_cond_broadcast(&P->signal);
+    pthread_mutex_unlock(&P->lock);
+#endif
+}
+
+static int precompile_finish(Hymn *H, Precompile *P, PrecompileJob *job) {
+    HymnObjectString *module = job->module;
+    int cached = 0;
+    HymnValue value = job->func != NULL ? hymn_new_func_value(job->func) : hymn_new_none();
+    if (job->serial != NULL) {
+        value = hymn_deserialize(H, job->serial);
+        hymn_string_delete(job->serial);
+    }
+    if (hymn_is_func(value)) {
+        HymnArray *entry = hymn_new_array(3);
+        entry->items[0] = value;
+        entry->items[1] = hymn_new_int(job->stamp[0]);
+        entry->items[2] = hymn_new_int(job->stamp[1]);
+        hymn_reference(value);
+        hymn_set_property(H, &H->precompiled, module, hymn_new_array_value(entry));
+        cached = 1;
+    }
+    if (job->uses.count > 0) {
+        HymnString *parent = hymn_path_parent(module->string);
+        for (int i = 0; i < job->uses.count; i++) {
+            precompile_queue(H, P, job->uses.items[i], parent);
+        }
+        hymn_string_delete(parent);
+    }
+    import_list_delete(&job->uses);
+    return cached;
+}
+
+static int precompile_serial(Hymn *H, Precompile *P) {
+    int cached = 0;
+    for (int i = 0; i < P->count; i++) {
+        PrecompileJob job = {.module = P->jobs[i].module, .stamp = {P->jobs[i].stamp[0], P->jobs[i].stamp[1]}};
+        HymnString *source = hymn_read_file(job.module->string);
+        if (source != NULL) {
+            CompileResult result = compile_with_uses(H, job.module->string, source, TYPE_MODULE, &job.uses);
+            job.func = result.func;
+            free(result.error);
+            hymn_string_delete(source);
+        }
+        cached += precompile_finish(H, P, &job);
+    }
+    return cached;
+}
+
+#ifndef _MSC_VER
+
+static void precompile_job(Hymn *W, const char *path, PrecompileJob *job) {
+    Hymn *previous = active;
+    active = W;
+    HymnString *source = hymn_read_file(path);
+    if (source != NULL) {
+        CompileResult result = compile_with_uses(W, path, source, TYPE_MODULE, &job->uses);
+        if (result.func != NULL) {
+            job->serial = hymn_serialize(hymn_new_func_value(result.func));
+            function_delete(result.func);
+        }
+        free(result.error);
+        hymn_string_delete(source);
+    }
+    active = previous;
+}
+
+static void *precompile_worker(void *data) {
+    Precompile *P = (Precompile *)data;
+    Hymn *W = new_hymn();
+    pthread_mutex_lock(&P->lock);
+    while (true) {
+        while (P->next >= P->count && !P->closed) {
+            pthread_cond_wait(&P->signal, &P->lock);
+        }
+        if (P->next >= P->count) {
+            break;
+        }
+        int index = P->next++;
+        const char *path = P->jobs[index].module->string;
+        pthread_mutex_unlock(&P->lock);
+
+        PrecompileJob result = {0};
+        precompile_job(W, path, &result);
+
+        pthread_mutex_lock(&P->lock);
+        PrecompileJob *job = &P->jobs[index];
+        job->serial = result.serial;
+        job->uses = result.uses;
+        job->done = true;
+        pthread_cond_broadcast(&P->signal);
+    }
+    pthread_mutex_unlock(&P->lock);
+    hymn_delete(W);
+    return NULL;
+}
+
+static int precompile_parallel(Hymn *H, Precompile *P, int threads) {
+    pthread_t *workers = hymn_malloc_int(threads, sizeof(pthread_t));
+    int started = 0;
+    while (started < threads && pthread_create(&workers[started], NULL, precompile_worker, P) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        hymn_free(workers);
+        return precompile_serial(H, P);
+    }
+    int cached = 0;
+    pthread_mutex_lock(&P->lock);
+    for (int i = 0; i < P->count; i++) {
+        while (!P->jobs[i].done) {
+            pthread_cond_wait(&P->signal, &P->lock);
+        }
+        PrecompileJob job = P->jobs[i];
+        pthread_mutex_unlock(&P->lock);
+        cached += precompile_finish(H, P, &job);
+        pthread_mutex_lock(&P->lock);
+    }
+    P->closed = true;
+    pthread_cond_broadcast(&P->signal);
+    pthread_mutex_unlock(&P->lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    hymn_free(workers);
+    return cached;
+}
+
+#endif
+
+int hymn_precompile(Hymn *H, const char *script, int threads) {
+#ifndef _MSC_VER
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > 1 && cores < 2) {
+        return 0;
+    } else if (threads > cores) {
+        threads = (int)cores;
+    }
+#endif
+    HymnString *source = hymn_read_file(script);
+    if (source == NULL) {
+        return 0;
+    }
+
+    Hymn *previous = active;
+    active = H;
+
+    Precompile P = {0};
+#ifndef _MSC_VER
+    pthread_mutex_init(&P.lock, NULL);
+    pthread_cond_init(&P.signal, NULL);
+#endif
+
+    ImportList uses = {0};
+    bool tracking = H->compile_tracking;
+    H->compile_tracking = false;
+    CompileResult result = compile_with_uses(H, script, source, TYPE_MODULE, &uses);
+    H->compile_tracking = tracking;
+    if (result.func != NULL) {
+        function_delete(result.func);
+    }
+    free(result.error);
+    hymn_string_delete(source);
+
+    HymnString *path = hymn_new_string(script);
+    HymnString *parent = hymn_path_parent(path);
+    for (int i = 0; i < uses.count; i++) {
+        precompile_queue(H, &P, uses.items[i], parent);
+    }
+    import_list_delete(&uses);
+    hymn_string_delete(parent);
+    hymn_string_delete(path);
+
+#ifndef _MSC_VER
+    int cached = threads > 1 && P.count > 1 ? precompile_parallel(H, &P, threads > P.count ? P.count : threads) : precompile_serial(H, &P);
+    pthread_cond_destroy(&P.signal);
+    pthread_mutex_destroy(&P.lock);
+#else
+    (void)threads;
+    int cached = precompile_serial(H, &P);
+#endif
+
+    for (int i = 0; i < P.count; i++) {
+        hymn_dereference_string(H, P.jobs[i].module);
+    }
+    hymn_free(P.jobs);
+
+    active = previous;
+
+    return cached;
+}
+
 #ifndef HYMN_NO_REPL
 
 #include <ctype.h>
@@ -7760,7 +11324,7 @@ enum Keyboard {
     DELETE_KEY
 };
 
-static char letters[] =
+static const char letters[] =
     "0123456789"
     "abcdefghijklmnopqrstuvwxyz"
     "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -7857,6 +11421,8 @@ static void call_function(Hymn *H, HymnFunction *func) {
         fprintf(stderr, "%s\n", error);
         fflush(stderr);
         free(error);
+    } else {
+        hymn_dereference(H, pop(H));
     }
     assert(H->stack_top == H->stack);
     reset_stack(H);
@@ -7891,6 +11457,9 @@ void hymn_repl(Hymn *H) {
     History *cursor = NULL;
 #endif
 
+    Hymn *previous = active;
+    active = H;
+
     char line[INPUT_LIMIT];
     HymnString *input = hymn_new_string_with_capacity(INPUT_LIMIT);
 
@@ -8270,17 +11839,19 @@ quit:
 #ifndef _MSC_VER
     while (lines != NULL) {
         hymn_string_delete(lines->input);
-        History *previous = lines->previous;
-        free(lines);
-        lines = previous;
+        History *back = lines->previous;
+        hymn_free(lines);
+        lines = back;
     }
 #endif
     while (history != NULL) {
         hymn_string_delete(history->input);
-        History *previous = history->previous;
-        free(history);
-        history = previous;
+        History *back = history->previous;
+        hymn_free(history);
+        history = back;
     }
+
+    active = previous;
 }
 #endif
 
@@ -8422,7 +11993,7 @@ static void append(Format *F, char c) {
     const size_t len = ++F->n;
     if (len >= F->capacity) {
         F->capacity += 256;
-        F->dest = hymn_realloc(F->dest, (F->capacity + 1) * sizeof(char));
+        F->dest = system_realloc(F->dest, (F->capacity + 1) * sizeof(char));
     }
     F->dest[len - 1] = c;
 }
@@ -8775,7 +12346,7 @@ char *hymn_format(HymnString *source) {
     F.source = source;
     F.size = size;
     F.capacity = size;
-    F.dest = hymn_malloc((size + 1) * sizeof(char));
+    F.dest = system_malloc((size + 1) * sizeof(char));
     skip(&F);
     while (F.s < size) {
         char c = source[F.s++];
@@ -9033,7 +12604,7 @@ char *hymn_format(HymnString *source) {
     }
     F.dest[F.capacity] = '\0';
     F.dest[F.n] = '\0';
-    free(F.compact);
-    free(F.nest);
+    hymn_free(F.compact);
+    hymn_free(F.nest);
     return F.dest;
 }
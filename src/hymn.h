@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <math.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -25,6 +26,7 @@
 // #define HYMN_NO_REPL
 // #define HYMN_NO_DYNAMIC_LIBS
 // #define HYMN_NO_OPTIMIZE
+// #define HYMN_NO_LAZY
 // #define HYMN_NO_MEMORY
 
 #ifdef _MSC_VER
@@ -66,8 +68,11 @@
 
 #define HYMN_UINT8_COUNT (UINT8_MAX + 1)
 
-#define HYMN_FRAMES_MAX 64
-#define HYMN_STACK_MAX (HYMN_FRAMES_MAX * HYMN_UINT8_COUNT)
+#define HYMN_FRAMES_MAX 1024
+
+#define HYMN_HANDLE_ARGUMENTS 16
+
+#define HYMN_SIGNATURE_MAX 8
 
 #define hymn_string_head(string) ((HymnStringHead *)((char *)string - sizeof(HymnStringHead)))
 #define hymn_string_len(string) (hymn_string_head(string)->length)
@@ -88,6 +93,7 @@ enum HymnValueType {
     HYMN_VALUE_FUNC,
     HYMN_VALUE_FUNC_NATIVE,
     HYMN_VALUE_POINTER,
+    HYMN_VALUE_COROUTINE,
 };
 
 typedef char HymnString;
@@ -110,8 +116,22 @@ export void *hymn_malloc_int(int count, size_t size);
 export void *hymn_calloc_int(int count, size_t size);
 export void *hymn_realloc_int(void *mem, int count, size_t size);
 
+export void hymn_free(void *mem);
+
 export FILE *hymn_open_file(const char *path, const char *mode);
 
+enum HymnBudget {
+    HYMN_BUDGET_CONTINUE,
+    HYMN_BUDGET_ABORT,
+    HYMN_BUDGET_YIELD,
+};
+
+enum HymnTrace {
+    HYMN_TRACE_CALL = 1,
+    HYMN_TRACE_RETURN = 2,
+    HYMN_TRACE_LINE = 4,
+};
+
 typedef struct HymnValue HymnValue;
 typedef struct HymnObjectString HymnObjectString;
 typedef struct HymnArray HymnArray;
@@ -123,8 +143,17 @@ typedef struct HymnExceptList HymnExceptList;
 typedef struct HymnFunction HymnFunction;
 typedef struct HymnNativeFunction HymnNativeFunction;
 typedef struct HymnFrame HymnFrame;
+typedef struct HymnCoroutine HymnCoroutine;
+typedef struct HymnHandle HymnHandle;
+typedef struct HymnSnapshot HymnSnapshot;
 typedef struct HymnValuePool HymnValuePool;
 typedef struct HymnByteCode HymnByteCode;
+typedef struct HymnAllocator HymnAllocator;
+typedef struct HymnCensus HymnCensus;
+typedef struct HymnImportCache HymnImportCache;
+typedef struct HymnCompileStats HymnCompileStats;
+typedef struct HymnFinalizer HymnFinalizer;
+typedef struct HymnOpcodeCounts HymnOpcodeCounts;
 typedef struct Hymn Hymn;
 
 typedef struct HymnValue (*HymnNativeCall)(Hymn *H, int count, HymnValue *arguments);
@@ -145,11 +174,14 @@ struct HymnObjectString {
     int count;
     unsigned int hash;
     HymnString *string;
+    bool frozen;
+    char padding[7];
 };
 
 struct HymnArray {
     int count;
-    char padding[4];
+    bool frozen;
+    char padding[3];
     HymnValue *items;
     HymnInt length;
     HymnInt capacity;
@@ -165,7 +197,8 @@ struct HymnTable {
     int count;
     int size;
     unsigned int bins;
-    char padding[4];
+    bool frozen;
+    char padding[3];
     HymnTableItem **items;
 };
 
@@ -182,9 +215,12 @@ struct HymnSet {
 
 struct HymnNativeFunction {
     int count;
-    char padding[4];
+    int arity;
     HymnObjectString *name;
     HymnNativeCall func;
+    uint16_t types[HYMN_SIGNATURE_MAX];
+    bool scalar;
+    char padding[7];
 };
 
 struct HymnValuePool {
@@ -197,7 +233,9 @@ struct HymnByteCode {
     int count;
     int capacity;
     uint8_t *instructions;
-    int *lines;
+    int *rows;
+    uint8_t *lines;
+    size_t line_size;
     HymnValuePool constants;
 };
 
@@ -212,6 +250,8 @@ struct HymnExceptList {
 struct HymnFunction {
     int count;
     int arity;
+    int row;
+    int column;
     HymnString *name;
     HymnString *script;
     HymnString *source;
@@ -226,6 +266,59 @@ struct HymnFrame {
     HymnValue *stack;
 };
 
+struct HymnCoroutine {
+    int count;
+    int status;
+    HymnValue function;
+    HymnValue value;
+    HymnValue *stack;
+    HymnValue *stack_top;
+    HymnFrame *frames;
+    int stack_capacity;
+    int frame_count;
+    int frame_capacity;
+    bool preempted;
+    char padding[3];
+};
+
+struct HymnHandle {
+    Hymn *H;
+    HymnValue function;
+    HymnValue result;
+    int count;
+    bool overflow;
+    char padding[3];
+    HymnValue arguments[HYMN_HANDLE_ARGUMENTS];
+};
+
+struct HymnCompileStats {
+    char *script;
+    size_t source;
+    int64_t lex;
+    int64_t parse;
+    int64_t optimize;
+    size_t bytes;
+    size_t optimized;
+    size_t constants;
+    size_t lines;
+    int functions;
+    char padding[4];
+    HymnCompileStats *next;
+};
+
+struct HymnFinalizer {
+    void (*finalize)(Hymn *H, void *user);
+    void *user;
+    HymnFinalizer *next;
+};
+
+struct HymnSnapshot {
+    HymnTable *globals;
+    HymnArray *objects;
+    HymnArray *copies;
+    int64_t budget_left;
+};
+
 #ifndef HYMN_NO_DYNAMIC_LIBS
 typedef struct HymnLibList HymnLibList;
 
@@ -235,23 +328,66 @@ struct HymnLibList {
 };
 #endif
 
+// Thread and pool workers created by the thread library inherit the parent's
+// allocator, so these functions are called from several threads at once and
+// must be thread safe when that library is used.
+struct HymnAllocator {
+    void *(*allocate)(void *user, size_t size);
+    void *(*reallocate)(void *user, void *memory, size_t size);
+    void (*release)(void *user, void *memory);
+    void *user;
+};
+
 struct Hymn {
-    HymnValue stack[HYMN_STACK_MAX];
+    HymnValue *stack;
     HymnValue *stack_top;
-    HymnFrame frames[HYMN_FRAMES_MAX];
+    HymnFrame *frames;
+    int stack_capacity;
     int frame_count;
-    char padding[4];
+    int frame_capacity;
+    int frame_limit;
     HymnSet strings;
     HymnTable globals;
     HymnArray *paths;
     HymnTable *imports;
+    HymnImportCache *import_cache;
+    HymnTable precompiled;
     HymnString *error;
     HymnString *exception;
+    HymnCoroutine *coroutine;
+    HymnSnapshot *snapshot;
+    HymnCensus *census;
+    HymnCompileStats *compile_stats;
+    HymnFinalizer *finalizers;
+#ifdef HYMN_OPCODE_COUNTS
+    HymnOpcodeCounts *opcode_counts;
+#endif
 #ifndef HYMN_NO_DYNAMIC_LIBS
     HymnLibList *libraries;
 #endif
     void (*print)(const char *format, ...);
     void (*print_error)(const char *format, ...);
+    HymnAllocator allocator;
+    size_t memory;
+    size_t memory_peak;
+    size_t memory_limit;
+    int64_t budget;
+    int64_t budget_left;
+    enum HymnBudget (*budget_callback)(Hymn *H, void *user);
+    void *budget_user;
+    void (*sampler)(Hymn *H);
+    void (*allocated)(Hymn *H, size_t size, const char *kind);
+    void (*tracer)(Hymn *H, enum HymnTrace event, HymnFunction *func, int line, void *user);
+    void *trace_user;
+    volatile sig_atomic_t interrupt;
+    volatile sig_atomic_t interrupted;
+    volatile sig_atomic_t sample;
+    int trace_events;
+    int frame_base;
+    bool memory_exceeded;
+    bool yielded;
+    bool compile_tracking;
+    char padding[1];
 };
 
 export HymnString *hymn_working_directory(void);
@@ -301,6 +437,7 @@ export void hymn_array_delete(Hymn *H, HymnArray *array);
 export HymnTable *hymn_new_table(void);
 
 export HymnValue hymn_table_get(HymnTable *table, const char *key);
+export HymnTableItem *hymn_table_next(HymnTable *table, HymnObjectString *key);
 
 export HymnValue hymn_new_undefined(void);
 export HymnValue hymn_new_none(void);
@@ -323,6 +460,7 @@ export HymnInt hymn_as_int(HymnValue v);
 export HymnFloat hymn_as_float(HymnValue v);
 export HymnNativeFunction *hymn_as_native(HymnValue v);
 export void *hymn_as_pointer(HymnValue v);
+export HymnCoroutine *hymn_as_coroutine(HymnValue v);
 export void *hymn_as_object(HymnValue v);
 export HymnObjectString *hymn_as_hymn_string(HymnValue v);
 export HymnString *hymn_as_string(HymnValue v);
@@ -337,6 +475,7 @@ export bool hymn_is_int(HymnValue v);
 export bool hymn_is_float(HymnValue v);
 export bool hymn_is_native(HymnValue v);
 export bool hymn_is_pointer(HymnValue v);
+export bool hymn_is_coroutine(HymnValue v);
 export bool hymn_is_string(HymnValue v);
 export bool hymn_is_array(HymnValue v);
 export bool hymn_is_table(HymnValue v);
@@ -361,15 +500,45 @@ export HymnValue hymn_arity_exception(Hymn *H, int expected, int actual);
 export HymnValue hymn_type_exception(Hymn *H, enum HymnValueType expected, enum HymnValueType actual);
 
 export Hymn *new_hymn(void);
+export Hymn *new_hymn_with_allocator(HymnAllocator *allocator);
 
 export char *hymn_call(Hymn *H, const char *name, int arguments);
+
+// From inside a native this runs on the same stack above the caller. The stack
+// may be reallocated as it grows, so read any arguments the native still needs
+// before calling.
+export char *hymn_call_value(Hymn *H, HymnValue function, int count, HymnValue *arguments, HymnValue *result);
+export HymnHandle *hymn_handle(Hymn *H, const char *name);
+export HymnHandle *hymn_handle_value(Hymn *H, HymnValue function);
+export bool hymn_handle_push(HymnHandle *handle, HymnValue value);
+export bool hymn_handle_push_int(HymnHandle *handle, HymnInt value);
+export bool hymn_handle_push_float(HymnHandle *handle, HymnFloat value);
+export bool hymn_handle_push_bool(HymnHandle *handle, bool value);
+export bool hymn_handle_push_string(HymnHandle *handle, const char *value);
+export char *hymn_handle_call(HymnHandle *handle);
+export char *hymn_handle_call_batch(HymnHandle *handle, int count, int arity, HymnValue *arguments, HymnValue *results);
+export HymnValue hymn_handle_result(HymnHandle *handle);
+export void hymn_handle_delete(HymnHandle *handle);
+export HymnString *hymn_serialize(HymnValue value);
+export HymnValue hymn_deserialize(Hymn *H, HymnString *data);
+export HymnTable *hymn_function_globals(Hymn *H, HymnFunction *func);
+export HymnValue hymn_freeze(Hymn *H, HymnValue value);
+export size_t hymn_frozen_memory(void);
+export void hymn_set_frozen_limit(size_t limit);
+export void hymn_census_track(Hymn *H, bool track);
+export HymnString *hymn_census(Hymn *H);
+export void hymn_compile_stats_track(Hymn *H, bool track);
+export HymnString *hymn_compile_stats(Hymn *H);
 export char *hymn_debug(Hymn *H, const char *script, const char *source);
+export char *hymn_compile(Hymn *H, const char *script, const char *source);
 export char *hymn_run(Hymn *H, const char *script, const char *source);
 export char *hymn_do(Hymn *H, const char *source);
 export char *hymn_direct(Hymn *H, const char *source);
 export char *hymn_script(Hymn *H, const char *script);
+export int hymn_precompile(Hymn *H, const char *script, int threads);
 
 export HymnValue hymn_get(Hymn *H, const char *name);
+export Hymn *hymn_activate(Hymn *H);
 
 export void hymn_add(Hymn *H, const char *name, HymnValue value);
 export void hymn_add_string(Hymn *H, const char *name, const char *string);
@@ -378,7 +547,22 @@ export void hymn_add_pointer(Hymn *H, const char *name, void *pointer);
 export void hymn_add_string_to_table(Hymn *H, HymnTable *table, const char *name, const char *string);
 export void hymn_add_function_to_table(Hymn *H, HymnTable *table, const char *name, HymnNativeCall func);
 export void hymn_add_function(Hymn *H, const char *name, HymnNativeCall func);
-
+export void hymn_add_function_typed(Hymn *H, const char *name, HymnNativeCall func, const char *signature);
+export void hymn_add_function_typed_to_table(Hymn *H, HymnTable *table, const char *name, HymnNativeCall func, const char *signature);
+
+export void hymn_set_tracer(Hymn *H, void (*tracer)(Hymn *H, enum HymnTrace event, HymnFunction *func, int line, void *user), int events, void *user);
+export void hymn_set_budget(Hymn *H, int64_t checks, enum HymnBudget (*callback)(Hymn *H, void *user), void *user);
+export void hymn_interrupt(Hymn *H);
+export void hymn_add_finalizer(Hymn *H, void (*finalize)(Hymn *H, void *user), void *user);
+export void *hymn_finalizer_user(Hymn *H, void (*finalize)(Hymn *H, void *user));
+export int hymn_frame_row(HymnFrame *frame);
+
+#ifdef HYMN_OPCODE_COUNTS
+export HymnString *hymn_opcode_counts(bool json);
+export void hymn_opcode_counts_clear(void);
+#endif
+export void hymn_capture(Hymn *H);
+export void hymn_reset(Hymn *H);
 export void hymn_delete(Hymn *H);
 
 #ifndef HYMN_NO_REPL
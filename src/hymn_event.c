@@ -0,0 +1,564 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#ifdef __GNUC__
+#define _GNU_SOURCE
+#endif
+
+#include "hymn_event.h"
+
+#ifndef __linux__
+
+static HymnValue event_unsupported(Hymn *H, int count, HymnValue *arguments) {
+    (void)count;
+    (void)arguments;
+    return hymn_new_exception(H, "event loop not supported");
+}
+
+void hymn_use_event(Hymn *H) {
+    HymnTable *event = hymn_new_table();
+    hymn_add_function_to_table(H, event, "loop", event_unsupported);
+    hymn_add_function_to_table(H, event, "release", event_unsupported);
+    hymn_add_function_to_table(H, event, "timer", event_unsupported);
+    hymn_add_function_to_table(H, event, "watch", event_unsupported);
+    hymn_add_function_to_table(H, event, "unwatch", event_unsupported);
+    hymn_add_function_to_table(H, event, "poll", event_unsupported);
+    hymn_add_function_to_table(H, event, "run", event_unsupported);
+    hymn_add_function_to_table(H, event, "stop", event_unsupported);
+    hymn_add_function_to_table(H, event, "fd", event_unsupported);
+    hymn_add_function_to_table(H, event, "read", event_unsupported);
+    hymn_add_function_to_table(H, event, "write", event_unsupported);
+    hymn_add_function_to_table(H, event, "close", event_unsupported);
+    hymn_add_function_to_table(H, event, "listen", event_unsupported);
+    hymn_add_function_to_table(H, event, "connect", event_unsupported);
+    hymn_add_function_to_table(H, event, "accept", event_unsupported);
+    hymn_add_table(H, "event", event);
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define EVENT_BATCH 64
+#define EVENT_READ_SIZE 4096
+
+typedef struct Watch Watch;
+typedef struct Loop Loop;
+typedef struct Loops Loops;
+
+struct Watch {
+    int fd;
+    bool timer;
+    bool repeat;
+    bool removed;
+    char padding[1];
+    HymnValue callback;
+    Watch *next;
+};
+
+struct Loop {
+    int epoll;
+    int count;
+    bool stopped;
+    bool dispatching;
+    char padding[6];
+    Watch *watches;
+    Watch *removed;
+    Loop *next;
+};
+
+struct Loops {
+    Loop *head;
+};
+
+static void loops_finalize(Hymn *H, void *user);
+
+static Loop *get_loop(Hymn *H, HymnValue value) {
+    if (!hymn_is_pointer(value)) {
+        return NULL;
+    }
+    Loops *loops = hymn_finalizer_user(H, loops_finalize);
+    if (loops == NULL) {
+        return NULL;
+    }
+    void *pointer = hymn_as_pointer(value);
+    for (Loop *loop = loops->head; loop != NULL; loop = loop->next) {
+        if (loop == pointer) {
+            return loop;
+        }
+    }
+    return NULL;
+}
+
+#define LOOP_ARGUMENT                                           \
+    if (count < 1) {                                            \
+        return hymn_new_exception(H, "missing loop");           \
+    }                                                           \
+    Loop *loop = get_loop(H, arguments[0]);                     \
+    if (loop == NULL) {                                         \
+        return hymn_new_exception(H, "expected an event loop"); \
+    }
+
+static bool get_fd(HymnValue value, int *fd) {
+    if (hymn_is_int(value)) {
+        *fd = (int)hymn_as_int(value);
+        return true;
+    } else if (hymn_is_pointer(value) && hymn_as_pointer(value) != NULL) {
+        *fd = fileno((FILE *)hymn_as_pointer(value));
+        return *fd >= 0;
+    }
+    return false;
+}
+
+static HymnValue errno_exception(Hymn *H, const char *what) {
+    HymnString *message = hymn_string_format("%s: %s", what, strerror(errno));
+    HymnValue exception = hymn_new_exception(H, message);
+    hymn_string_delete(message);
+    return exception;
+}
+
+static Watch *find_watch(Loop *loop, int fd) {
+    for (Watch *watch = loop->watches; watch != NULL; watch = watch->next) {
+        if (watch->fd == fd) {
+            return watch;
+        }
+    }
+    return NULL;
+}
+
+static void watch_delete(Hymn *H, Watch *watch) {
+    if (watch->timer) {
+        close(watch->fd);
+    }
+    hymn_dereference(H, watch->callback);
+    hymn_free(watch);
+}
+
+static void watch_remove(Hymn *H, Loop *loop, Watch *watch) {
+    Watch **link = &loop->watches;
+    while (*link != watch) {
+        link = &(*link)->next;
+    }
+    *link = watch->next;
+    loop->count--;
+    epoll_ctl(loop->epoll, EPOLL_CTL_DEL, watch->fd, NULL);
+    watch->removed = true;
+    if (loop->dispatching) {
+        watch->next = loop->removed;
+        loop->removed = watch;
+    } else {
+        watch_delete(H, watch);
+    }
+}
+
+static Watch *watch_add(Loop *loop, int fd, uint32_t events, HymnValue callback) {
+    Watch *watch = hymn_calloc(1, sizeof(Watch));
+    watch->fd = fd;
+    watch->callback = callback;
+    struct epoll_event event = {0};
+    event.events = events;
+    event.data.ptr = watch;
+    if (epoll_ctl(loop->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+        hymn_free(watch);
+        return NULL;
+    }
+    hymn_reference(callback);
+    watch->next = loop->watches;
+    loop->watches = watch;
+    loop->count++;
+    return watch;
+}
+
+static void loop_delete(Hymn *H, Loop *loop) {
+    while (loop->watches != NULL) {
+        watch_remove(H, loop, loop->watches);
+    }
+    close(loop->epoll);
+    hymn_free(loop);
+}
+
+static void loops_finalize(Hymn *H, void *user) {
+    Loops *loops = (Loops *)user;
+    Loop *loop = loops->head;
+    while (loop != NULL) {
+        Loop *next = loop->next;
+        loop_delete(H, loop);
+        loop = next;
+    }
+    free(loops);
+}
+
+static HymnValue event_loop(Hymn *H, int count, HymnValue *arguments) {
+    (void)count;
+    (void)arguments;
+    Loops *loops = hymn_finalizer_user(H, loops_finalize);
+    if (loops == NULL) {
+        loops = calloc(1, sizeof(Loops));
+        if (loops == NULL) {
+            fprintf(stderr, "calloc failed.\n");
+            exit(1);
+        }
+        hymn_add_finalizer(H, loops_finalize, loops);
+    }
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) {
+        return errno_exception(H, "epoll");
+    }
+    Loop *loop = hymn_calloc(1, sizeof(Loop));
+    loop->epoll = epoll;
+    loop->next = loops->head;
+    loops->head = loop;
+    return hymn_new_pointer(loop);
+}
+
+static HymnValue event_release(Hymn *H, int count, HymnValue *arguments) {
+    LOOP_ARGUMENT
+    if (loop->dispatching) {
+        return hymn_new_exception(H, "can't release a running loop");
+    }
+    Loops *loops = hymn_finalizer_user(H, loops_finalize);
+    Loop **link = &loops->head;
+    while (*link != loop) {
+        link = &(*link)->next;
+    }
+    *link = loop->next;
+    loop_delete(H, loop);
+    return hymn_new_none();
+}
+
+static HymnValue event_timer(Hymn *H, int count, HymnValue *arguments) {
+    LOOP_ARGUMENT
+    if (count < 3) {
+        return hymn_new_exception(H, "missing milliseconds and callback");
+    } else if (!hymn_is_int(arguments[1])) {
+        return hymn_type_exception(H, HYMN_VALUE_INTEGER, arguments[1].is);
+    }
+    HymnInt milliseconds = hymn_as_int(arguments[1]);
+    bool repeat = count >= 4 && !hymn_value_false(arguments[3]);
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        return errno_exception(H, "timerfd");
+    }
+    if (milliseconds < 1) {
+        milliseconds = 1;
+    }
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = (time_t)(milliseconds / 1000);
+    spec.it_value.tv_nsec = (long)(milliseconds % 1000) * 1000000L;
+    if (repeat) {
+        spec.it_interval = spec.it_value;
+    }
+    timerfd_settime(fd, 0, &spec, NULL);
+    Watch *watch = watch_add(loop, fd, EPOLLIN, arguments[2]);
+    if (watch == NULL) {
+        close(fd);
+        return errno_exception(H, "epoll");
+    }
+    watch->timer = true;
+    watch->repeat = repeat;
+    return hymn_new_int(fd);
+}
+
+static HymnValue event_watch(Hymn *H, int count, HymnValue *arguments) {
+    LOOP_ARGUMENT
+    if (count < 4) {
+        return hymn_new_exception(H, "missing source, mode and callback");
+    }
+    int fd;
+    if (!get_fd(arguments[1], &fd)) {
+        return hymn_new_exception(H, "source must be a file descriptor or file pointer");
+    } else if (!hymn_is_string(arguments[2])) {
+        return hymn_type_exception(H, HYMN_VALUE_STRING, arguments[2].is);
+    }
+    HymnString *mode = hymn_as_string(arguments[2]);
+    uint32_t events = 0;
+    if (strchr(mode, 'r') != NULL) events |= EPOLLIN;
+    if (strchr(mode, 'w') != NULL) events |= EPOLLOUT;
+    if (events == 0) {
+        return hymn_new_exception(H, "mode must contain 'r' or 'w'");
+    }
+    if (find_watch(loop, fd) != NULL) {
+        return hymn_new_exception(H, "already watching file descriptor");
+    }
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0) {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+    if (watch_add(loop, fd, events, arguments[3]) == NULL) {
+        return errno_exception(H, "epoll");
+    }
+    return hymn_new_int(fd);
+}
+
+static HymnValue event_unwatch(Hymn *H, int count, HymnValue *arguments) {
+    LOOP_ARGUMENT
+    int fd;
+    if (count < 2 || !get_fd(arguments[1], &fd)) {
+        return hymn_new_exception(H, "missing watch");
+    }
+    Watch *watch = find_watch(loop, fd);
+    if (watch == NULL) {
+        return hymn_new_bool(false);
+    }
+    watch_remove(H, loop, watch);
+    return hymn_new_bool(true);
+}
+
+static HymnValue dispatch(Hymn *H, Loop *loop, Watch *watch, uint32_t events) {
+    int count;
+    HymnValue arguments[2];
+    arguments[0] = hymn_new_int(watch->fd);
+    if (watch->timer) {
+        uint64_t expirations;
+        if (read(watch->fd, &expirations, sizeof(expirations)) < 0) {
+            return hymn_new_none();
+        }
+        count = 1;
+    } else {
+        const char *mode = "r";
+        if ((events & EPOLLOUT) != 0) {
+            mode = (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 ? "rw" : "w";
+        }
+        arguments[1] = hymn_new_string_value(hymn_new_intern_string(H, mode));
+        hymn_reference(arguments[1]);
+        count = 2;
+    }
+    HymnValue callback = watch->callback;
+    hymn_reference(callback);
+    HymnValue result;
+    char *error = hymn_call_value(H, callback, count, arguments, &result);
+    hymn_dereference(H, callback);
+    if (count == 2) {
+        hymn_dereference(H, arguments[1]);
+    }
+    if (error != NULL) {
+        HymnValue exception = hymn_new_exception(H, error);
+        free(error);
+        return exception;
+    }
+    hymn_dereference(H, result);
+    if (watch->timer && !watch->repeat && !watch->removed) {
+        watch_remove(H, loop, watch);
+    }
+    return hymn_new_none();
+}
+
+static HymnValue poll_loop(Hymn *H, Loop *loop, int timeout, int *fired) {
+    struct epoll_event events[EVENT_BATCH];
+    int ready = epoll_wait(loop->epoll, events, EVENT_BATCH, timeout);
+    if (ready < 0) {
+        return errno == EINTR ? hymn_new_none() : errno_exception(H, "epoll");
+    }
+    loop->dispatching = true;
+    HymnValue result = hymn_new_none();
+    for (int i = 0; i < ready; i++) {
+        Watch *watch = (Watch *)events[i].data.ptr;
+        if (watch->removed) {
+            continue;
+        }
+        (*fired)++;
+        result = dispatch(H, loop, watch, events[i].events);
+        if (H->exception != NULL || loop->stopped) {
+            break;
+        }
+    }
+    loop->dispatching = false;
+    while (loop->removed != NULL) {
+        Watch *next = loop->removed->next;
+        watch_delete(H, loop->removed);
+        loop->removed = next;
+    }
+    return result;
+}
+
+static HymnValue event_poll(Hymn *H, int count, HymnValue *arguments) {
+    LOOP_ARGUMENT
+    if (loop->dispatching) {
+        return hymn_new_exception(H, "loop is already running");
+    }
+    int timeout = count >= 2 && hymn_is_int(arguments[1]) ? (int)hymn_as_int(arguments[1]) : 0;
+    int fired = 0;
+    loop->stopped = false;
+    HymnValue result = poll_loop(H, loop, timeout, &fired);
+    if (H->exception != NULL) {
+        return result;
+    }
+    return hymn_new_int(fired);
+}
+
+static HymnValue event_run(Hymn *H, int count, HymnValue *arguments) {
+    LOOP_ARGUMENT
+    if (loop->dispatching) {
+        return hymn_new_exception(H, "loop is already running");
+    }
+    loop->stopped = false;
+    while (!loop->stopped && loop->count > 0) {
+        int fired = 0;
+        HymnValue result = poll_loop(H, loop, -1, &fired);
+        if (H->exception != NULL) {
+            return result;
+        }
+    }
+    return hymn_new_none();
+}
+
+static HymnValue event_stop(Hymn *H, int count, HymnValue *arguments) {
+    LOOP_ARGUMENT
+    loop->stopped = true;
+    return hymn_new_none();
+}
+
+static HymnValue event_fd(Hymn *H, int count, HymnValue *arguments) {
+    int fd;
+    if (count < 1 || !get_fd(arguments[0], &fd)) {
+        return hymn_new_exception(H, "argument must be a file pointer");
+    }
+    return hymn_new_int(fd);
+}
+
+static HymnValue event_read(Hymn *H, int count, HymnValue *arguments) {
+    int fd;
+    if (count < 1 || !get_fd(arguments[0], &fd)) {
+        return hymn_new_exception(H, "missing file descriptor");
+    }
+    size_t size = count >= 2 && hymn_is_int(arguments[1]) && hymn_as_int(arguments[1]) > 0 ? (size_t)hymn_as_int(arguments[1]) : EVENT_READ_SIZE;
+    HymnString *string = hymn_new_empty_string(size);
+    ssize_t length = read(fd, string, size);
+    if (length < 0) {
+        hymn_string_delete(string);
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return hymn_new_string_value(hymn_new_intern_string(H, ""));
+        }
+        return errno_exception(H, "read");
+    } else if (length == 0) {
+        hymn_string_delete(string);
+        return hymn_new_none();
+    }
+    HymnString *data = hymn_new_string_with_length(string, (size_t)length);
+    hymn_string_delete(string);
+    return hymn_new_string_value(hymn_intern_string(H, data));
+}
+
+static HymnValue event_write(Hymn *H, int count, HymnValue *arguments) {
+    int fd;
+    if (count < 2 || !get_fd(arguments[0], &fd)) {
+        return hymn_new_exception(H, "missing file descriptor and content");
+    } else if (!hymn_is_string(arguments[1])) {
+        return hymn_type_exception(H, HYMN_VALUE_STRING, arguments[1].is);
+    }
+    HymnString *content = hymn_as_string(arguments[1]);
+    size_t size = hymn_string_len(content);
+    ssize_t length = send(fd, content, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (length < 0 && errno == ENOTSOCK) {
+        length = write(fd, content, size);
+    }
+    if (length < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return hymn_new_int(0);
+        }
+        return errno_exception(H, "write");
+    }
+    return hymn_new_int((HymnInt)length);
+}
+
+static HymnValue event_close(Hymn *H, int count, HymnValue *arguments) {
+    if (count < 1 || !hymn_is_int(arguments[0])) {
+        return hymn_new_exception(H, "missing file descriptor");
+    }
+    return hymn_new_int(close((int)hymn_as_int(arguments[0])));
+}
+
+static HymnValue unix_socket(Hymn *H, int count, HymnValue *arguments, struct sockaddr_un *address) {
+    if (count < 1) {
+        return hymn_new_exception(H, "missing path");
+    } else if (!hymn_is_string(arguments[0])) {
+        return hymn_type_exception(H, HYMN_VALUE_STRING, arguments[0].is);
+    }
+    HymnString *path = hymn_as_string(arguments[0]);
+    if (hymn_string_len(path) >= sizeof(address->sun_path)) {
+        return hymn_new_exception(H, "socket path too long");
+    }
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path, path, hymn_string_len(path));
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return errno_exception(H, "socket");
+    }
+    return hymn_new_int(fd);
+}
+
+static HymnValue event_listen(Hymn *H, int count, HymnValue *arguments) {
+    struct sockaddr_un address;
+    HymnValue value = unix_socket(H, count, arguments, &address);
+    if (!hymn_is_int(value)) {
+        return value;
+    }
+    int fd = (int)hymn_as_int(value);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        HymnValue exception = errno_exception(H, "listen");
+        close(fd);
+        return exception;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return value;
+}
+
+static HymnValue event_connect(Hymn *H, int count, HymnValue *arguments) {
+    struct sockaddr_un address;
+    HymnValue value = unix_socket(H, count, arguments, &address);
+    if (!hymn_is_int(value)) {
+        return value;
+    }
+    int fd = (int)hymn_as_int(value);
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        HymnValue exception = errno_exception(H, "connect");
+        close(fd);
+        return exception;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return value;
+}
+
+static HymnValue event_accept(Hymn *H, int count, HymnValue *arguments) {
+    if (count < 1 || !hymn_is_int(arguments[0])) {
+        return hymn_new_exception(H, "missing file descriptor");
+    }
+    int fd = accept4((int)hymn_as_int(arguments[0]), NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return hymn_new_none();
+        }
+        return errno_exception(H, "accept");
+    }
+    return hymn_new_int(fd);
+}
+
+void hymn_use_event(Hymn *H) {
+    HymnTable *event = hymn_new_table();
+    hymn_add_function_to_table(H, event, "loop", event_loop);
+    hymn_add_function_to_table(H, event, "release", event_release);
+    hymn_add_function_to_table(H, event, "timer", event_timer);
+    hymn_add_function_to_table(H, event, "watch", event_watch);
+    hymn_add_function_to_table(H, event, "unwatch", event_unwatch);
+    hymn_add_function_to_table(H, event, "poll", event_poll);
+    hymn_add_function_to_table(H, event, "run", event_run);
+    hymn_add_function_to_table(H, event, "stop", event_stop);
+    hymn_add_function_to_table(H, event, "fd", event_fd);
+    hymn_add_function_to_table(H, event, "read", event_read);
+    hymn_add_function_to_table(H, event, "write", event_write);
+    hymn_add_function_to_table(H, event, "close", event_close);
+    hymn_add_function_to_table(H, event, "listen", event_listen);
+    hymn_add_function_to_table(H, event, "connect", event_connect);
+    hymn_add_function_to_table(H, event, "accept", event_accept);
+    hymn_add_table(H, "event", event);
+}
+
+#endif
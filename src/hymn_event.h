@@ -0,0 +1,12 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#ifndef HYMN_EVENT_LIB_H
+#define HYMN_EVENT_LIB_H
+
+#include "hymn.h"
+
+void hymn_use_event(Hymn *H);
+
+#endif
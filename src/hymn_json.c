@@ -113,7 +113,7 @@ static HymnString *json_save_recursive(HymnValue value, struct PointerSet *set)
             hymn_string_delete(add);
         }
         string = hymn_string_append(string, " }");
-        free(keys);
+        hymn_free(keys);
         return string;
     }
     case HYMN_VALUE_FUNC: {
@@ -136,7 +136,7 @@ static HymnValue json_save(Hymn *H, int count, HymnValue *arguments) {
     }
     struct PointerSet set = {.count = 0, .capacity = 0, .items = NULL};
     HymnString *json = json_save_recursive(arguments[0], &set);
-    free(set.items);
+    hymn_free(set.items);
     HymnObjectString *string = hymn_intern_string(H, json);
     return hymn_new_string_value(string);
 }
@@ -403,8 +403,8 @@ static HymnValue json_parse(Hymn *H, int count, HymnValue *arguments) {
 
 done:
     hymn_string_delete(key);
-    free(stack->items);
-    free(stack);
+    hymn_free(stack->items);
+    hymn_free(stack);
     return json;
 
 error:
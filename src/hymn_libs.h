@@ -20,16 +20,24 @@
 #include "hymn_path.h"
 #include "hymn_pattern.h"
 #include "hymn_text.h"
+#include "hymn_event.h"
+#include "hymn_thread.h"
 
-#define hymn_use_libs(H) \
-    hymn_use_os(H);      \
-    hymn_use_io(H);      \
-    hymn_use_path(H);    \
-    hymn_use_math(H);    \
-    hymn_use_json(H);    \
-    hymn_use_text(H);    \
-    hymn_use_glob(H);    \
-    hymn_use_pattern(H)
+#define hymn_use_libs(H)                          \
+    do {                                          \
+        Hymn *hymn_previous = hymn_activate(H);   \
+        hymn_use_os(H);                           \
+        hymn_use_io(H);                           \
+        hymn_use_path(H);                         \
+        hymn_use_math(H);                         \
+        hymn_use_json(H);                         \
+        hymn_use_text(H);                         \
+        hymn_use_glob(H);                         \
+        hymn_use_pattern(H);                      \
+        hymn_use_event(H);                        \
+        hymn_use_thread(H);                       \
+        hymn_activate(hymn_previous);             \
+    } while (0)
 #endif
 
 #endif
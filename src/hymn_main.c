@@ -9,11 +9,17 @@
 
 #include "hymn.h"
 #include "hymn_libs.h"
+#include "hymn_profile.h"
 
 #if !defined(HYMN_TESTING) && !defined(HYMN_NO_CLI)
 
+static Hymn *running = NULL;
+
 static void signal_handle(int signum) {
     if (signum == SIGINT) {
+        if (running != NULL) {
+            hymn_interrupt(running);
+        }
         signal(SIGINT, signal_handle);
     } else {
         exit(signum);
@@ -25,6 +31,13 @@ static void help(void) {
            "  -c  run command\n"
            "  -i  open interactive mode\n"
            "  -b  print compiled byte code\n"
+           "  --profile <file>  write sampled folded stacks to file, sampled at calls and loop back-edges\n"
+           "  --opcodes <file>  write opcode counts as json to file\n"
+           "  --allocations <file>  write top allocation sites to file\n"
+           "  --census <file>   write a heap census to file on exit\n"
+           "  --timing <file>   write time spent per function to file\n"
+           "  --compile-stats   print compile times and byte code sizes per module on exit\n"
+           "  --precompile <threads>  compile imported modules on threads before running, skipped on one cpu\n"
            "  -v  print version information\n"
            "  -h  print this help message\n"
            "  --  end of options\n");
@@ -37,6 +50,13 @@ int main(int argc, char **argv) {
 
     char *file = NULL;
     char *code = NULL;
+    char *profile = NULL;
+    char *opcodes = NULL;
+    char *allocations = NULL;
+    char *census = NULL;
+    char *timing = NULL;
+    bool compile_stats = false;
+    int precompile = 0;
 
     if (argc >= 2) {
         for (int i = 1; i < argc; i++) {
@@ -59,6 +79,55 @@ int main(int argc, char **argv) {
                     help();
                     return EXIT_FAILURE;
                 }
+            } else if (hymn_string_equal(argv[i], "--profile")) {
+                if (i + 1 < argc) {
+                    profile = argv[i + 1];
+                    i++;
+                } else {
+                    help();
+                    return EXIT_FAILURE;
+                }
+            } else if (hymn_string_equal(argv[i], "--opcodes")) {
+                if (i + 1 < argc) {
+                    opcodes = argv[i + 1];
+                    i++;
+                } else {
+                    help();
+                    return EXIT_FAILURE;
+                }
+            } else if (hymn_string_equal(argv[i], "--allocations")) {
+                if (i + 1 < argc) {
+                    allocations = argv[i + 1];
+                    i++;
+                } else {
+                    help();
+                    return EXIT_FAILURE;
+                }
+            } else if (hymn_string_equal(argv[i], "--census")) {
+                if (i + 1 < argc) {
+                    census = argv[i + 1];
+                    i++;
+                } else {
+                    help();
+                    return EXIT_FAILURE;
+                }
+            } else if (hymn_string_equal(argv[i], "--timing")) {
+                if (i + 1 < argc) {
+                    timing = argv[i + 1];
+                    i++;
+                } else {
+                    help();
+                    return EXIT_FAILURE;
+                }
+            } else if (hymn_string_equal(argv[i], "--compile-stats")) {
+                compile_stats = true;
+            } else if (hymn_string_equal(argv[i], "--precompile")) {
+                if (i + 1 < argc && (precompile = atoi(argv[i + 1])) > 0) {
+                    i++;
+                } else {
+                    help();
+                    return EXIT_FAILURE;
+                }
             } else if (hymn_string_equal(argv[i], "-b")) {
                 byte = true;
             } else if (hymn_string_equal(argv[i], "-i")) {
@@ -76,11 +145,37 @@ int main(int argc, char **argv) {
 
     int exit = EXIT_SUCCESS;
 
+    running = hymn;
+
+    if (profile != NULL && !hymn_profile_start(hymn, HYMN_PROFILE_INTERVAL)) {
+        fprintf(stderr, "profiling not supported\n");
+        profile = NULL;
+    }
+
+    if (allocations != NULL) {
+        hymn_allocations_start(hymn);
+    }
+
+    if (census != NULL) {
+        hymn_census_track(hymn, true);
+    }
+
+    if (timing != NULL) {
+        hymn_timing_start(hymn);
+    }
+
+    if (compile_stats) {
+        hymn_compile_stats_track(hymn, true);
+    }
+
     if (file != NULL) {
         char *error;
         if (byte) {
             error = hymn_debug(hymn, file, NULL);
         } else {
+            if (precompile > 0) {
+                hymn_precompile(hymn, file, precompile);
+            }
             error = hymn_script(hymn, file);
         }
         if (error != NULL) {
@@ -106,6 +201,73 @@ int main(int argc, char **argv) {
         }
     }
 
+    running = NULL;
+
+    if (profile != NULL) {
+        hymn_profile_stop();
+        HymnString *folded = hymn_profile_folded(hymn);
+        FILE *open = hymn_open_file(profile, "w");
+        if (open == NULL) {
+            fprintf(stderr, "failed to write profile: %s\n", profile);
+            exit = EXIT_FAILURE;
+        } else {
+            fputs(folded, open);
+            fclose(open);
+        }
+        hymn_string_delete(folded);
+        hymn_profile_clear(hymn);
+    }
+
+    if (allocations != NULL) {
+        hymn_allocations_stop(hymn);
+        HymnString *report = hymn_allocations_report(hymn, HYMN_ALLOCATION_SITES);
+        FILE *open = hymn_open_file(allocations, "w");
+        if (open == NULL) {
+            fprintf(stderr, "failed to write allocations: %s\n", allocations);
+            exit = EXIT_FAILURE;
+        } else {
+            fputs(report, open);
+            fclose(open);
+        }
+        hymn_string_delete(report);
+        hymn_allocations_clear(hymn);
+    }
+
+    if (timing != NULL) {
+        hymn_timing_stop(hymn);
+        HymnString *report = hymn_timing_report(hymn);
+        FILE *open = hymn_open_file(timing, "w");
+        if (open == NULL) {
+            fprintf(stderr, "failed to write timing: %s\n", timing);
+            exit = EXIT_FAILURE;
+        } else {
+            fputs(report, open);
+            fclose(open);
+        }
+        hymn_string_delete(report);
+        hymn_timing_clear(hymn);
+    }
+
+    if (compile_stats) {
+        HymnString *report = hymn_compile_stats(hymn);
+        fputs(report, stderr);
+        hymn_string_delete(report);
+        hymn_compile_stats_track(hymn, false);
+    }
+
+    if (census != NULL) {
+        HymnString *report = hymn_census(hymn);
+        FILE *open = hymn_open_file(census, "w");
+        if (open == NULL) {
+            fprintf(stderr, "failed to write census: %s\n", census);
+            exit = EXIT_FAILURE;
+        } else {
+            fputs(report, open);
+            fclose(open);
+        }
+        hymn_string_delete(report);
+    }
+
 #ifdef HYMN_NO_REPL
     (void)mode;
     fprintf(stderr, "interactive mode not available\n");
@@ -117,6 +279,28 @@ int main(int argc, char **argv) {
 
     hymn_delete(hymn);
 
+#ifdef HYMN_OPCODE_COUNTS
+    HymnString *counts = hymn_opcode_counts(false);
+    fputs(counts, stderr);
+    hymn_string_delete(counts);
+    if (opcodes != NULL) {
+        counts = hymn_opcode_counts(true);
+        FILE *open = hymn_open_file(opcodes, "w");
+        if (open == NULL) {
+            fprintf(stderr, "failed to write opcode counts: %s\n", opcodes);
+            exit = EXIT_FAILURE;
+        } else {
+            fputs(counts, open);
+            fclose(open);
+        }
+        hymn_string_delete(counts);
+    }
+#else
+    if (opcodes != NULL) {
+        fprintf(stderr, "opcode counts not enabled, build with HYMN_OPCODE_COUNTS\n");
+    }
+#endif
+
     return exit;
 }
 
@@ -105,17 +105,16 @@ static HymnValue math_max(Hymn *H, int count, HymnValue *arguments) {
     return hymn_new_exception(H, "missing numbers");
 }
 
-#define MATH_FUNCTION(fun)                                          \
-    if (count >= 1) {                                               \
-        HymnValue value = arguments[0];                             \
-        if (hymn_is_int(value)) {                                   \
-            return hymn_new_float(fun((double)hymn_as_int(value))); \
-        } else if (hymn_is_float(value)) {                          \
-            return hymn_new_float(fun(hymn_as_float(value)));       \
-        }                                                           \
-        return hymn_new_exception(H, "argument must be a number");  \
-    }                                                               \
-    return hymn_new_exception(H, "missing number");
+#define MATH_FUNCTION(fun)                                      \
+    (void)H;                                                    \
+    (void)count;                                                \
+    HymnValue value = arguments[0];                             \
+    if (hymn_is_int(value)) {                                   \
+        return hymn_new_float(fun((double)hymn_as_int(value))); \
+    }                                                           \
+    return hymn_new_float(fun(hymn_as_float(value)));
+
+#define MATH_NUMBER(value) (hymn_is_int(value) ? (double)hymn_as_int(value) : hymn_as_float(value))
 
 static HymnValue math_floor(Hymn *H, int count, HymnValue *arguments) {
     MATH_FUNCTION(floor)
@@ -158,25 +157,9 @@ static HymnValue math_atan(Hymn *H, int count, HymnValue *arguments) {
 }
 
 static HymnValue math_atan2(Hymn *H, int count, HymnValue *arguments) {
-    if (count >= 2) {
-        HymnValue a = arguments[0];
-        HymnValue b = arguments[1];
-        if (hymn_is_int(a)) {
-            if (hymn_is_int(b)) {
-                hymn_new_float(atan2((double)hymn_as_int(a), (double)hymn_as_int(b)));
-            } else if (hymn_is_float(b)) {
-                hymn_new_float(atan2((double)hymn_as_int(a), hymn_as_float(b)));
-            }
-        } else if (hymn_is_float(a)) {
-            if (hymn_is_int(b)) {
-                hymn_new_float(atan2(hymn_as_float(a), (double)hymn_as_int(b)));
-            } else if (hymn_is_float(b)) {
-                hymn_new_float(atan2(hymn_as_float(a), hymn_as_float(b)));
-            }
-        }
-        return hymn_new_exception(H, "arguments must be numbers");
-    }
-    return hymn_new_exception(H, "missing numbers");
+    (void)H;
+    (void)count;
+    return hymn_new_float(atan2(MATH_NUMBER(arguments[0]), MATH_NUMBER(arguments[1])));
 }
 
 static HymnValue math_sqrt(Hymn *H, int count, HymnValue *arguments) {
@@ -184,25 +167,9 @@ static HymnValue math_sqrt(Hymn *H, int count, HymnValue *arguments) {
 }
 
 static HymnValue math_pow(Hymn *H, int count, HymnValue *arguments) {
-    if (count >= 2) {
-        HymnValue a = arguments[0];
-        HymnValue b = arguments[1];
-        if (hymn_is_int(a)) {
-            if (hymn_is_int(b)) {
-                hymn_new_float(pow((double)hymn_as_int(a), (double)hymn_as_int(b)));
-            } else if (hymn_is_float(b)) {
-                hymn_new_float(pow((double)hymn_as_int(a), hymn_as_float(b)));
-            }
-        } else if (hymn_is_float(a)) {
-            if (hymn_is_int(b)) {
-                hymn_new_float(pow(hymn_as_float(a), (double)hymn_as_int(b)));
-            } else if (hymn_is_float(b)) {
-                hymn_new_float(pow(hymn_as_float(a), hymn_as_float(b)));
-            }
-        }
-        return hymn_new_exception(H, "arguments must be numbers");
-    }
-    return hymn_new_exception(H, "missing numbers");
+    (void)H;
+    (void)count;
+    return hymn_new_float(pow(MATH_NUMBER(arguments[0]), MATH_NUMBER(arguments[1])));
 }
 
 static HymnValue math_log(Hymn *H, int count, HymnValue *arguments) {
@@ -222,22 +189,22 @@ void hymn_use_math(Hymn *H) {
     hymn_add_function_to_table(H, math, "abs", math_abs);
     hymn_add_function_to_table(H, math, "min", math_min);
     hymn_add_function_to_table(H, math, "max", math_max);
-    hymn_add_function_to_table(H, math, "floor", math_floor);
-    hymn_add_function_to_table(H, math, "ceil", math_ceil);
-    hymn_add_function_to_table(H, math, "sin", math_sin);
-    hymn_add_function_to_table(H, math, "cos", math_cos);
-    hymn_add_function_to_table(H, math, "tan", math_tan);
-    hymn_add_function_to_table(H, math, "asin", math_asin);
-    hymn_add_function_to_table(H, math, "acos", math_acos);
-    hymn_add_function_to_table(H, math, "sinh", math_sinh);
-    hymn_add_function_to_table(H, math, "cosh", math_cosh);
-    hymn_add_function_to_table(H, math, "atan", math_atan);
-    hymn_add_function_to_table(H, math, "atan2", math_atan2);
-    hymn_add_function_to_table(H, math, "sqrt", math_sqrt);
-    hymn_add_function_to_table(H, math, "pow", math_pow);
-    hymn_add_function_to_table(H, math, "log", math_log);
-    hymn_add_function_to_table(H, math, "log2", math_log2);
-    hymn_add_function_to_table(H, math, "log10", math_log10);
+    hymn_add_function_typed_to_table(H, math, "floor", math_floor, "n");
+    hymn_add_function_typed_to_table(H, math, "ceil", math_ceil, "n");
+    hymn_add_function_typed_to_table(H, math, "sin", math_sin, "n");
+    hymn_add_function_typed_to_table(H, math, "cos", math_cos, "n");
+    hymn_add_function_typed_to_table(H, math, "tan", math_tan, "n");
+    hymn_add_function_typed_to_table(H, math, "asin", math_asin, "n");
+    hymn_add_function_typed_to_table(H, math, "acos", math_acos, "n");
+    hymn_add_function_typed_to_table(H, math, "sinh", math_sinh, "n");
+    hymn_add_function_typed_to_table(H, math, "cosh", math_cosh, "n");
+    hymn_add_function_typed_to_table(H, math, "atan", math_atan, "n");
+    hymn_add_function_typed_to_table(H, math, "atan2", math_atan2, "nn");
+    hymn_add_function_typed_to_table(H, math, "sqrt", math_sqrt, "n");
+    hymn_add_function_typed_to_table(H, math, "pow", math_pow, "nn");
+    hymn_add_function_typed_to_table(H, math, "log", math_log, "n");
+    hymn_add_function_typed_to_table(H, math, "log2", math_log2, "n");
+    hymn_add_function_typed_to_table(H, math, "log10", math_log10, "n");
     hymn_add_table(H, "math", math);
 
     hymn_add(H, "PI", hymn_new_float(PI));
@@ -22,6 +22,30 @@
 #define PCLOSE pclose
 #endif
 
+#if defined(__unix__) || defined(__APPLE__)
+#define HYMN_SPAWN_SUPPORTED
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+typedef struct Job Job;
+
+struct Job {
+    pid_t pid;
+    int output;
+    int error;
+    int code;
+    HymnString *out;
+    HymnString *err;
+};
+#endif
+
 static HymnValue os_clock(Hymn *H, int count, HymnValue *arguments) {
     (void)H;
     (void)count;
@@ -102,6 +126,227 @@ static HymnValue os_exec(Hymn *H, int count, HymnValue *arguments) {
     return hymn_new_int(result);
 }
 
+#ifdef HYMN_SPAWN_SUPPORTED
+static bool job_pipe(int *ends) {
+    if (pipe(ends) != 0) {
+        return false;
+    }
+    fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ends[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+static void job_start(Job *job, const char *command) {
+    job->out = hymn_new_string("");
+    job->err = hymn_new_string("");
+    job->output = -1;
+    job->error = -1;
+    int out[2];
+    int err[2];
+    if (!job_pipe(out)) {
+        job->code = 127;
+        job->err = hymn_string_append(job->err, "pipe failed");
+        return;
+    }
+    if (!job_pipe(err)) {
+        close(out[0]);
+        close(out[1]);
+        job->code = 127;
+        job->err = hymn_string_append(job->err, "pipe failed");
+        return;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    char *arguments[] = {"sh", "-c", (char *)command, NULL};
+    int result = posix_spawn(&job->pid, "/bin/sh", &actions, &attributes, arguments, environ);
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    close(out[1]);
+    close(err[1]);
+    if (result != 0) {
+        close(out[0]);
+        close(err[0]);
+        job->pid = 0;
+        job->code = 127;
+        job->err = hymn_string_append(job->err, strerror(result));
+        return;
+    }
+    job->output = out[0];
+    job->error = err[0];
+}
+
+static bool job_read(int *fd, HymnString **buffer) {
+    char chunk[4096];
+    ssize_t size = read(*fd, chunk, sizeof(chunk));
+    if (size > 0) {
+        *buffer = hymn_string_append_substring(*buffer, chunk, 0, (size_t)size);
+        return true;
+    } else if (size < 0 && errno == EINTR) {
+        return true;
+    }
+    close(*fd);
+    *fd = -1;
+    return false;
+}
+
+static void job_finish(Job *job) {
+    int status;
+    while (waitpid(job->pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            job->code = 127;
+            return;
+        }
+    }
+    if (WIFEXITED(status)) {
+        job->code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        job->code = 128 + WTERMSIG(status);
+    }
+}
+
+static void job_kill(Job *job) {
+    kill(-job->pid, SIGKILL);
+    if (job->output != -1) {
+        close(job->output);
+        job->output = -1;
+    }
+    if (job->error != -1) {
+        close(job->error);
+        job->error = -1;
+    }
+    job_finish(job);
+}
+
+static HymnValue os_spawn_all(Hymn *H, int count, HymnValue *arguments) {
+    if (count < 1) {
+        return hymn_new_exception(H, "missing commands");
+    } else if (!hymn_is_array(arguments[0])) {
+        return hymn_type_exception(H, HYMN_VALUE_ARRAY, arguments[0].is);
+    }
+    HymnArray *commands = hymn_as_array(arguments[0]);
+    HymnInt size = commands->length;
+    for (HymnInt i = 0; i < size; i++) {
+        if (!hymn_is_string(commands->items[i])) {
+            return hymn_new_exception(H, "commands must be strings");
+        }
+    }
+    HymnInt concurrency = (HymnInt)sysconf(_SC_NPROCESSORS_ONLN);
+    if (count >= 2) {
+        if (!hymn_is_int(arguments[1])) {
+            return hymn_new_exception(H, "concurrency must be an integer");
+        }
+        concurrency = hymn_as_int(arguments[1]);
+    }
+    if (concurrency < 1) {
+        concurrency = 1;
+    } else if (concurrency > size) {
+        concurrency = size;
+    }
+
+    Job *jobs = hymn_calloc_int((int)size, sizeof(Job));
+    Job **running = hymn_calloc_int((int)concurrency, sizeof(Job *));
+    struct pollfd *polls = hymn_calloc_int((int)concurrency * 2, sizeof(struct pollfd));
+
+    HymnInt next = 0;
+    HymnInt active = 0;
+    int failure = 0;
+    while (next < size || active > 0) {
+        while (next < size && active < concurrency) {
+            Job *job = &jobs[next];
+            job_start(job, hymn_as_string(commands->items[next]));
+            next++;
+            if (job->output != -1) {
+                running[active++] = job;
+            }
+        }
+        if (active == 0) {
+            continue;
+        }
+        for (HymnInt i = 0; i < active; i++) {
+            polls[i * 2].fd = running[i]->output;
+            polls[i * 2].events = POLLIN;
+            polls[i * 2].revents = 0;
+            polls[i * 2 + 1].fd = running[i]->error;
+            polls[i * 2 + 1].events = POLLIN;
+            polls[i * 2 + 1].revents = 0;
+        }
+        if (poll(polls, (nfds_t)(active * 2), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failure = errno;
+            break;
+        }
+        for (HymnInt i = 0; i < active; i++) {
+            Job *job = running[i];
+            if (polls[i * 2].revents != 0) {
+                job_read(&job->output, &job->out);
+            }
+            if (polls[i * 2 + 1].revents != 0) {
+                job_read(&job->error, &job->err);
+            }
+        }
+        HymnInt kept = 0;
+        for (HymnInt i = 0; i < active; i++) {
+            Job *job = running[i];
+            if (job->output == -1 && job->error == -1) {
+                job_finish(job);
+            } else {
+                running[kept++] = job;
+            }
+        }
+        active = kept;
+    }
+
+    if (failure != 0) {
+        for (HymnInt i = 0; i < active; i++) {
+            job_kill(running[i]);
+        }
+        for (HymnInt i = 0; i < next; i++) {
+            hymn_string_delete(jobs[i].out);
+            hymn_string_delete(jobs[i].err);
+        }
+        hymn_free(jobs);
+        hymn_free(running);
+        hymn_free(polls);
+        HymnString *message = hymn_string_format("poll failed: %s", strerror(failure));
+        HymnValue exception = hymn_new_exception(H, message);
+        hymn_string_delete(message);
+        return exception;
+    }
+
+    HymnArray *results = hymn_new_array(0);
+    for (HymnInt i = 0; i < size; i++) {
+        Job *job = &jobs[i];
+        HymnTable *table = hymn_new_table();
+        hymn_set_property_const(H, table, "code", hymn_new_int(job->code));
+        hymn_set_property_const(H, table, "stdout", hymn_new_string_value(hymn_intern_string(H, job->out)));
+        hymn_set_property_const(H, table, "stderr", hymn_new_string_value(hymn_intern_string(H, job->err)));
+        HymnValue value = hymn_new_table_value(table);
+        hymn_reference(value);
+        hymn_array_push(results, value);
+    }
+
+    hymn_free(jobs);
+    hymn_free(running);
+    hymn_free(polls);
+
+    return hymn_new_array_value(results);
+}
+#else
+static HymnValue os_spawn_all(Hymn *H, int count, HymnValue *arguments) {
+    (void)count;
+    (void)arguments;
+    return hymn_new_exception(H, "spawn not supported");
+}
+#endif
+
 static HymnValue os_popen(Hymn *H, int count, HymnValue *arguments) {
 #ifdef HYMN_POPEN_SUPPORTED
     if (count < 2) {
@@ -213,6 +458,7 @@ void hymn_use_os(Hymn *H) {
     hymn_add_function_to_table(H, os, "fclose", os_fclose);
     hymn_add_function_to_table(H, os, "fget", os_fget);
     hymn_add_function_to_table(H, os, "exec", os_exec);
+    hymn_add_function_to_table(H, os, "spawn-all", os_spawn_all);
     hymn_add_table(H, "os", os);
 
     hymn_add_function(H, "system", os_system);
@@ -78,7 +78,7 @@ void hymn_delete_file_list(struct HymnPathFileList *list) {
     for (int i = 0; i < list->count; i++) {
         hymn_string_delete(list->files[i]);
     }
-    free(list->files);
+    hymn_free(list->files);
 }
 
 #define PATH_FUNCTION(fun)                                     \
@@ -152,7 +152,7 @@ static HymnValue walk(Hymn *H, int count, HymnValue *arguments, bool recursive)
         hymn_reference_string(item);
         array->items[i] = hymn_new_string_value(item);
     }
-    free(list.files);
+    hymn_free(list.files);
     if (count == 0) {
         hymn_string_delete(path);
     }
@@ -0,0 +1,544 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#ifdef __GNUC__
+#define _GNU_SOURCE
+#endif
+
+#include "hymn_profile.h"
+
+#define PROFILE_BINS 1024
+#define PROFILE_STACK 4096
+
+typedef struct Sample Sample;
+
+struct Sample {
+    char *stack;
+    unsigned int hash;
+    char padding[4];
+    int64_t count;
+    Sample *next;
+};
+
+#define ALLOCATION_BINS 1024
+
+typedef struct Site Site;
+
+struct Site {
+    HymnFunction *func;
+    char *name;
+    char *script;
+    const char *kind;
+    int row;
+    unsigned int hash;
+    int64_t count;
+    int64_t bytes;
+    Site *next;
+};
+
+#define TIMING_BINS 256
+#define TIMING_DEPTH 4096
+
+typedef struct Timing Timing;
+typedef struct TimingFrame TimingFrame;
+
+struct Timing {
+    HymnFunction *func;
+    char *name;
+    char *script;
+    int64_t calls;
+    int64_t total;
+    int64_t self;
+    int active;
+    char padding[4];
+    Timing *next;
+};
+
+struct TimingFrame {
+    Timing *timing;
+    int64_t start;
+    int64_t children;
+};
+
+typedef struct Profile Profile;
+
+struct Profile {
+    Sample *samples[PROFILE_BINS];
+    Site *sites[ALLOCATION_BINS];
+    Timing *timings[TIMING_BINS];
+    TimingFrame stack[TIMING_DEPTH];
+    int depth;
+    char padding[4];
+};
+
+static void samples_clear(Profile *profile) {
+    for (int i = 0; i < PROFILE_BINS; i++) {
+        Sample *sample = profile->samples[i];
+        while (sample != NULL) {
+            Sample *next = sample->next;
+            free(sample->stack);
+            free(sample);
+            sample = next;
+        }
+        profile->samples[i] = NULL;
+    }
+}
+
+static void sites_clear(Profile *profile) {
+    for (int i = 0; i < ALLOCATION_BINS; i++) {
+        Site *site = profile->sites[i];
+        while (site != NULL) {
+            Site *next = site->next;
+            free(site->name);
+            free(site->script);
+            free(site);
+            site = next;
+        }
+        profile->sites[i] = NULL;
+    }
+}
+
+static void timings_clear(Profile *profile) {
+    for (int i = 0; i < TIMING_BINS; i++) {
+        Timing *timing = profile->timings[i];
+        while (timing != NULL) {
+            Timing *next = timing->next;
+            free(timing->name);
+            free(timing->script);
+            free(timing);
+            timing = next;
+        }
+        profile->timings[i] = NULL;
+    }
+    profile->depth = 0;
+}
+
+static void profile_finalize(Hymn *H, void *user) {
+    (void)H;
+    Profile *profile = (Profile *)user;
+    samples_clear(profile);
+    sites_clear(profile);
+    timings_clear(profile);
+    free(profile);
+}
+
+static Profile *profile_get(Hymn *H) {
+    Profile *profile = hymn_finalizer_user(H, profile_finalize);
+    if (profile == NULL) {
+        profile = calloc(1, sizeof(Profile));
+        if (profile == NULL) {
+            fprintf(stderr, "calloc failed.\n");
+            exit(1);
+        }
+        hymn_add_finalizer(H, profile_finalize, profile);
+    }
+    return profile;
+}
+
+static unsigned int profile_hash(const char *stack) {
+    unsigned int hash = 2166136261u;
+    for (const char *c = stack; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return hash;
+}
+
+static void profile_record(Profile *profile, const char *stack) {
+    unsigned int hash = profile_hash(stack);
+    unsigned int bin = hash & (PROFILE_BINS - 1);
+    for (Sample *sample = profile->samples[bin]; sample != NULL; sample = sample->next) {
+        if (sample->hash == hash && strcmp(sample->stack, stack) == 0) {
+            sample->count++;
+            return;
+        }
+    }
+    size_t size = strlen(stack) + 1;
+    Sample *sample = malloc(sizeof(Sample));
+    char *copy = malloc(size);
+    if (sample == NULL || copy == NULL) {
+        free(sample);
+        free(copy);
+        return;
+    }
+    memcpy(copy, stack, size);
+    sample->stack = copy;
+    sample->hash = hash;
+    sample->count = 1;
+    sample->next = profile->samples[bin];
+    profile->samples[bin] = sample;
+}
+
+static void profile_sample(Hymn *H) {
+    char stack[PROFILE_STACK];
+    size_t length = 0;
+    for (int i = 0; i < H->frame_count; i++) {
+        HymnFrame *frame = &H->frames[i];
+        HymnFunction *func = frame->func;
+        const char *name = func->name != NULL ? func->name : func->script != NULL ? func->script : "script";
+        int wrote = snprintf(stack + length, PROFILE_STACK - length, "%s%s:%d", i == 0 ? "" : ";", name, hymn_frame_row(frame));
+        if (wrote < 0 || (size_t)wrote >= PROFILE_STACK - length) {
+            break;
+        }
+        length += (size_t)wrote;
+    }
+    Profile *profile = hymn_finalizer_user(H, profile_finalize);
+    if (length > 0 && profile != NULL) {
+        profile_record(profile, stack);
+    }
+}
+
+static char *profile_copy(const char *string) {
+    size_t size = strlen(string) + 1;
+    char *copy = malloc(size);
+    if (copy != NULL) {
+        memcpy(copy, string, size);
+    }
+    return copy;
+}
+
+static void allocation_record(Hymn *H, size_t size, const char *kind) {
+    Profile *profile = hymn_finalizer_user(H, profile_finalize);
+    if (H->frame_count == 0 || profile == NULL) {
+        return;
+    }
+    HymnFrame *frame = &H->frames[H->frame_count - 1];
+    HymnFunction *func = frame->func;
+    int row = hymn_frame_row(frame);
+    if (kind == NULL) {
+        kind = "other";
+    }
+    const char *name = func->name != NULL ? func->name : "script";
+    unsigned int hash = (unsigned int)((uintptr_t)func >> 4) ^ ((unsigned int)row * 16777619u) ^ (unsigned int)((uintptr_t)kind >> 2);
+    unsigned int bin = hash & (ALLOCATION_BINS - 1);
+    for (Site *site = profile->sites[bin]; site != NULL; site = site->next) {
+        if (site->hash == hash && site->func == func && site->row == row && site->kind == kind && strcmp(site->name, name) == 0) {
+            site->count++;
+            site->bytes += (int64_t)size;
+            return;
+        }
+    }
+    Site *site = malloc(sizeof(Site));
+    if (site == NULL) {
+        return;
+    }
+    site->name = profile_copy(name);
+    site->script = profile_copy(func->script != NULL ? func->script : "");
+    if (site->name == NULL || site->script == NULL) {
+        free(site->name);
+        free(site->script);
+        free(site);
+        return;
+    }
+    site->func = func;
+    site->kind = kind;
+    site->row = row;
+    site->hash = hash;
+    site->count = 1;
+    site->bytes = (int64_t)size;
+    site->next = profile->sites[bin];
+    profile->sites[bin] = site;
+}
+
+static int site_compare_bytes(const void *a, const void *b) {
+    const Site *x = *(Site *const *)a;
+    const Site *y = *(Site *const *)b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+static int site_compare_count(const void *a, const void *b) {
+    const Site *x = *(Site *const *)a;
+    const Site *y = *(Site *const *)b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+static HymnString *allocation_table(HymnString *out, const char *title, Site **sorted, size_t count, size_t top) {
+    HymnString *line = hymn_string_format("%s\n%14s %10s  %-10s %s\n", title, "BYTES", "COUNT", "KIND", "SITE");
+    out = hymn_string_append(out, line);
+    hymn_string_delete(line);
+    for (size_t i = 0; i < count && i < top; i++) {
+        Site *site = sorted[i];
+        line = hymn_string_format("%14" PRId64 " %10" PRId64 "  %-10s %s:%d %s\n", site->bytes, site->count, site->kind, site->script, site->row, site->name);
+        out = hymn_string_append(out, line);
+        hymn_string_delete(line);
+    }
+    return out;
+}
+
+HymnString *hymn_allocations_report(Hymn *H, int top) {
+    Profile *profile = profile_get(H);
+    size_t count = 0;
+    for (int i = 0; i < ALLOCATION_BINS; i++) {
+        for (Site *site = profile->sites[i]; site != NULL; site = site->next) {
+            count++;
+        }
+    }
+    HymnString *out = hymn_new_string("");
+    if (count == 0) {
+        return out;
+    }
+    Site **sorted = malloc(count * sizeof(Site *));
+    if (sorted == NULL) {
+        return out;
+    }
+    size_t index = 0;
+    for (int i = 0; i < ALLOCATION_BINS; i++) {
+        for (Site *site = profile->sites[i]; site != NULL; site = site->next) {
+            sorted[index++] = site;
+        }
+    }
+    size_t limit = top > 0 ? (size_t)top : count;
+    qsort(sorted, count, sizeof(Site *), site_compare_bytes);
+    out = allocation_table(out, "allocation sites by bytes", sorted, count, limit);
+    out = hymn_string_append(out, "\n");
+    qsort(sorted, count, sizeof(Site *), site_compare_count);
+    out = allocation_table(out, "allocation sites by count", sorted, count, limit);
+    free(sorted);
+    return out;
+}
+
+void hymn_allocations_clear(Hymn *H) {
+    sites_clear(profile_get(H));
+}
+
+void hymn_allocations_start(Hymn *H) {
+    profile_get(H);
+    H->allocated = allocation_record;
+}
+
+void hymn_allocations_stop(Hymn *H) {
+    H->allocated = NULL;
+}
+
+static int64_t timing_now(void) {
+    struct timespec time;
+#if defined(__unix__) || defined(__APPLE__)
+    clock_gettime(CLOCK_MONOTONIC, &time);
+#else
+    timespec_get(&time, TIME_UTC);
+#endif
+    return (int64_t)time.tv_sec * 1000000000 + (int64_t)time.tv_nsec;
+}
+
+static Timing *timing_get(Profile *profile, HymnFunction *func) {
+    const char *name = func->name != NULL ? func->name : "script";
+    unsigned int bin = (unsigned int)((uintptr_t)func >> 4) & (TIMING_BINS - 1);
+    for (Timing *timing = profile->timings[bin]; timing != NULL; timing = timing->next) {
+        if (timing->func == func && strcmp(timing->name, name) == 0) {
+            return timing;
+        }
+    }
+    Timing *timing = calloc(1, sizeof(Timing));
+    if (timing == NULL) {
+        return NULL;
+    }
+    timing->name = profile_copy(name);
+    timing->script = profile_copy(func->script != NULL ? func->script : "");
+    if (timing->name == NULL || timing->script == NULL) {
+        free(timing->name);
+        free(timing->script);
+        free(timing);
+        return NULL;
+    }
+    timing->func = func;
+    timing->next = profile->timings[bin];
+    profile->timings[bin] = timing;
+    return timing;
+}
+
+static void timing_trace(Hymn *H, enum HymnTrace event, HymnFunction *func, int line, void *user) {
+    (void)H;
+    (void)line;
+    Profile *profile = (Profile *)user;
+    int64_t now = timing_now();
+    if (event == HYMN_TRACE_CALL) {
+        if (profile->depth == TIMING_DEPTH) {
+            return;
+        }
+        Timing *timing = timing_get(profile, func);
+        TimingFrame *frame = &profile->stack[profile->depth++];
+        frame->timing = timing;
+        frame->start = now;
+        frame->children = 0;
+        if (timing != NULL) {
+            timing->calls++;
+            timing->active++;
+        }
+    } else if (event == HYMN_TRACE_RETURN) {
+        if (profile->depth == 0) {
+            return;
+        }
+        TimingFrame *frame = &profile->stack[--profile->depth];
+        int64_t elapsed = now - frame->start;
+        Timing *timing = frame->timing;
+        if (timing != NULL) {
+            timing->self += elapsed - frame->children;
+            if (--timing->active == 0) {
+                timing->total += elapsed;
+            }
+        }
+        if (profile->depth > 0) {
+            profile->stack[profile->depth - 1].children += elapsed;
+        }
+    }
+}
+
+static int timing_compare(const void *a, const void *b) {
+    const Timing *x = *(Timing *const *)a;
+    const Timing *y = *(Timing *const *)b;
+    return (x->self < y->self) - (x->self > y->self);
+}
+
+HymnString *hymn_timing_report(Hymn *H) {
+    Profile *profile = profile_get(H);
+    size_t count = 0;
+    for (int i = 0; i < TIMING_BINS; i++) {
+        for (Timing *timing = profile->timings[i]; timing != NULL; timing = timing->next) {
+            count++;
+        }
+    }
+    HymnString *out = hymn_string_format("%-32s %10s %12s %12s %12s\n", "FUNCTION", "CALLS", "TOTAL MS", "SELF MS", "MEAN US");
+    if (count == 0) {
+        return out;
+    }
+    Timing **sorted = malloc(count * sizeof(Timing *));
+    if (sorted == NULL) {
+        return out;
+    }
+    size_t index = 0;
+    for (int i = 0; i < TIMING_BINS; i++) {
+        for (Timing *timing = profile->timings[i]; timing != NULL; timing = timing->next) {
+            sorted[index++] = timing;
+        }
+    }
+    qsort(sorted, count, sizeof(Timing *), timing_compare);
+    for (size_t i = 0; i < count; i++) {
+        Timing *timing = sorted[i];
+        HymnString *name = hymn_string_format("%s %s", timing->name, timing->script);
+        double mean = timing->calls > 0 ? (double)timing->total / (double)timing->calls / 1000.0 : 0.0;
+        HymnString *line = hymn_string_format("%-32s %10" PRId64 " %12.3f %12.3f %12.3f\n", name, timing->calls, (double)timing->total / 1e6, (double)timing->self / 1e6, mean);
+        out = hymn_string_append(out, line);
+        hymn_string_delete(line);
+        hymn_string_delete(name);
+    }
+    free(sorted);
+    return out;
+}
+
+void hymn_timing_clear(Hymn *H) {
+    timings_clear(profile_get(H));
+}
+
+void hymn_timing_start(Hymn *H) {
+    hymn_set_tracer(H, timing_trace, HYMN_TRACE_CALL | HYMN_TRACE_RETURN, profile_get(H));
+}
+
+void hymn_timing_stop(Hymn *H) {
+    hymn_set_tracer(H, NULL, 0, NULL);
+}
+
+static int sample_compare(const void *a, const void *b) {
+    return strcmp((*(Sample *const *)a)->stack, (*(Sample *const *)b)->stack);
+}
+
+HymnString *hymn_profile_folded(Hymn *H) {
+    Profile *profile = profile_get(H);
+    size_t count = 0;
+    for (int i = 0; i < PROFILE_BINS; i++) {
+        for (Sample *sample = profile->samples[i]; sample != NULL; sample = sample->next) {
+            count++;
+        }
+    }
+    HymnString *out = hymn_new_string("");
+    if (count == 0) {
+        return out;
+    }
+    Sample **sorted = malloc(count * sizeof(Sample *));
+    if (sorted == NULL) {
+        return out;
+    }
+    size_t index = 0;
+    for (int i = 0; i < PROFILE_BINS; i++) {
+        for (Sample *sample = profile->samples[i]; sample != NULL; sample = sample->next) {
+            sorted[index++] = sample;
+        }
+    }
+    qsort(sorted, count, sizeof(Sample *), sample_compare);
+    for (size_t i = 0; i < count; i++) {
+        HymnString *line = hymn_string_format("%s %" PRId64 "\n", sorted[i]->stack, sorted[i]->count);
+        out = hymn_string_append(out, line);
+        hymn_string_delete(line);
+    }
+    free(sorted);
+    return out;
+}
+
+void hymn_profile_clear(Hymn *H) {
+    samples_clear(profile_get(H));
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <sys/time.h>
+
+// SIGPROF and ITIMER_PROF are process wide, so only one interpreter is
+// sampled at a time. Everything it records lives in its own Profile.
+static Hymn *profiled = NULL;
+
+static void profile_signal(int signum) {
+    (void)signum;
+    Hymn *H = profiled;
+    if (H != NULL) {
+        H->sample = 1;
+        H->interrupt = 1;
+    }
+}
+
+bool hymn_profile_start(Hymn *H, int interval) {
+    if (profiled != NULL) {
+        return false;
+    }
+    if (interval <= 0) {
+        interval = HYMN_PROFILE_INTERVAL;
+    }
+    profile_get(H);
+    profiled = H;
+    H->sampler = profile_sample;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = profile_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+    return true;
+}
+
+void hymn_profile_stop(void) {
+    if (profiled == NULL) {
+        return;
+    }
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    signal(SIGPROF, SIG_IGN);
+    profiled->sampler = NULL;
+    profiled->sample = 0;
+    profiled = NULL;
+}
+
+#else
+
+bool hymn_profile_start(Hymn *H, int interval) {
+    (void)H;
+    (void)interval;
+    return false;
+}
+
+void hymn_profile_stop(void) {}
+
+#endif
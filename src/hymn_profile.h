@@ -0,0 +1,28 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#ifndef HYMN_PROFILE_H
+#define HYMN_PROFILE_H
+
+#include "hymn.h"
+
+#define HYMN_PROFILE_INTERVAL 1000
+#define HYMN_ALLOCATION_SITES 20
+
+bool hymn_profile_start(Hymn *H, int interval);
+void hymn_profile_stop(void);
+void hymn_profile_clear(Hymn *H);
+HymnString *hymn_profile_folded(Hymn *H);
+
+void hymn_allocations_start(Hymn *H);
+void hymn_allocations_stop(Hymn *H);
+void hymn_allocations_clear(Hymn *H);
+HymnString *hymn_allocations_report(Hymn *H, int top);
+
+void hymn_timing_start(Hymn *H);
+void hymn_timing_stop(Hymn *H);
+void hymn_timing_clear(Hymn *H);
+HymnString *hymn_timing_report(Hymn *H);
+
+#endif
@@ -0,0 +1,98 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/* Generated by superinstructions.js from superinstructions.txt. Do not edit. */
+
+#ifndef HYMN_SUPER_H
+#define HYMN_SUPER_H
+
+#define HYMN_SUPER_MAX 3
+#define HYMN_SUPER_COUNT 7
+
+#define HYMN_SUPER_OPCODES          \
+    OP_GET_LOCAL_CONSTANT_ADD,      \
+    OP_GET_LOCAL_CONSTANT_SUBTRACT, \
+    OP_GET_LOCAL_CONSTANT_EQUAL,    \
+    OP_GET_LOCAL_GET_PROPERTY,      \
+    OP_GET_LOCAL_CONSTANT,          \
+    OP_GET_GLOBAL_GET_LOCAL,        \
+    OP_SET_LOCAL_POP,
+
+#define HYMN_SUPER_NEXT                            \
+    case OP_GET_LOCAL_CONSTANT_ADD: return 3;      \
+    case OP_GET_LOCAL_CONSTANT_SUBTRACT: return 3; \
+    case OP_GET_LOCAL_CONSTANT_EQUAL: return 3;    \
+    case OP_GET_LOCAL_GET_PROPERTY: return 3;      \
+    case OP_GET_LOCAL_CONSTANT: return 3;          \
+    case OP_GET_GLOBAL_GET_LOCAL: return 3;        \
+    case OP_SET_LOCAL_POP: return 2;
+
+#define HYMN_SUPER_NAMES                                                          \
+    case OP_GET_LOCAL_CONSTANT_ADD: return "OP_GET_LOCAL_CONSTANT_ADD";           \
+    case OP_GET_LOCAL_CONSTANT_SUBTRACT: return "OP_GET_LOCAL_CONSTANT_SUBTRACT"; \
+    case OP_GET_LOCAL_CONSTANT_EQUAL: return "OP_GET_LOCAL_CONSTANT_EQUAL";       \
+    case OP_GET_LOCAL_GET_PROPERTY: return "OP_GET_LOCAL_GET_PROPERTY";           \
+    case OP_GET_LOCAL_CONSTANT: return "OP_GET_LOCAL_CONSTANT";                   \
+    case OP_GET_GLOBAL_GET_LOCAL: return "OP_GET_GLOBAL_GET_LOCAL";               \
+    case OP_SET_LOCAL_POP: return "OP_SET_LOCAL_POP";
+
+#define HYMN_SUPER_DISASSEMBLE                                                                        \
+    case OP_GET_LOCAL_CONSTANT_ADD: return debug_super_instruction(debug, name, 3, code, index);      \
+    case OP_GET_LOCAL_CONSTANT_SUBTRACT: return debug_super_instruction(debug, name, 3, code, index); \
+    case OP_GET_LOCAL_CONSTANT_EQUAL: return debug_super_instruction(debug, name, 3, code, index);    \
+    case OP_GET_LOCAL_GET_PROPERTY: return debug_super_instruction(debug, name, 3, code, index);      \
+    case OP_GET_LOCAL_CONSTANT: return debug_super_instruction(debug, name, 3, code, index);          \
+    case OP_GET_GLOBAL_GET_LOCAL: return debug_super_instruction(debug, name, 3, code, index);        \
+    case OP_SET_LOCAL_POP: return debug_super_instruction(debug, name, 2, code, index);
+
+#define HYMN_SUPER_PATTERNS                                                        \
+    {OP_GET_LOCAL_CONSTANT_ADD, 3, {OP_GET_LOCAL, OP_CONSTANT, OP_ADD}},           \
+    {OP_GET_LOCAL_CONSTANT_SUBTRACT, 3, {OP_GET_LOCAL, OP_CONSTANT, OP_SUBTRACT}}, \
+    {OP_GET_LOCAL_CONSTANT_EQUAL, 3, {OP_GET_LOCAL, OP_CONSTANT, OP_EQUAL}},       \
+    {OP_GET_LOCAL_GET_PROPERTY, 2, {OP_GET_LOCAL, OP_GET_PROPERTY, 0}},            \
+    {OP_GET_LOCAL_CONSTANT, 2, {OP_GET_LOCAL, OP_CONSTANT, 0}},                    \
+    {OP_GET_GLOBAL_GET_LOCAL, 2, {OP_GET_GLOBAL, OP_GET_LOCAL, 0}},                \
+    {OP_SET_LOCAL_POP, 2, {OP_SET_LOCAL, OP_POP, 0}},
+
+#define HYMN_SUPER_RUN                     \
+    case OP_GET_LOCAL_CONSTANT_ADD: {      \
+        { GET_LOCAL_OP() }                 \
+        { CONSTANT_OP() }                  \
+        { ADD_OP() }                       \
+        goto dispatch;                     \
+    }                                      \
+    case OP_GET_LOCAL_CONSTANT_SUBTRACT: { \
+        { GET_LOCAL_OP() }                 \
+        { CONSTANT_OP() }                  \
+        { SUBTRACT_OP() }                  \
+        goto dispatch;                     \
+    }                                      \
+    case OP_GET_LOCAL_CONSTANT_EQUAL: {    \
+        { GET_LOCAL_OP() }                 \
+        { CONSTANT_OP() }                  \
+        { EQUAL_OP() }                     \
+        goto dispatch;                     \
+    }                                      \
+    case OP_GET_LOCAL_GET_PROPERTY: {      \
+        { GET_LOCAL_OP() }                 \
+        { GET_PROPERTY_OP() }              \
+        goto dispatch;                     \
+    }                                      \
+    case OP_GET_LOCAL_CONSTANT: {          \
+        { GET_LOCAL_OP() }                 \
+        { CONSTANT_OP() }                  \
+        goto dispatch;                     \
+    }                                      \
+    case OP_GET_GLOBAL_GET_LOCAL: {        \
+        { GET_GLOBAL_OP() }                \
+        { GET_LOCAL_OP() }                 \
+        goto dispatch;                     \
+    }                                      \
+    case OP_SET_LOCAL_POP: {               \
+        { SET_LOCAL_OP() }                 \
+        { POP_OP() }                       \
+        goto dispatch;                     \
+    }
+
+#endif
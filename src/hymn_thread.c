@@ -0,0 +1,760 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#ifdef __GNUC__
+#define _GNU_SOURCE
+#endif
+
+#include "hymn_thread.h"
+#include "hymn_libs.h"
+
+#ifdef _MSC_VER
+
+static HymnValue thread_unsupported(Hymn *H, int count, HymnValue *arguments) {
+    (void)count;
+    (void)arguments;
+    return hymn_new_exception(H, "threads not supported");
+}
+
+void hymn_use_thread(Hymn *H) {
+    HymnTable *thread = hymn_new_table();
+    hymn_add_function_to_table(H, thread, "spawn", thread_unsupported);
+    hymn_add_function_to_table(H, thread, "send", thread_unsupported);
+    hymn_add_function_to_table(H, thread, "receive", thread_unsupported);
+    hymn_add_function_to_table(H, thread, "join", thread_unsupported);
+    hymn_add_function_to_table(H, thread, "map", thread_unsupported);
+    hymn_add_function_to_table(H, thread, "each", thread_unsupported);
+    hymn_add_function_to_table(H, thread, "cores", thread_unsupported);
+    hymn_add_table(H, "thread", thread);
+}
+
+#else
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct Message Message;
+typedef struct Channel Channel;
+typedef struct Worker Worker;
+typedef struct Handle Handle;
+typedef struct Handles Handles;
+typedef struct Limits Limits;
+
+struct Message {
+    HymnString *data;
+    Message *next;
+};
+
+struct Channel {
+    pthread_mutex_t lock;
+    pthread_cond_t signal;
+    Message *head;
+    Message *tail;
+    bool closed;
+    char padding[7];
+};
+
+struct Limits {
+    HymnAllocator allocator;
+    size_t memory_limit;
+    int64_t budget;
+    int frame_limit;
+    char padding[4];
+};
+
+struct Worker {
+    pthread_t thread;
+    Limits limits;
+    pthread_mutex_t lock;
+    Hymn *parent;
+    Hymn *child;
+    Channel inbox;
+    Channel outbox;
+    HymnString *function;
+    HymnString *arguments;
+    HymnString *result;
+    char *error;
+};
+
+struct Handle {
+    Worker *worker;
+    Handle *next;
+    bool owner;
+    char padding[7];
+};
+
+struct Handles {
+    Handle *head;
+};
+
+static void channel_init(Channel *channel) {
+    pthread_mutex_init(&channel->lock, NULL);
+    pthread_cond_init(&channel->signal, NULL);
+    channel->head = NULL;
+    channel->tail = NULL;
+    channel->closed = false;
+}
+
+static void channel_send(Channel *channel, HymnString *data) {
+    Message *message = malloc(sizeof(Message));
+    if (message == NULL) {
+        fprintf(stderr, "malloc failed.\n");
+        exit(1);
+    }
+    message->data = data;
+    message->next = NULL;
+    pthread_mutex_lock(&channel->lock);
+    if (channel->tail == NULL) {
+        channel->head = message;
+    } else {
+        channel->tail->next = message;
+    }
+    channel->tail = message;
+    pthread_cond_signal(&channel->signal);
+    pthread_mutex_unlock(&channel->lock);
+}
+
+static HymnString *channel_receive(Channel *channel) {
+    pthread_mutex_lock(&channel->lock);
+    while (channel->head == NULL && !channel->closed) {
+        pthread_cond_wait(&channel->signal, &channel->lock);
+    }
+    Message *message = channel->head;
+    HymnString *data = NULL;
+    if (message != NULL) {
+        channel->head = message->next;
+        if (channel->head == NULL) {
+            channel->tail = NULL;
+        }
+        data = message->data;
+        free(message);
+    }
+    pthread_mutex_unlock(&channel->lock);
+    return data;
+}
+
+static void channel_close(Channel *channel) {
+    pthread_mutex_lock(&channel->lock);
+    channel->closed = true;
+    pthread_cond_broadcast(&channel->signal);
+    pthread_mutex_unlock(&channel->lock);
+}
+
+static void serial_release(Hymn *H, HymnString *data) {
+    if (data != NULL) {
+        HymnValue value = hymn_deserialize(H, data);
+        hymn_reference(value);
+        hymn_dereference(H, value);
+        hymn_string_delete(data);
+    }
+}
+
+static void channel_delete(Hymn *H, Channel *channel) {
+    Message *message = channel->head;
+    while (message != NULL) {
+        Message *next = message->next;
+        serial_release(H, message->data);
+        free(message);
+        message = next;
+    }
+    pthread_cond_destroy(&channel->signal);
+    pthread_mutex_destroy(&channel->lock);
+}
+
+static char *error_chars(const char *error) {
+    size_t len = strlen(error);
+    char *chars = malloc(len + 1);
+    if (chars == NULL) {
+        fprintf(stderr, "malloc failed.\n");
+        exit(1);
+    }
+    memcpy(chars, error, len + 1);
+    return chars;
+}
+
+static void worker_delete(Hymn *H, Worker *worker) {
+    channel_delete(H, &worker->inbox);
+    channel_delete(H, &worker->outbox);
+    serial_release(H, worker->function);
+    serial_release(H, worker->arguments);
+    serial_release(H, worker->result);
+    pthread_mutex_destroy(&worker->lock);
+    free(worker->error);
+    free(worker);
+}
+
+static void worker_reclaim(Hymn *H, Worker *worker) {
+    channel_close(&worker->inbox);
+    pthread_mutex_lock(&worker->lock);
+    if (worker->child != NULL) {
+        hymn_interrupt(worker->child);
+    }
+    pthread_mutex_unlock(&worker->lock);
+    pthread_join(worker->thread, NULL);
+    worker_delete(H, worker);
+}
+
+static void handles_finalize(Hymn *H, void *user) {
+    Handles *handles = (Handles *)user;
+    Handle *handle = handles->head;
+    while (handle != NULL) {
+        Handle *next = handle->next;
+        if (handle->owner && handle->worker != NULL) {
+            worker_reclaim(H, handle->worker);
+        }
+        free(handle);
+        handle = next;
+    }
+    free(handles);
+}
+
+static HymnValue new_handle(Hymn *H, Worker *worker, bool owner) {
+    Handles *handles = hymn_finalizer_user(H, handles_finalize);
+    if (handles == NULL) {
+        handles = calloc(1, sizeof(Handles));
+        if (handles == NULL) {
+            fprintf(stderr, "calloc failed.\n");
+            exit(1);
+        }
+        hymn_add_finalizer(H, handles_finalize, handles);
+    }
+    Handle *handle = calloc(1, sizeof(Handle));
+    if (handle == NULL) {
+        fprintf(stderr, "calloc failed.\n");
+        exit(1);
+    }
+    handle->worker = worker;
+    handle->owner = owner;
+    handle->next = handles->head;
+    handles->head = handle;
+    return hymn_new_pointer(handle);
+}
+
+static Limits worker_limits(Hymn *parent) {
+    Limits limits = {0};
+    limits.allocator = parent->allocator;
+    limits.memory_limit = parent->memory_limit;
+    limits.budget = parent->budget;
+    limits.frame_limit = parent->frame_limit;
+    return limits;
+}
+
+static Hymn *worker_hymn(Limits *limits) {
+    Hymn *H = new_hymn_with_allocator(limits->allocator.allocate != NULL ? &limits->allocator : NULL);
+    H->memory_limit = limits->memory_limit;
+    H->frame_limit = limits->frame_limit;
+    if (limits->budget > 0) {
+        hymn_set_budget(H, limits->budget, NULL, NULL);
+    }
+    hymn_use_libs(H);
+    if (!hymn_is_table(hymn_get(H, "thread"))) {
+        hymn_use_thread(H);
+    }
+    return H;
+}
+
+static HymnString *serial_function(Hymn *H, HymnValue function) {
+    HymnTable *globals = hymn_is_func(function) ? hymn_function_globals(H, hymn_as_func(function)) : hymn_new_table();
+    HymnArray *array = hymn_new_array(2);
+    array->items[0] = function;
+    array->items[1] = hymn_new_table_value(globals);
+    hymn_reference(function);
+    hymn_reference(array->items[1]);
+    HymnValue pair = hymn_new_array_value(array);
+    hymn_reference(pair);
+    HymnString *data = hymn_serialize(pair);
+    hymn_dereference(H, pair);
+    return data;
+}
+
+static HymnValue worker_function(Hymn *H, HymnString *data) {
+    HymnValue pair = hymn_deserialize(H, data);
+    hymn_reference(pair);
+    HymnArray *array = hymn_as_array(pair);
+    HymnValue function = array->items[0];
+    HymnTable *globals = hymn_as_table(array->items[1]);
+    HymnTableItem *item = NULL;
+    while ((item = hymn_table_next(globals, item == NULL ? NULL : item->key)) != NULL) {
+        if (hymn_is_undefined(hymn_get(H, item->key->string))) {
+            hymn_add(H, item->key->string, item->value);
+        }
+    }
+    if (hymn_is_func(function) && hymn_as_func(function)->name != NULL) {
+        hymn_add(H, hymn_as_func(function)->name, function);
+    }
+    hymn_reference(function);
+    hymn_dereference(H, pair);
+    return function;
+}
+
+static void *worker_run(void *data) {
+    Worker *worker = (Worker *)data;
+
+    Hymn *H = worker_hymn(&worker->limits);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->child = H;
+    pthread_mutex_unlock(&worker->lock);
+
+    HymnTable *thread = hymn_as_table(hymn_get(H, "thread"));
+    hymn_set_property_const(H, thread, "parent", new_handle(H, worker, false));
+
+    HymnValue function = worker_function(H, worker->function);
+    hymn_string_delete(worker->function);
+    worker->function = NULL;
+
+    if (hymn_is_string(function)) {
+        worker->error = hymn_script(H, hymn_as_string(function));
+    } else {
+        HymnValue arguments = hymn_deserialize(H, worker->arguments);
+        hymn_reference(arguments);
+        hymn_string_delete(worker->arguments);
+        worker->arguments = NULL;
+        HymnArray *array = hymn_as_array(arguments);
+        HymnValue result;
+        worker->error = hymn_call_value(H, function, (int)array->length, array->items, &result);
+        if (worker->error == NULL) {
+            worker->result = hymn_serialize(result);
+            if (worker->result == NULL) {
+                worker->error = error_chars("can't return a cyclic value from a thread");
+            }
+        }
+        hymn_dereference(H, result);
+        hymn_dereference(H, arguments);
+    }
+
+    hymn_dereference(H, function);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->child = NULL;
+    pthread_mutex_unlock(&worker->lock);
+
+    hymn_delete(H);
+
+    channel_close(&worker->outbox);
+
+    return NULL;
+}
+
+static Handle *thread_handle(Hymn *H, int count, HymnValue *arguments) {
+    if (count < 1 || !hymn_is_pointer(arguments[0])) {
+        return NULL;
+    }
+    Handles *handles = hymn_finalizer_user(H, handles_finalize);
+    if (handles == NULL) {
+        return NULL;
+    }
+    void *pointer = hymn_as_pointer(arguments[0]);
+    for (Handle *handle = handles->head; handle != NULL; handle = handle->next) {
+        if (handle == pointer) {
+            return handle;
+        }
+    }
+    return NULL;
+}
+
+static HymnValue thread_spawn(Hymn *H, int count, HymnValue *arguments) {
+    if (count < 1) {
+        return hymn_new_exception(H, "missing function");
+    }
+    HymnValue function = arguments[0];
+    if (!hymn_is_func(function) && !hymn_is_native(function) && !hymn_is_string(function)) {
+        return hymn_new_exception(H, "thread must be a function or script");
+    }
+    HymnArray *array = hymn_new_array(0);
+    for (int i = 1; i < count; i++) {
+        hymn_reference(arguments[i]);
+        hymn_array_push(array, arguments[i]);
+    }
+    HymnValue list = hymn_new_array_value(array);
+    hymn_reference(list);
+    HymnString *serial = serial_function(H, function);
+    HymnString *serial_arguments = hymn_serialize(list);
+    hymn_dereference(H, list);
+    if (serial == NULL || serial_arguments == NULL) {
+        serial_release(H, serial);
+        serial_release(H, serial_arguments);
+        return hymn_new_exception(H, "can't send a cyclic value to a thread");
+    }
+    Worker *worker = calloc(1, sizeof(Worker));
+    if (worker == NULL) {
+        fprintf(stderr, "calloc failed.\n");
+        exit(1);
+    }
+    worker->parent = H;
+    worker->limits = worker_limits(H);
+    worker->function = serial;
+    worker->arguments = serial_arguments;
+    pthread_mutex_init(&worker->lock, NULL);
+    channel_init(&worker->inbox);
+    channel_init(&worker->outbox);
+    if (pthread_create(&worker->thread, NULL, worker_run, worker) != 0) {
+        worker_delete(H, worker);
+        return hymn_new_exception(H, "failed to create thread");
+    }
+    return new_handle(H, worker, true);
+}
+
+static HymnValue thread_send(Hymn *H, int count, HymnValue *arguments) {
+    Handle *handle = thread_handle(H, count, arguments);
+    if (handle == NULL) {
+        return hymn_new_exception(H, "expected a thread");
+    } else if (handle->worker == NULL) {
+        return hymn_new_exception(H, "thread already joined");
+    } else if (count < 2) {
+        return hymn_new_exception(H, "missing value");
+    }
+    HymnString *data = hymn_serialize(arguments[1]);
+    if (data == NULL) {
+        return hymn_new_exception(H, "can't send a cyclic value to a thread");
+    }
+    Worker *worker = handle->worker;
+    channel_send(handle->owner ? &worker->inbox : &worker->outbox, data);
+    return hymn_new_none();
+}
+
+static HymnValue thread_receive(Hymn *H, int count, HymnValue *arguments) {
+    Handle *handle = thread_handle(H, count, arguments);
+    if (handle == NULL) {
+        return hymn_new_exception(H, "expected a thread");
+    } else if (handle->worker == NULL) {
+        return hymn_new_exception(H, "thread already joined");
+    }
+    Worker *worker = handle->worker;
+    HymnString *data = channel_receive(handle->owner ? &worker->outbox : &worker->inbox);
+    if (data == NULL) {
+        return hymn_new_none();
+    }
+    HymnValue value = hymn_deserialize(H, data);
+    hymn_string_delete(data);
+    return value;
+}
+
+static HymnValue thread_join(Hymn *H, int count, HymnValue *arguments) {
+    Handle *handle = thread_handle(H, count, arguments);
+    if (handle == NULL) {
+        return hymn_new_exception(H, "expected a thread");
+    } else if (!handle->owner) {
+        return hymn_new_exception(H, "only the parent can join a thread");
+    } else if (handle->worker == NULL) {
+        return hymn_new_none();
+    }
+    Worker *worker = handle->worker;
+    handle->worker = NULL;
+    pthread_join(worker->thread, NULL);
+    HymnValue result;
+    if (worker->error != NULL) {
+        result = hymn_new_exception(H, worker->error);
+    } else if (worker->result != NULL) {
+        result = hymn_deserialize(H, worker->result);
+        hymn_string_delete(worker->result);
+        worker->result = NULL;
+    } else {
+        result = hymn_new_none();
+    }
+    worker_delete(H, worker);
+    return result;
+}
+
+typedef struct Deque Deque;
+typedef struct Pool Pool;
+typedef struct PoolWorker PoolWorker;
+
+struct Deque {
+    pthread_mutex_t lock;
+    int *tasks;
+    int head;
+    int tail;
+};
+
+struct Pool {
+    pthread_mutex_t lock;
+    Limits limits;
+    HymnString **chunks;
+    HymnString **results;
+    Deque *deques;
+    char *error;
+    int chunk_count;
+    int worker_count;
+    bool collect;
+    bool failed;
+    char padding[6];
+};
+
+struct PoolWorker {
+    pthread_t thread;
+    Pool *pool;
+    HymnString *function;
+    int id;
+    char padding[4];
+};
+
+static int pool_take(Pool *pool, int id) {
+    Deque *own = &pool->deques[id];
+    int task = -1;
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail) {
+        task = own->tasks[own->head++];
+    }
+    pthread_mutex_unlock(&own->lock);
+    for (int i = 1; task == -1 && i < pool->worker_count; i++) {
+        Deque *victim = &pool->deques[(id + i) % pool->worker_count];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            task = victim->tasks[--victim->tail];
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return task;
+}
+
+static bool pool_fail(Pool *pool, char *error) {
+    pthread_mutex_lock(&pool->lock);
+    bool failed = pool->failed;
+    if (error != NULL) {
+        if (pool->error == NULL) {
+            pool->error = error;
+        } else {
+            free(error);
+        }
+        pool->failed = true;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return failed;
+}
+
+static void *pool_run(void *data) {
+    PoolWorker *worker = (PoolWorker *)data;
+    Pool *pool = worker->pool;
+
+    Hymn *H = worker_hymn(&pool->limits);
+
+    HymnValue function = worker_function(H, worker->function);
+    hymn_string_delete(worker->function);
+    worker->function = NULL;
+
+    int task;
+    while ((task = pool_take(pool, worker->id)) != -1) {
+        if (pool_fail(pool, NULL)) {
+            break;
+        }
+        HymnValue chunk = hymn_deserialize(H, pool->chunks[task]);
+        hymn_reference(chunk);
+        hymn_string_delete(pool->chunks[task]);
+        pool->chunks[task] = NULL;
+        HymnArray *items = hymn_as_array(chunk);
+        HymnArray *results = pool->collect ? hymn_new_array(0) : NULL;
+        char *error = NULL;
+        for (HymnInt i = 0; i < items->length; i++) {
+            HymnValue result;
+            error = hymn_call_value(H, function, 1, &items->items[i], &result);
+            if (error != NULL) {
+                break;
+            } else if (results != NULL) {
+                hymn_array_push(results, result);
+            } else {
+                hymn_dereference(H, result);
+            }
+        }
+        if (results != NULL) {
+            HymnValue list = hymn_new_array_value(results);
+            hymn_reference(list);
+            if (error == NULL) {
+                pool->results[task] = hymn_serialize(list);
+                if (pool->results[task] == NULL) {
+                    error = error_chars("can't return a cyclic value from a thread");
+                }
+            }
+            hymn_dereference(H, list);
+        }
+        hymn_dereference(H, chunk);
+        if (error != NULL) {
+            pool_fail(pool, error);
+            break;
+        }
+    }
+
+    hymn_dereference(H, function);
+    hymn_delete(H);
+
+    return NULL;
+}
+
+static HymnValue thread_pool(Hymn *H, int count, HymnValue *arguments, bool collect) {
+    if (count < 2) {
+        return hymn_new_exception(H, "missing array and function");
+    }
+    HymnValue input = arguments[0];
+    HymnValue function = arguments[1];
+    if (!hymn_is_array(input)) {
+        return hymn_new_exception(H, "expected an array");
+    } else if (!hymn_is_func(function) && !hymn_is_native(function)) {
+        return hymn_new_exception(H, "expected a function");
+    }
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (count >= 3) {
+        if (!hymn_is_int(arguments[2]) || hymn_as_int(arguments[2]) < 1) {
+            return hymn_new_exception(H, "workers must be a positive integer");
+        }
+        workers = hymn_as_int(arguments[2]) > UINT8_MAX ? UINT8_MAX : (int)hymn_as_int(arguments[2]);
+    }
+    HymnArray *array = hymn_as_array(input);
+    if (array->length == 0) {
+        return collect ? hymn_new_array_value(hymn_new_array(0)) : hymn_new_none();
+    }
+    if (workers < 1) {
+        workers = 1;
+    } else if ((HymnInt)workers > array->length) {
+        workers = (int)array->length;
+    }
+
+    HymnInt size = array->length / ((HymnInt)workers * 8);
+    if (size < 1) {
+        size = 1;
+    }
+    int chunks = (int)((array->length + size - 1) / size);
+
+    HymnString *serial = serial_function(H, function);
+    if (serial == NULL) {
+        return hymn_new_exception(H, "can't send a cyclic value to a thread");
+    }
+
+    Pool pool = {0};
+    pthread_mutex_init(&pool.lock, NULL);
+    pool.limits = worker_limits(H);
+    pool.chunk_count = chunks;
+    pool.worker_count = workers;
+    pool.collect = collect;
+    pool.chunks = calloc((size_t)chunks, sizeof(HymnString *));
+    pool.results = calloc((size_t)chunks, sizeof(HymnString *));
+    pool.deques = calloc((size_t)workers, sizeof(Deque));
+    PoolWorker *threads = calloc((size_t)workers, sizeof(PoolWorker));
+    if (pool.chunks == NULL || pool.results == NULL || pool.deques == NULL || threads == NULL) {
+        fprintf(stderr, "calloc failed.\n");
+        exit(1);
+    }
+    threads[0].function = serial;
+
+    bool cyclic = false;
+    HymnArray *chunk = hymn_new_array(size);
+    HymnValue list = hymn_new_array_value(chunk);
+    hymn_reference(list);
+    for (int c = 0; c < chunks; c++) {
+        HymnInt start = (HymnInt)c * size;
+        HymnInt end = start + size > array->length ? array->length : start + size;
+        chunk->length = end - start;
+        memcpy(chunk->items, &array->items[start], (size_t)chunk->length * sizeof(HymnValue));
+        pool.chunks[c] = hymn_serialize(list);
+        if (pool.chunks[c] == NULL) {
+            cyclic = true;
+            break;
+        }
+    }
+    chunk->length = 0;
+    hymn_dereference(H, list);
+
+    int started = 0;
+    if (!cyclic) {
+        int per = (chunks + workers - 1) / workers;
+        for (int w = 0; w < workers; w++) {
+            Deque *deque = &pool.deques[w];
+            pthread_mutex_init(&deque->lock, NULL);
+            deque->tasks = malloc((size_t)per * sizeof(int));
+            if (deque->tasks == NULL) {
+                fprintf(stderr, "malloc failed.\n");
+                exit(1);
+            }
+            for (int c = w * per; c < chunks && c < (w + 1) * per; c++) {
+                deque->tasks[deque->tail++] = c;
+            }
+        }
+        for (int w = 0; w < workers; w++) {
+            threads[w].pool = &pool;
+            if (w > 0) {
+                threads[w].function = serial_function(H, function);
+            }
+            threads[w].id = w;
+            if (pthread_create(&threads[w].thread, NULL, pool_run, &threads[w]) != 0) {
+                pool_fail(&pool, error_chars("failed to create thread"));
+                break;
+            }
+            started++;
+        }
+        for (int w = 0; w < started; w++) {
+            pthread_join(threads[w].thread, NULL);
+        }
+        for (int w = 0; w < workers; w++) {
+            pthread_mutex_destroy(&pool.deques[w].lock);
+            free(pool.deques[w].tasks);
+        }
+    }
+
+    HymnValue result = hymn_new_none();
+    if (cyclic) {
+        result = hymn_new_exception(H, "can't send a cyclic value to a thread");
+    } else if (pool.error != NULL) {
+        result = hymn_new_exception(H, pool.error);
+    } else if (collect) {
+        HymnArray *output = hymn_new_array(0);
+        for (int c = 0; c < chunks; c++) {
+            HymnValue part = hymn_deserialize(H, pool.results[c]);
+            hymn_reference(part);
+            hymn_string_delete(pool.results[c]);
+            pool.results[c] = NULL;
+            HymnArray *items = hymn_as_array(part);
+            for (HymnInt i = 0; i < items->length; i++) {
+                hymn_reference(items->items[i]);
+                hymn_array_push(output, items->items[i]);
+            }
+            hymn_dereference(H, part);
+        }
+        result = hymn_new_array_value(output);
+    }
+
+    for (int c = 0; c < chunks; c++) {
+        serial_release(H, pool.chunks[c]);
+        serial_release(H, pool.results[c]);
+    }
+    for (int w = started; w < workers; w++) {
+        serial_release(H, threads[w].function);
+    }
+    free(pool.error);
+    free(pool.chunks);
+    free(pool.results);
+    free(pool.deques);
+    free(threads);
+    pthread_mutex_destroy(&pool.lock);
+
+    return result;
+}
+
+static HymnValue thread_map(Hymn *H, int count, HymnValue *arguments) {
+    return thread_pool(H, count, arguments, true);
+}
+
+static HymnValue thread_each(Hymn *H, int count, HymnValue *arguments) {
+    return thread_pool(H, count, arguments, false);
+}
+
+static HymnValue thread_cores(Hymn *H, int count, HymnValue *arguments) {
+    (void)H;
+    (void)count;
+    (void)arguments;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return hymn_new_int(cores < 1 ? 1 : (HymnInt)cores);
+}
+
+void hymn_use_thread(Hymn *H) {
+    HymnTable *thread = hymn_new_table();
+    hymn_add_function_to_table(H, thread, "spawn", thread_spawn);
+    hymn_add_function_to_table(H, thread, "send", thread_send);
+    hymn_add_function_to_table(H, thread, "receive", thread_receive);
+    hymn_add_function_to_table(H, thread, "join", thread_join);
+    hymn_add_function_to_table(H, thread, "map", thread_map);
+    hymn_add_function_to_table(H, thread, "each", thread_each);
+    hymn_add_function_to_table(H, thread, "cores", thread_cores);
+    hymn_add_table(H, "thread", thread);
+}
+
+#endif
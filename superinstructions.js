@@ -0,0 +1,185 @@
+#!/usr/bin/env node
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// Generates src/hymn_super.h from the sequences listed in superinstructions.txt.
+//
+//   node superinstructions.js                          regenerate from the table
+//   node superinstructions.js opcodes.json [options]   print candidate pairs from a profile, without generating
+//
+//   --top <n>            print at most n candidates (default 8)
+//   --min-count <n>      skip pairs executed fewer than n times (default 1000)
+//   --min-percent <p>    skip pairs below p percent of all executed pairs (default 1)
+//
+// opcodes.json is written by a HYMN_OPCODE_COUNTS build with `hymn --opcodes opcodes.json script.hm`.
+// Candidates are printed in table format. Review them and copy the ones worth fusing into the table by hand.
+
+const fs = require('fs')
+const path = require('path')
+const process = require('process')
+
+let input = null
+const options = { top: 8, minCount: 1000, minPercent: 1 }
+
+for (let i = 2; i < process.argv.length; i++) {
+  const arg = process.argv[i]
+  const number = (name) => {
+    const value = Number(process.argv[++i])
+    if (!Number.isFinite(value) || value < 0) {
+      console.error(`${name} expects a non-negative number`)
+      process.exit(1)
+    }
+    return value
+  }
+  if (arg === '--top') options.top = number(arg)
+  else if (arg === '--min-count') options.minCount = number(arg)
+  else if (arg === '--min-percent') options.minPercent = number(arg)
+  else if (input === null) input = path.resolve(arg)
+  else {
+    console.error(`unknown argument: ${arg}`)
+    process.exit(1)
+  }
+}
+
+process.chdir(__dirname)
+
+const TABLE = 'superinstructions.txt'
+const HEADER = path.join('src', 'hymn_super.h')
+
+const MAX = 3
+
+// Instructions that can be fused. Each has its operand size in bytes and the run() macro that executes it
+// without dispatching. Jumps, calls and anything that changes frames are left out.
+const fusable = {
+  ADD: [0, 'ADD_OP()'],
+  CONSTANT: [1, 'CONSTANT_OP()'],
+  EQUAL: [0, 'EQUAL_OP()'],
+  GET_GLOBAL: [1, 'GET_GLOBAL_OP()'],
+  GET_LOCAL: [1, 'GET_LOCAL_OP()'],
+  GET_PROPERTY: [1, 'GET_PROPERTY_OP()'],
+  GREATER: [0, 'COMPARE_OP(>)'],
+  GREATER_EQUAL: [0, 'COMPARE_OP(>=)'],
+  LESS: [0, 'COMPARE_OP(<)'],
+  LESS_EQUAL: [0, 'COMPARE_OP(<=)'],
+  NOT_EQUAL: [0, 'EQUAL_OP(!)'],
+  POP: [0, 'POP_OP()'],
+  SET_LOCAL: [1, 'SET_LOCAL_OP()'],
+  SUBTRACT: [0, 'SUBTRACT_OP()'],
+}
+
+function strip(opcode) {
+  return opcode.startsWith('OP_') ? opcode.substring(3) : opcode
+}
+
+function valid(sequence) {
+  return sequence.length >= 2 && sequence.length <= MAX && sequence.every((opcode) => opcode in fusable)
+}
+
+function read() {
+  const sequences = []
+  if (!fs.existsSync(TABLE)) return sequences
+  const lines = fs.readFileSync(TABLE, 'utf8').split('\n')
+  for (let i = 0; i < lines.length; i++) {
+    const line = lines[i].replace(/#.*/, '').trim()
+    if (line === '') continue
+    const sequence = line.split(/\s+/).map(strip)
+    if (!valid(sequence)) {
+      console.error(`${TABLE}:${i + 1}: can't fuse: ${line}`)
+      process.exit(1)
+    }
+    sequences.push(sequence)
+  }
+  return sequences
+}
+
+function candidates(sequences, file, options) {
+  const counts = JSON.parse(fs.readFileSync(file, 'utf8'))
+  const known = new Set(sequences.map((sequence) => sequence.join(' ')))
+  const total = counts.pairs.reduce((sum, pair) => sum + pair.count, 0)
+  let found = 0
+  for (const pair of counts.pairs) {
+    if (found >= options.top) break
+    const percent = total > 0 ? (100 * pair.count) / total : 0
+    if (pair.count < options.minCount || percent < options.minPercent) break
+    const sequence = [strip(pair.first), strip(pair.second)]
+    const key = sequence.join(' ')
+    if (known.has(key) || !valid(sequence)) continue
+    found++
+    console.log(`${key.padEnd(40)} # ${pair.count} (${percent.toFixed(2)}%)`)
+  }
+  if (found === 0) {
+    console.log(`no candidates above ${options.minCount} executions and ${options.minPercent}% of ${total} pairs`)
+  }
+}
+
+function macro(name, lines) {
+  let out = `#define ${name}`
+  if (lines.length === 0) return out + '\n'
+  const width = Math.max(out.length, ...lines.map((line) => line.length)) + 1
+  out = out.padEnd(width) + '\\\n'
+  for (let i = 0; i < lines.length; i++) {
+    const line = lines[i]
+    out += i === lines.length - 1 ? line + '\n' : line.padEnd(width) + '\\\n'
+  }
+  return out
+}
+
+function generate(sequences) {
+  // longest sequences are matched first
+  sequences = sequences.slice().sort((a, b) => b.length - a.length)
+
+  const opcodes = []
+  const sizes = []
+  const names = []
+  const disassemble = []
+  const patterns = []
+  const run = []
+
+  for (const sequence of sequences) {
+    const opcode = 'OP_' + sequence.join('_')
+    const size = 1 + sequence.reduce((sum, part) => sum + fusable[part][0], 0)
+    opcodes.push(`    ${opcode},`)
+    sizes.push(`    case ${opcode}: return ${size};`)
+    names.push(`    case ${opcode}: return "${opcode}";`)
+    disassemble.push(`    case ${opcode}: return debug_super_instruction(debug, name, ${size}, code, index);`)
+    const parts = sequence.map((part) => 'OP_' + part)
+    while (parts.length < MAX) parts.push('0')
+    patterns.push(`    {${opcode}, ${sequence.length}, {${parts.join(', ')}}},`)
+    run.push(`    case ${opcode}: {`)
+    for (const part of sequence) {
+      run.push(`        { ${fusable[part][1]} }`)
+    }
+    run.push('        goto dispatch;')
+    run.push('    }')
+  }
+
+  let out = `/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/* Generated by superinstructions.js from ${TABLE}. Do not edit. */
+
+#ifndef HYMN_SUPER_H
+#define HYMN_SUPER_H
+
+#define HYMN_SUPER_MAX ${MAX}
+#define HYMN_SUPER_COUNT ${sequences.length}
+
+`
+  out += macro('HYMN_SUPER_OPCODES', opcodes) + '\n'
+  out += macro('HYMN_SUPER_NEXT', sizes) + '\n'
+  out += macro('HYMN_SUPER_NAMES', names) + '\n'
+  out += macro('HYMN_SUPER_DISASSEMBLE', disassemble) + '\n'
+  out += macro('HYMN_SUPER_PATTERNS', patterns) + '\n'
+  out += macro('HYMN_SUPER_RUN', run) + '\n'
+  out += '#endif\n'
+
+  fs.writeFileSync(HEADER, out)
+  console.log(`wrote ${sequences.length} superinstructions to ${HEADER}`)
+}
+
+const sequences = read()
+if (input !== null) candidates(sequences, input, options)
+else generate(sequences)
@@ -0,0 +1,292 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "hymn.h"
+#include "hymn_libs.h"
+#include <time.h>
+
+#ifdef HYMN_BENCHMARK
+
+#define KEYS 100000
+#define ROUNDS 20
+
+static const char *filter = NULL;
+
+static HymnObjectString *keys[KEYS];
+
+static double now(void) {
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static bool selected(const char *name) {
+    return filter == NULL || strstr(name, filter) != NULL;
+}
+
+static void report(const char *name, int64_t operations, double seconds) {
+    double nanoseconds = seconds * 1e9 / (double)operations;
+    printf("%-24s %12" PRId64 " ops %10.3f s %10.2f ns/op\n", name, operations, seconds, nanoseconds);
+}
+
+static void report_throughput(const char *name, size_t bytes, int rounds, double seconds) {
+    double megabytes = (double)bytes * (double)rounds / (1024.0 * 1024.0);
+    printf("%-24s %12d runs %10.3f s %10.2f MB/s\n", name, rounds, seconds, megabytes / seconds);
+}
+
+static void benchmark_intern(Hymn *H) {
+    char name[32];
+    double start = now();
+    for (int i = 0; i < KEYS; i++) {
+        snprintf(name, sizeof(name), "key-%d", i);
+        keys[i] = hymn_new_intern_string(H, name);
+        hymn_reference_string(keys[i]);
+    }
+    report("intern new", KEYS, now() - start);
+
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < KEYS; i++) {
+            snprintf(name, sizeof(name), "key-%d", i);
+            hymn_new_intern_string(H, name);
+        }
+    }
+    report("intern existing", (int64_t)KEYS * ROUNDS, now() - start);
+}
+
+static void benchmark_table(Hymn *H) {
+    HymnTable *table = hymn_new_table();
+    HymnValue value = hymn_new_table_value(table);
+    hymn_reference(value);
+
+    double start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < KEYS; i++) {
+            hymn_set_property(H, table, keys[i], hymn_new_int(i));
+        }
+    }
+    report("table put", (int64_t)KEYS * ROUNDS, now() - start);
+
+    HymnInt sum = 0;
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < KEYS; i++) {
+            sum += hymn_as_int(hymn_table_get(table, keys[i]->string));
+        }
+    }
+    report("table get", (int64_t)KEYS * ROUNDS, now() - start);
+
+    int64_t items = 0;
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        HymnTableItem *item = hymn_table_next(table, NULL);
+        while (item != NULL) {
+            sum += hymn_as_int(item->value);
+            items++;
+            item = hymn_table_next(table, item->key);
+        }
+    }
+    report("table next", items, now() - start);
+
+    if (sum == 0) {
+        printf("unexpected table sum\n");
+    }
+
+    hymn_dereference(H, value);
+}
+
+static void benchmark_array(Hymn *H) {
+    int64_t count = 0;
+    double start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        HymnArray *array = hymn_new_array(0);
+        HymnValue value = hymn_new_array_value(array);
+        hymn_reference(value);
+        for (int i = 0; i < KEYS * 10; i++) {
+            hymn_array_push(array, hymn_new_int(i));
+        }
+        count += array->length;
+        hymn_dereference(H, value);
+    }
+    report("array push", count, now() - start);
+}
+
+static void benchmark_string(void) {
+    int64_t count = 0;
+    double start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        HymnString *string = hymn_new_string("");
+        for (int i = 0; i < KEYS * 10; i++) {
+            string = hymn_string_append(string, "hymn");
+        }
+        count += KEYS * 10;
+        hymn_string_delete(string);
+    }
+    report("string append", count, now() - start);
+}
+
+static void benchmark_value_to_string(void) {
+    size_t length = 0;
+    double start = now();
+    for (int i = 0; i < KEYS * 10; i++) {
+        HymnString *string = hymn_value_to_string(hymn_new_int(i));
+        length += hymn_string_len(string);
+        hymn_string_delete(string);
+    }
+    report("int to string", KEYS * 10, now() - start);
+
+    start = now();
+    for (int i = 0; i < KEYS * 10; i++) {
+        HymnString *string = hymn_value_to_string(hymn_new_float((HymnFloat)i * 0.25));
+        length += hymn_string_len(string);
+        hymn_string_delete(string);
+    }
+    report("float to string", KEYS * 10, now() - start);
+
+    if (length == 0) {
+        printf("unexpected string length\n");
+    }
+}
+
+static void benchmark_reference(Hymn *H) {
+    HymnValue value = hymn_new_array_value(hymn_new_array(0));
+    hymn_reference(value);
+    int64_t count = (int64_t)KEYS * 1000;
+    double start = now();
+    for (int64_t i = 0; i < count; i++) {
+        hymn_reference(value);
+        hymn_dereference(H, value);
+    }
+    report("reference dereference", count, now() - start);
+    hymn_dereference(H, value);
+}
+
+static HymnString *compile_source(void) {
+    HymnString *source = hymn_new_string("");
+    for (int i = 0; i < 100; i++) {
+        HymnString *part = hymn_string_format("func work_%d(a, b) {\n", i);
+        source = hymn_string_append(source, part);
+        hymn_string_delete(part);
+        for (int k = 0; k < 20; k++) {
+            source = hymn_string_append(source, "  if a {\n"
+                                                "    set total = 0\n"
+                                                "    for i = 0, i < a {\n"
+                                                "      if i % 2 == 0 { total += i * b } else { total -= \"text {i}\".len }\n"
+                                                "    }\n"
+                                                "    set table = {name: \"work\", values: [a, b, total]}\n"
+                                                "    b = table.values[2]\n"
+                                                "  }\n");
+        }
+        source = hymn_string_append(source, "  return b\n}\n");
+    }
+    return source;
+}
+
+static void benchmark_compile(Hymn *H) {
+    HymnString *source = compile_source();
+    int rounds = 10;
+    double start = now();
+    for (int r = 0; r < rounds; r++) {
+        char *error = hymn_compile(H, "benchmark", source);
+        if (error != NULL) {
+            printf("%s\n", error);
+            free(error);
+            break;
+        }
+    }
+    report_throughput("compile", hymn_string_len(source), rounds, now() - start);
+    hymn_string_delete(source);
+}
+
+static HymnString *json_source(void) {
+    HymnString *source = hymn_new_string("[");
+    for (int i = 0; i < 20000; i++) {
+        HymnString *part = hymn_string_format("%s{\"id\": %d, \"name\": \"item %d\", \"price\": %d.5, \"tags\": [\"a\", \"b\"]}", i == 0 ? "" : ", ", i, i, i);
+        source = hymn_string_append(source, part);
+        hymn_string_delete(part);
+    }
+    return hymn_string_append(source, "]");
+}
+
+static void benchmark_json(Hymn *H) {
+    HymnTable *json = hymn_as_table(hymn_get(H, "json"));
+    HymnHandle *parse = hymn_handle_value(H, hymn_table_get(json, "parse"));
+    HymnHandle *save = hymn_handle_value(H, hymn_table_get(json, "save"));
+
+    HymnString *source = json_source();
+    int rounds = 5;
+    double start = now();
+    for (int r = 0; r < rounds; r++) {
+        hymn_handle_push_string(parse, source);
+        char *error = hymn_handle_call(parse);
+        if (error != NULL) {
+            printf("%s\n", error);
+            free(error);
+            goto end;
+        }
+    }
+    report_throughput("json parse", hymn_string_len(source), rounds, now() - start);
+
+    size_t length = 0;
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        hymn_handle_push(save, hymn_handle_result(parse));
+        char *error = hymn_handle_call(save);
+        if (error != NULL) {
+            printf("%s\n", error);
+            free(error);
+            goto end;
+        }
+        length = hymn_string_len(hymn_as_string(hymn_handle_result(save)));
+    }
+    report_throughput("json save", length, rounds, now() - start);
+
+end:
+    hymn_string_delete(source);
+    hymn_handle_delete(parse);
+    hymn_handle_delete(save);
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2) {
+        filter = argv[1];
+    }
+
+    Hymn *hymn = new_hymn();
+    hymn_use_libs(hymn);
+
+    if (selected("intern") || selected("table")) {
+        benchmark_intern(hymn);
+    }
+
+    if (selected("table")) {
+        benchmark_table(hymn);
+    }
+    if (selected("array")) {
+        benchmark_array(hymn);
+    }
+    if (selected("string")) {
+        benchmark_string();
+        benchmark_value_to_string();
+    }
+    if (selected("reference")) {
+        benchmark_reference(hymn);
+    }
+    if (selected("compile")) {
+        benchmark_compile(hymn);
+    }
+    if (selected("json")) {
+        benchmark_json(hymn);
+    }
+
+    for (int i = 0; i < KEYS && keys[i] != NULL; i++) {
+        hymn_dereference_string(hymn, keys[i]);
+    }
+
+    hymn_delete(hymn);
+
+    return 0;
+}
+
+#endif
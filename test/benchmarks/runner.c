@@ -0,0 +1,313 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#ifdef __GNUC__
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_BENCHMARKS 64
+#define MAX_RUNS 1000
+
+typedef struct Result Result;
+
+struct Result {
+    char *name;
+    char *path;
+    double median;
+    double min;
+    double mean;
+    double stddev;
+    long rss;
+    bool failed;
+    char padding[7];
+};
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_string(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static char *copy(const char *string) {
+    size_t size = strlen(string) + 1;
+    char *out = malloc(size);
+    memcpy(out, string, size);
+    return out;
+}
+
+static char *benchmark_name(const char *path) {
+    const char *base = strrchr(path, '/');
+    base = base == NULL ? path : base + 1;
+    char *name = copy(base);
+    char *dot = strrchr(name, '.');
+    if (dot != NULL) {
+        *dot = '\0';
+    }
+    return name;
+}
+
+static bool run(const char *interpreter, const char *path, double *seconds, long *rss) {
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    } else if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+        execl(interpreter, interpreter, path, (char *)NULL);
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    *seconds = now() - start;
+#ifdef __APPLE__
+    *rss = usage.ru_maxrss / 1024;
+#else
+    *rss = usage.ru_maxrss;
+#endif
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void measure(Result *result, const char *interpreter, int warmup, int runs) {
+    double times[MAX_RUNS];
+    long rss = 0;
+    for (int i = 0; i < warmup; i++) {
+        double seconds;
+        long peak;
+        if (!run(interpreter, result->path, &seconds, &peak)) {
+            result->failed = true;
+            return;
+        }
+    }
+    for (int i = 0; i < runs; i++) {
+        long peak = 0;
+        if (!run(interpreter, result->path, &times[i], &peak)) {
+            result->failed = true;
+            return;
+        }
+        if (peak > rss) {
+            rss = peak;
+        }
+    }
+    qsort(times, (size_t)runs, sizeof(double), compare_double);
+    double sum = 0.0;
+    for (int i = 0; i < runs; i++) {
+        sum += times[i];
+    }
+    double mean = sum / (double)runs;
+    double variance = 0.0;
+    for (int i = 0; i < runs; i++) {
+        variance += (times[i] - mean) * (times[i] - mean);
+    }
+    result->median = runs % 2 == 1 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2.0;
+    result->min = times[0];
+    result->mean = mean;
+    result->stddev = runs > 1 ? sqrt(variance / (double)(runs - 1)) : 0.0;
+    result->rss = rss;
+}
+
+static char *read_file(const char *path) {
+    FILE *open = fopen(path, "r");
+    if (open == NULL) {
+        return NULL;
+    }
+    fseek(open, 0, SEEK_END);
+    long size = ftell(open);
+    fseek(open, 0, SEEK_SET);
+    char *content = malloc((size_t)size + 1);
+    size_t read = fread(content, 1, (size_t)size, open);
+    content[read] = '\0';
+    fclose(open);
+    return content;
+}
+
+static bool baseline_median(const char *baseline, const char *name, double *median) {
+    char key[256];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    const char *found = strstr(baseline, key);
+    if (found == NULL) {
+        return false;
+    }
+    const char *end = strchr(found, '}');
+    const char *value = strstr(found, "\"median\": ");
+    if (value == NULL || (end != NULL && value > end)) {
+        return false;
+    }
+    *median = strtod(value + strlen("\"median\": "), NULL);
+    return true;
+}
+
+static void write_json(FILE *out, Result *results, int count, int warmup, int runs) {
+    fprintf(out, "{\n  \"warmup\": %d,\n  \"runs\": %d,\n  \"benchmarks\": [\n", warmup, runs);
+    for (int i = 0; i < count; i++) {
+        Result *r = &results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"failed\": %s, \"median\": %.6f, \"min\": %.6f, \"mean\": %.6f, \"stddev\": %.6f, \"rss\": %ld}%s\n", r->name, r->failed ? "true" : "false", r->median, r->min, r->mean, r->stddev, r->rss, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void help(void) {
+    printf("usage: runner [options] [benchmark.hm ...]\n"
+           "  -x <path>       interpreter to run (default ./hymn)\n"
+           "  -n <runs>       measured runs per benchmark (default 5)\n"
+           "  -w <runs>       warmup runs per benchmark (default 1)\n"
+           "  -o <file>       write results as json\n"
+           "  -b <file>       compare medians against a baseline json\n"
+           "  -t <percent>    regression threshold (default 5)\n"
+           "  -h              print this help message\n");
+}
+
+int main(int argc, char **argv) {
+    const char *interpreter = "./hymn";
+    const char *output = NULL;
+    const char *baseline_path = NULL;
+    int runs = 5;
+    int warmup = 1;
+    double threshold = 5.0;
+
+    char *paths[MAX_BENCHMARKS];
+    int count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool value = i + 1 < argc;
+        if (strcmp(arg, "-h") == 0) {
+            help();
+            return 0;
+        } else if (strcmp(arg, "-x") == 0 && value) {
+            interpreter = argv[++i];
+        } else if (strcmp(arg, "-n") == 0 && value) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(arg, "-w") == 0 && value) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(arg, "-o") == 0 && value) {
+            output = argv[++i];
+        } else if (strcmp(arg, "-b") == 0 && value) {
+            baseline_path = argv[++i];
+        } else if (strcmp(arg, "-t") == 0 && value) {
+            threshold = atof(argv[++i]);
+        } else if (arg[0] == '-') {
+            help();
+            return 2;
+        } else if (count < MAX_BENCHMARKS) {
+            paths[count++] = copy(arg);
+        }
+    }
+
+    if (runs < 1 || runs > MAX_RUNS || warmup < 0) {
+        fprintf(stderr, "runs must be between 1 and %d\n", MAX_RUNS);
+        return 2;
+    }
+
+    if (count == 0) {
+        const char *directory = "test/benchmarks";
+        DIR *dir = opendir(directory);
+        if (dir == NULL) {
+            fprintf(stderr, "failed to open %s\n", directory);
+            return 2;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL && count < MAX_BENCHMARKS) {
+            size_t length = strlen(entry->d_name);
+            if (length > 3 && strcmp(entry->d_name + length - 3, ".hm") == 0) {
+                char *path = malloc(strlen(directory) + length + 2);
+                sprintf(path, "%s/%s", directory, entry->d_name);
+                paths[count++] = path;
+            }
+        }
+        closedir(dir);
+        qsort(paths, (size_t)count, sizeof(char *), compare_string);
+    }
+
+    char *baseline = NULL;
+    if (baseline_path != NULL) {
+        baseline = read_file(baseline_path);
+        if (baseline == NULL) {
+            fprintf(stderr, "failed to read baseline %s\n", baseline_path);
+            return 2;
+        }
+    }
+
+    Result results[MAX_BENCHMARKS];
+    memset(results, 0, sizeof(results));
+
+    int regressions = 0;
+
+    printf("%-12s %10s %10s %10s %10s", "BENCHMARK", "MEDIAN", "MIN", "STDDEV", "RSS");
+    printf(baseline != NULL ? " %10s\n" : "\n", "CHANGE");
+    for (int i = 0; i < count; i++) {
+        Result *result = &results[i];
+        result->path = paths[i];
+        result->name = benchmark_name(paths[i]);
+        measure(result, interpreter, warmup, runs);
+        if (result->failed) {
+            printf("%-12s %10s\n", result->name, "failed");
+            regressions++;
+            continue;
+        }
+        printf("%-12s %9.3fs %9.3fs %9.3fs %8ldkB", result->name, result->median, result->min, result->stddev, result->rss);
+        double previous;
+        if (baseline != NULL && baseline_median(baseline, result->name, &previous) && previous > 0.0) {
+            double change = (result->median - previous) / previous * 100.0;
+            bool regressed = change > threshold;
+            printf(" %+9.1f%%%s", change, regressed ? " regression" : "");
+            if (regressed) {
+                regressions++;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (output != NULL) {
+        FILE *out = fopen(output, "w");
+        if (out == NULL) {
+            fprintf(stderr, "failed to write %s\n", output);
+        } else {
+            write_json(out, results, count, warmup, runs);
+            fclose(out);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(results[i].name);
+        free(paths[i]);
+    }
+    free(baseline);
+
+    return regressions > 0 ? 1 : 0;
+}
@@ -5,6 +5,7 @@
 #include "hymn.h"
 #include "hymn_libs.h"
 #include "hymn_path.h"
+#include "hymn_profile.h"
 #include "hymn_text.h"
 #include <stddef.h>
 
@@ -37,7 +38,7 @@ static void delete_filter_list(struct FilterList *list) {
     for (int i = 0; i < list->count; i++) {
         hymn_string_delete(list->filtered[i]);
     }
-    free(list->filtered);
+    hymn_free(list->filtered);
 }
 
 static void console(const char *format, ...) {
@@ -50,7 +51,7 @@ static void console(const char *format, ...) {
     vsnprintf(chars, len + 1, format, args);
     va_end(args);
     out = hymn_string_append(out, chars);
-    free(chars);
+    hymn_free(chars);
 }
 
 static HymnString *indent(HymnString *text) {
@@ -226,7 +227,1065 @@ fail:
 
 end:
     hymn_delete(hymn);
-    free(point);
+    hymn_free(point);
+}
+
+static void *allocate_for_test(void *user, size_t size) {
+#ifdef __GNUC__
+    __atomic_add_fetch((size_t *)user, 1, __ATOMIC_RELAXED);
+#else
+    (*(size_t *)user)++;
+#endif
+    return malloc(size);
+}
+
+static void *reallocate_for_test(void *user, void *memory, size_t size) {
+    (void)user;
+    return realloc(memory, size);
+}
+
+static void release_for_test(void *user, void *memory) {
+    (void)user;
+    free(memory);
+}
+
+static void test_memory(void) {
+    tests_count++;
+    printf("memory\n");
+    size_t allocations = 0;
+    HymnAllocator allocator = {allocate_for_test, reallocate_for_test, release_for_test, &allocations};
+    Hymn *hymn = new_hymn_with_allocator(&allocator);
+    hymn->print = console;
+    hymn->memory_limit = 1 << 20;
+    hymn_string_zero(out);
+
+    char *error = NULL;
+
+    error = hymn_do(hymn, "set a = []\ntry { while true { push(a, \"item \" + len(a)) } } except e { echo e }\na = none");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_string_trim(out);
+    if (!hymn_string_starts_with(out, "memory limit exceeded")) {
+        printf("incorrent output: <%s>\n\n", out);
+        tests_fail++;
+        goto end;
+    }
+
+    if (allocations == 0 || hymn->memory_peak < hymn->memory_limit / 2 || hymn->memory_peak > hymn->memory_limit + 1024 || hymn->memory > hymn->memory_limit) {
+        printf("incorrent memory: %zu allocations, %zu bytes, %zu peak\n\n", allocations, hymn->memory, hymn->memory_peak);
+        tests_fail++;
+        goto end;
+    }
+
+    tests_success++;
+    goto end;
+
+fail:
+    printf("%s\n\n", error);
+    free(error);
+    tests_fail++;
+
+end:
+    hymn_delete(hymn);
+}
+
+static void test_memory_refused(void) {
+    tests_count++;
+    printf("memory refused\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn->memory_limit = 1 << 20;
+    hymn_string_zero(out);
+
+    char *error = hymn_do(hymn, "set s = \"0123456789abcdef\"\n"
+                                "try { while true { s += s } } except e { echo e[:21] }\n"
+                                "echo len(s) < 1048576\n"
+                                "set t = {}\n"
+                                "try { for i = 0, i < 1048576 { t[\"k\" + i] = i } } except e { t = none\n echo e[:21] }\n"
+                                "s = none\n"
+                                "echo \"released\"");
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+        goto end;
+    }
+
+    hymn_string_trim(out);
+    if (!hymn_string_equal(out, "memory limit exceeded\ntrue\nmemory limit exceeded\nreleased")) {
+        printf("incorrent output: <%s>\n\n", out);
+        tests_fail++;
+        goto end;
+    }
+
+    if (hymn->memory_peak > hymn->memory_limit + 1024 || hymn->memory > hymn->memory_limit) {
+        printf("incorrent memory: %zu bytes, %zu peak\n\n", hymn->memory, hymn->memory_peak);
+        tests_fail++;
+        goto end;
+    }
+
+    tests_success++;
+
+end:
+    hymn_delete(hymn);
+}
+
+static void test_memory_libs(void) {
+    tests_count++;
+    printf("memory libs\n");
+    size_t allocations = 0;
+    HymnAllocator allocator = {allocate_for_test, reallocate_for_test, release_for_test, &allocations};
+    Hymn *hymn = new_hymn_with_allocator(&allocator);
+    size_t memory = hymn->memory;
+    size_t before = allocations;
+    hymn_use_libs(hymn);
+    size_t libs = hymn->memory;
+    hymn_add_function(hymn, "fun_for_vm", fun_for_vm);
+
+    if (allocations <= before || libs <= memory || hymn->memory <= libs || hymn->memory_peak < hymn->memory) {
+        printf("incorrent memory: %zu allocations, %zu bytes, %zu peak\n\n", allocations - before, hymn->memory, hymn->memory_peak);
+        tests_fail++;
+    } else {
+        tests_success++;
+    }
+
+    hymn_delete(hymn);
+}
+
+static void test_memory_frozen(void) {
+    tests_count++;
+    printf("memory frozen\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn->memory_limit = 1 << 20;
+    hymn_string_zero(out);
+
+    size_t frozen = hymn_frozen_memory();
+
+    char *error = hymn_do(hymn, "set s = \"0123456789abcdef\"\n"
+                                "for i = 0, i < 14 { s += s }\n"
+                                "set all = []\n"
+                                "try { while true { push(all, freeze([s])) } } except e { echo e[:28] }\n"
+                                "echo len(all) < 8\n"
+                                "all = none");
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+        goto end;
+    }
+
+    hymn_string_trim(out);
+    if (!hymn_string_equal(out, "frozen memory limit exceeded\ntrue")) {
+        printf("incorrent output: <%s>\n\n", out);
+        tests_fail++;
+        goto end;
+    }
+
+    if (hymn_frozen_memory() != frozen) {
+        printf("incorrent frozen memory: %zu bytes, expected %zu\n\n", hymn_frozen_memory(), frozen);
+        tests_fail++;
+        goto end;
+    }
+
+    tests_success++;
+
+end:
+    hymn_delete(hymn);
+}
+
+static void test_thread_limits(void) {
+    tests_count++;
+    printf("thread limits\n");
+    size_t allocations = 0;
+    HymnAllocator allocator = {allocate_for_test, reallocate_for_test, release_for_test, &allocations};
+    Hymn *hymn = new_hymn_with_allocator(&allocator);
+    hymn_use_libs(hymn);
+    hymn->print = console;
+    hymn->memory_limit = 1 << 20;
+    hymn_string_zero(out);
+
+    char *error = NULL;
+    size_t before = 0;
+
+    error = hymn_do(hymn, "func grow() {\n"
+                          "  set a = []\n"
+                          "  while true { push(a, \"item \" + len(a)) }\n"
+                          "}\n"
+                          "try { thread.join(thread.spawn(grow)) } except e { echo e }\n");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_string_trim(out);
+    if (!hymn_string_contains(out, "memory limit exceeded")) {
+        printf("incorrent output: <%s>\n\n", out);
+        tests_fail++;
+        goto end;
+    }
+
+    if (hymn->memory_peak > hymn->memory_limit) {
+        printf("incorrent memory: %zu bytes, %zu peak\n\n", hymn->memory, hymn->memory_peak);
+        tests_fail++;
+        goto end;
+    }
+
+    before = allocations;
+    hymn_string_zero(out);
+
+    error = hymn_do(hymn, "echo thread.map([1, 2, 3], func(n) { return n * 2 })");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_string_trim(out);
+    if (!hymn_string_equal(out, "[2, 4, 6]") || allocations <= before) {
+        printf("incorrent output: <%s> with %zu allocations\n\n", out, allocations - before);
+        tests_fail++;
+        goto end;
+    }
+
+    tests_success++;
+    goto end;
+
+fail:
+    printf("%s\n\n", error);
+    free(error);
+    tests_fail++;
+
+end:
+    hymn_delete(hymn);
+}
+
+static void test_serialize(void) {
+    tests_count++;
+    printf("serialize\n");
+    Hymn *hymn = new_hymn();
+    Hymn *copy = new_hymn();
+    copy->print = console;
+    hymn_string_zero(out);
+
+    HymnString *data = NULL;
+    HymnValue result = hymn_new_none();
+    char *error = NULL;
+
+    error = hymn_do(hymn, "set list = [1, 2.5, \"three\", { four: true }]\nfunc add(a, b) { return [a + b, list] }");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    data = hymn_serialize(hymn_get(hymn, "add"));
+    HymnValue function = hymn_deserialize(copy, data);
+    hymn_reference(function);
+    hymn_string_delete(data);
+
+    hymn_add(copy, "list", hymn_new_string_value(hymn_intern_string(copy, hymn_new_string("copied"))));
+
+    HymnValue arguments[2] = {hymn_new_int(3), hymn_new_int(4)};
+    error = hymn_call_value(copy, function, 2, arguments, &result);
+    hymn_dereference(copy, function);
+    if (error != NULL) {
+        goto fail;
+    }
+
+    data = hymn_serialize(hymn_get(hymn, "list"));
+    HymnValue list = hymn_deserialize(copy, data);
+    hymn_string_delete(data);
+    hymn_add(copy, "list", list);
+
+    hymn_add(copy, "result", result);
+    error = hymn_do(copy, "echo result\necho list");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_string_trim(out);
+    if (!hymn_string_equal(out, "[7, \"copied\"]\n[1, 2.5, \"three\", { \"four\": true }]")) {
+        printf("incorrent output: <%s>\n\n", out);
+        tests_fail++;
+        goto end;
+    }
+
+    tests_success++;
+    goto end;
+
+fail:
+    printf("%s\n\n", error);
+    free(error);
+    tests_fail++;
+
+end:
+    hymn_dereference(copy, result);
+    hymn_delete(copy);
+    hymn_delete(hymn);
+}
+
+static void test_handle(void) {
+    tests_count++;
+    printf("handle\n");
+    Hymn *hymn = new_hymn();
+    HymnHandle *handle = NULL;
+    HymnValue results[3] = {hymn_new_none(), hymn_new_none(), hymn_new_none()};
+    char *error = NULL;
+
+    error = hymn_do(hymn, "func join(a, b, c) { return a + str(b) + str(c) }\nfunc fail() { throw \"handle failed\" }\nfunc pick(n) { if n == 2 { throw \"bad pick\" } return [n] }");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    if (hymn_handle(hymn, "missing") != NULL) {
+        printf("expected null handle\n\n");
+        tests_fail++;
+        goto end;
+    }
+
+    handle = hymn_handle(hymn, "join");
+    for (int i = 0; i < 1000; i++) {
+        hymn_handle_push_string(handle, "x");
+        hymn_handle_push_int(handle, i);
+        hymn_handle_push_bool(handle, true);
+        error = hymn_handle_call(handle);
+        if (error != NULL) {
+            goto fail;
+        }
+    }
+
+    HymnValue result = hymn_handle_result(handle);
+    if (!hymn_is_string(result) || !hymn_string_equal(hymn_as_string(result), "x999true")) {
+        printf("incorrect handle result\n\n");
+        tests_fail++;
+        goto end;
+    }
+
+    HymnValue arguments[9] = {
+        hymn_new_int(1), hymn_new_int(2), hymn_new_int(3),
+        hymn_new_float(0.5), hymn_new_none(), hymn_new_bool(false),
+        hymn_new_int(7), hymn_new_int(8), hymn_new_int(9),
+    };
+    error = hymn_handle_call_batch(handle, 3, 3, arguments, results);
+    if (error != NULL) {
+        goto fail;
+    }
+    if (!hymn_is_string(results[0]) || !hymn_string_equal(hymn_as_string(results[0]), "123") || !hymn_string_equal(hymn_as_string(results[1]), "0.5nonefalse") || !hymn_string_equal(hymn_as_string(results[2]), "789")) {
+        printf("incorrect batch results\n\n");
+        tests_fail++;
+        goto end;
+    }
+
+    bool pushed = true;
+    for (int i = 0; i <= HYMN_HANDLE_ARGUMENTS; i++) {
+        pushed = hymn_handle_push_int(handle, i);
+    }
+    error = hymn_handle_call(handle);
+    if (pushed || error == NULL || strstr(error, "more than") == NULL) {
+        printf("expected handle overflow\n\n");
+        free(error);
+        tests_fail++;
+        goto end;
+    }
+    free(error);
+
+    hymn_handle_push_int(handle, 1);
+    error = hymn_handle_call_batch(handle, 1, 3, arguments, results);
+    if (error == NULL || strstr(error, "pushed arguments") == NULL) {
+        printf("expected batch error with pushed arguments\n\n");
+        free(error);
+        tests_fail++;
+        goto end;
+    }
+    free(error);
+
+    for (int i = 0; i < 3; i++) {
+        hymn_dereference(hymn, results[i]);
+        results[i] = hymn_new_none();
+    }
+    hymn_handle_delete(handle);
+    handle = hymn_handle(hymn, "pick");
+    HymnValue picks[3] = {hymn_new_int(1), hymn_new_int(2), hymn_new_int(3)};
+    error = hymn_handle_call_batch(handle, 3, 1, picks, results);
+    if (error == NULL || strstr(error, "bad pick") == NULL || !hymn_is_none(results[0])) {
+        printf("expected batch error with released results\n\n");
+        free(error);
+        tests_fail++;
+        goto end;
+    }
+    free(error);
+
+    hymn_handle_delete(handle);
+    handle = hymn_handle(hymn, "fail");
+    error = hymn_handle_call(handle);
+    if (error == NULL || strstr(error, "handle failed") == NULL) {
+        printf("expected handle exception\n\n");
+        free(error);
+        tests_fail++;
+        goto end;
+    }
+    free(error);
+
+    tests_success++;
+    goto end;
+
+fail:
+    printf("%s\n\n", error);
+    free(error);
+    tests_fail++;
+
+end:
+    for (int i = 0; i < 3; i++) {
+        hymn_dereference(hymn, results[i]);
+    }
+    if (handle != NULL) {
+        hymn_handle_delete(handle);
+    }
+    hymn_delete(hymn);
+}
+
+static HymnValue nested_apply(Hymn *H, int count, HymnValue *arguments) {
+    HymnValue result;
+    char *error = hymn_call_value(H, arguments[0], count - 1, &arguments[1], &result);
+    if (error != NULL) {
+        HymnValue exception = hymn_new_exception(H, error);
+        free(error);
+        return exception;
+    }
+    return result;
+}
+
+static void test_call_nested(void) {
+    tests_count++;
+    printf("call nested\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    hymn_add_function(hymn, "apply", nested_apply);
+    int before = hymn->stack_capacity;
+    char *error = hymn_do(hymn, "func add(a, b) { return a + b }\n"
+                                "func deep(n) { if n == 0 { return 0 } return 1 + deep(n - 1) }\n"
+                                "func fail() { throw \"nested failed\" }\n"
+                                "set total = 0\n"
+                                "for i = 0, i < 100 { total += apply(add, i, 1) }\n"
+                                "echo total\n"
+                                "echo apply(deep, 500)\n"
+                                "echo apply(apply, add, 2, 3)\n"
+                                "try { apply(fail) } except e { echo \"caught\" }\n"
+                                "echo apply(add, 4, 5)");
+
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+    } else if (!hymn_string_equal(out, "5050\n500\n5\ncaught\n9\n")) {
+        printf("incorrent output: <%s>\n\n", out);
+        tests_fail++;
+    } else if ((error = hymn_do(hymn, "apply(fail)")) == NULL || strstr(error, "nested failed") == NULL) {
+        printf("expected nested exception: <%s>\n\n", error);
+        free(error);
+        tests_fail++;
+    } else if (hymn->stack_capacity <= before || hymn->frame_count != 0 || hymn->stack_top != hymn->stack) {
+        printf("expected nested calls to grow and unwind the shared stack\n\n");
+        free(error);
+        tests_fail++;
+    } else {
+        free(error);
+        tests_success++;
+    }
+
+    hymn_delete(hymn);
+}
+
+static HymnValue typed_repeat(Hymn *H, int count, HymnValue *arguments) {
+    (void)count;
+    HymnString *string = hymn_new_string("");
+    for (HymnInt i = 0; i < hymn_as_int(arguments[0]); i++) {
+        string = hymn_string_append(string, hymn_as_string(arguments[1]));
+    }
+    return hymn_new_string_value(hymn_intern_string(H, string));
+}
+
+static void test_typed(void) {
+    tests_count++;
+    printf("typed\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    hymn_add_function_typed(hymn, "repeat", typed_repeat, "is");
+    hymn_add_function_typed(hymn, "repeat_any", typed_repeat, "iv");
+
+    char *error = hymn_do(hymn, "echo repeat(3, \"ab\")\n"
+                                "echo repeat_any(2, \"cd\")\n"
+                                "try { repeat(\"ab\", 3) } except e { echo e[:index(e, \"\\n\")] }\n"
+                                "try { repeat(3) } except e { echo e[:index(e, \"\\n\")] }");
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+        goto end;
+    }
+
+    hymn_string_trim(out);
+    if (!hymn_string_equal(out, "ababab\ncdcd\nexpected type: integer for argument 1 but was: string\nexpected: 2 function argument(s) but was: 1")) {
+        printf("incorrent output: <%s>\n\n", out);
+        tests_fail++;
+        goto end;
+    }
+
+    tests_success++;
+
+end:
+    hymn_delete(hymn);
+}
+
+static void test_reset(void) {
+    tests_count++;
+    printf("reset\n");
+    Hymn *hymn = new_hymn();
+    hymn_use_libs(hymn);
+    hymn->print = console;
+
+    char *error = hymn_do(hymn, "set config = {limits: {depth: 1}, names: [\"a\"]}");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_capture(hymn);
+
+    size_t memory = 0;
+
+    for (int i = 0; i < 20; i++) {
+        hymn_string_zero(out);
+        error = hymn_do(hymn, "echo exists(GLOBALS, \"counter\")\n"
+                              "echo str(config.limits.depth) + \" \" + str(len(config.names))\n"
+                              "set counter = [1, 2, 3]\n"
+                              "math.sqrt = none\n"
+                              "config.limits.depth = 5\n"
+                              "push(config.names, \"b\")\n"
+                              "push(PATHS, \"<path>.extra\")\n"
+                              "echo math.floor(2.5)");
+        if (error != NULL) {
+            goto fail;
+        }
+        hymn_string_trim(out);
+        if (!hymn_string_equal(out, "false\n1 1\n2")) {
+            printf("incorrent output: <%s>\n\n", out);
+            tests_fail++;
+            goto end;
+        }
+        hymn_reset(hymn);
+        if (i == 1) {
+            memory = hymn->memory;
+        } else if (i > 1 && hymn->memory != memory) {
+            printf("memory grew after reset: %zu to %zu\n\n", memory, hymn->memory);
+            tests_fail++;
+            goto end;
+        }
+    }
+
+    hymn_string_zero(out);
+    error = hymn_do(hymn, "echo math.sqrt(16)\necho len(PATHS)");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_string_trim(out);
+    if (!hymn_string_equal(out, "4\n6") && !hymn_string_equal(out, "4\n3")) {
+        printf("incorrent output: <%s>\n\n", out);
+        tests_fail++;
+        goto end;
+    }
+
+    hymn_reset(hymn);
+    hymn_set_budget(hymn, 1000, NULL, NULL);
+    hymn_capture(hymn);
+    hymn_string_zero(out);
+    error = hymn_do(hymn, "func f() {}\nfor i = 0, i < 400 { f() }\necho \"spent\"");
+    if (error != NULL) {
+        goto fail;
+    }
+    hymn_interrupt(hymn);
+    hymn_reset(hymn);
+    error = hymn_do(hymn, "func f() {}\nfor i = 0, i < 400 { f() }\necho \"again\"");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_string_trim(out);
+    if (!hymn_string_equal(out, "spent\nagain")) {
+        printf("incorrent output: <%s>\n\n", out);
+        tests_fail++;
+        goto end;
+    }
+
+    tests_success++;
+    goto end;
+
+fail:
+    printf("%s\n\n", error);
+    free(error);
+    tests_fail++;
+
+end:
+    hymn_delete(hymn);
+}
+
+static int budget_calls = 0;
+
+static enum HymnBudget budget_count(Hymn *H, void *user) {
+    (void)H;
+    (void)user;
+    budget_calls++;
+    return HYMN_BUDGET_CONTINUE;
+}
+
+static enum HymnBudget budget_yield(Hymn *H, void *user) {
+    (void)H;
+    (void)user;
+    return HYMN_BUDGET_YIELD;
+}
+
+static void test_budget(void) {
+    tests_count++;
+    printf("budget\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    char *error = NULL;
+
+    hymn_set_budget(hymn, 1000, NULL, NULL);
+    error = hymn_do(hymn, "try { while true { } } except e { echo e[:index(e, \"\\n\")] }");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_set_budget(hymn, 100, budget_count, NULL);
+    error = hymn_do(hymn, "set n = 0\nfor i = 0, i < 1000 { n += 1 }\necho n");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_set_budget(hymn, 10, budget_yield, NULL);
+    error = hymn_do(hymn, "set counter = 0\n"
+                          "set spin = coroutine.new(func() { while true { counter += 1 } })\n"
+                          "for i = 0, i < 3 { coroutine.resume(spin) }\n"
+                          "echo counter > 0\n"
+                          "echo coroutine.status(spin)");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    error = hymn_do(hymn, "try { while true { } } except e { echo e[:index(e, \"\\n\")] }");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    hymn_set_budget(hymn, 0, NULL, NULL);
+
+    hymn_string_trim(out);
+    if (!hymn_string_equal(out, "budget exceeded\n1000\ntrue\nsuspended\nbudget exceeded") || budget_calls < 9 || budget_calls > 11) {
+        printf("incorrent output: <%s> after %d calls\n\n", out, budget_calls);
+        tests_fail++;
+        goto end;
+    }
+
+    tests_success++;
+    goto end;
+
+fail:
+    printf("%s\n\n", error);
+    free(error);
+    tests_fail++;
+
+end:
+    hymn_delete(hymn);
+}
+
+static void test_profile(void) {
+    tests_count++;
+    printf("profile\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    if (!hymn_profile_start(hymn, 100)) {
+        tests_success++;
+        hymn_delete(hymn);
+        return;
+    }
+
+    char *error = hymn_do(hymn, "func spin(n) {\n"
+                                "  set s = 0\n"
+                                "  for i = 0, i < n { s += i }\n"
+                                "  return s\n"
+                                "}\n"
+                                "echo spin(5000000)");
+    hymn_profile_stop();
+
+    HymnString *folded = hymn_profile_folded(hymn);
+    hymn_profile_clear(hymn);
+
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+    } else if (strstr(folded, ";spin:3 ") == NULL) {
+        printf("incorrent profile: <%s>\n\n", folded);
+        tests_fail++;
+    } else {
+        tests_success++;
+    }
+
+    hymn_string_delete(folded);
+    hymn_delete(hymn);
+}
+
+static void test_allocations(void) {
+    tests_count++;
+    printf("allocations\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    hymn_allocations_start(hymn);
+    char *error = hymn_do(hymn, "func churn(n) {\n"
+                                "  set s = \"\"\n"
+                                "  for i = 0, i < n { s += \"x{i}\" }\n"
+                                "  return s\n"
+                                "}\n"
+                                "echo len(churn(1000))");
+    hymn_allocations_stop(hymn);
+
+    HymnString *report = hymn_allocations_report(hymn, 1);
+    hymn_allocations_clear(hymn);
+
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+    } else if (strstr(report, "string     :3 churn") == NULL) {
+        printf("incorrent allocations: <%s>\n\n", report);
+        tests_fail++;
+    } else {
+        tests_success++;
+    }
+
+    hymn_string_delete(report);
+    hymn_delete(hymn);
+}
+
+static int trace_counts[3];
+
+static void trace_count(Hymn *H, enum HymnTrace event, HymnFunction *func, int line, void *user) {
+    (void)H;
+    (void)user;
+    if (func->name != NULL && hymn_string_equal(func->name, "add")) {
+        trace_counts[event >> 1]++;
+        if (event == HYMN_TRACE_LINE && line != 2 && line != 3) {
+            trace_counts[2] = -1000;
+        }
+    }
+}
+
+static void test_trace(void) {
+    tests_count++;
+    printf("trace\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    memset(trace_counts, 0, sizeof(trace_counts));
+    hymn_set_tracer(hymn, trace_count, HYMN_TRACE_CALL | HYMN_TRACE_RETURN | HYMN_TRACE_LINE, NULL);
+
+    char *error = hymn_do(hymn, "func add(a, b) {\n"
+                                "  set c = a + b\n"
+                                "  return c\n"
+                                "}\n"
+                                "func fail() { throw \"error\" }\n"
+                                "set total = 0\n"
+                                "for i = 0, i < 10 { total = add(total, i) }\n"
+                                "try { fail() } except e { total += 1 }\n"
+                                "echo total");
+    hymn_set_tracer(hymn, NULL, 0, NULL);
+
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+    } else if (!hymn_string_equal(out, "46\n") || trace_counts[0] != 10 || trace_counts[1] != 10 || trace_counts[2] != 20) {
+        printf("incorrent trace: calls %d, returns %d, lines %d\n\n", trace_counts[0], trace_counts[1], trace_counts[2]);
+        tests_fail++;
+    } else {
+        tests_success++;
+    }
+
+    hymn_delete(hymn);
+}
+
+static void test_compile_stats(void) {
+    tests_count++;
+    printf("compile stats\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    hymn_compile_stats_track(hymn, true);
+
+    char *error = hymn_do(hymn, "func square(x) { return x * x }\n"
+                                "echo square(4)");
+
+    HymnCompileStats *stats = hymn->compile_stats;
+    HymnString *report = hymn_compile_stats(hymn);
+
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+    } else if (stats == NULL || stats->next != NULL || stats->functions != 2 || stats->optimized == 0 || stats->optimized > stats->bytes || stats->constants == 0 || strstr(report, "total") == NULL) {
+        printf("incorrent compile stats: <%s>\n\n", report);
+        tests_fail++;
+    } else {
+        tests_success++;
+    }
+
+    hymn_string_delete(report);
+    hymn_delete(hymn);
+}
+
+static void test_compile_stats_deferred(void) {
+    tests_count++;
+    printf("compile stats deferred\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    hymn_compile_stats_track(hymn, true);
+
+    HymnCompileStats *module = NULL;
+    size_t bytes = 0;
+    int functions = 0;
+    int64_t parse = 0;
+
+    char *error = hymn_do(hymn, "use \"test/language/use/lazy_module\"");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    for (HymnCompileStats *stats = hymn->compile_stats; stats != NULL; stats = stats->next) {
+        if (strstr(stats->script, "lazy_module") != NULL) {
+            module = stats;
+        }
+    }
+    if (module == NULL) {
+        printf("missing module compile stats\n\n");
+        tests_fail++;
+        goto end;
+    }
+
+    bytes = module->bytes;
+    functions = module->functions;
+    parse = module->parse;
+
+    error = hymn_do(hymn, "echo greet(\"stats\")");
+    if (error != NULL) {
+        goto fail;
+    }
+
+    if (module->functions != functions + 1 || module->bytes <= bytes || module->parse < parse) {
+        printf("deferred body not counted: %d functions, %zu bytes\n\n", module->functions, module->bytes);
+        tests_fail++;
+        goto end;
+    }
+
+    tests_success++;
+    goto end;
+
+fail:
+    printf("%s\n\n", error);
+    free(error);
+    tests_fail++;
+
+end:
+    hymn_delete(hymn);
+}
+
+static void test_line_table(void) {
+    tests_count++;
+    printf("line table\n");
+    Hymn *hymn = new_hymn();
+    Hymn *copy = new_hymn();
+    copy->print = console;
+    hymn_string_zero(out);
+
+    char *error = hymn_do(hymn, "func f(a) {\n"
+                                "  set b = 1\n"
+                                "\n"
+                                "  set c = a + b\n"
+                                "  return c - none\n"
+                                "}");
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+        goto end;
+    }
+
+    HymnString *data = hymn_serialize(hymn_get(hymn, "f"));
+    HymnValue function = hymn_deserialize(copy, data);
+    hymn_reference(function);
+    hymn_string_delete(data);
+
+    HymnValue result = hymn_new_none();
+    HymnValue arguments[1] = {hymn_new_int(1)};
+    error = hymn_call_value(copy, function, 1, arguments, &result);
+    hymn_dereference(copy, function);
+
+    if (error == NULL || strstr(error, "at f script:5") == NULL) {
+        printf("incorrent line: <%s>\n\n", error == NULL ? "" : error);
+        tests_fail++;
+    } else {
+        tests_success++;
+    }
+    free(error);
+
+end:
+    hymn_delete(hymn);
+    hymn_delete(copy);
+}
+
+static void test_precompile(void) {
+    tests_count++;
+    printf("precompile\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    const char *script = "test" PATH_SEP_STRING "language" PATH_SEP_STRING "use" PATH_SEP_STRING "use_lazy.hm";
+
+    int count = hymn_precompile(hymn, script, 1);
+    int cached = hymn->precompiled.size;
+
+    char *error = hymn_script(hymn, script);
+
+    HymnString *source = hymn_read_file(script);
+    HymnString *expected = parse_expected(source);
+    hymn_string_trim(out);
+
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+    } else if (count != 2 || cached != 2 || hymn->precompiled.size != 0 || !hymn_string_equal(out, expected)) {
+        printf("incorrent precompile: %d modules, %d remaining: <%s>\n\n", count, hymn->precompiled.size, out);
+        tests_fail++;
+    } else {
+        tests_success++;
+    }
+
+    hymn_string_delete(source);
+    hymn_string_delete(expected);
+    hymn_delete(hymn);
+}
+
+static bool write_file(const char *path, const char *content) {
+    FILE *open = fopen(path, "w");
+    if (open == NULL) {
+        return false;
+    }
+    fputs(content, open);
+    fclose(open);
+    return true;
+}
+
+static void test_precompile_stale(void) {
+    tests_count++;
+    printf("precompile stale\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    const char *script = "test-precompile-main.hm";
+    const char *module = "test-precompile-module.hm";
+
+    char *error = NULL;
+    int count = 0;
+    int cached = 0;
+
+    if (!write_file(script, "use \"test-precompile-module\"\necho value()\n") || !write_file(module, "func value() { return 1 }\n")) {
+        printf("failed to write precompile test files\n\n");
+        tests_fail++;
+        goto end;
+    }
+
+    count = hymn_precompile(hymn, script, 1);
+    cached = hymn->precompiled.size;
+
+    write_file(module, "func value() { return 22 }\n");
+
+    error = hymn_script(hymn, script);
+    hymn_string_trim(out);
+
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+    } else if (count != 1 || cached != 1 || hymn->precompiled.size != 0 || !hymn_string_equal(out, "22")) {
+        printf("incorrent stale precompile: %d modules, %d remaining: <%s>\n\n", count, hymn->precompiled.size, out);
+        tests_fail++;
+    } else {
+        tests_success++;
+    }
+
+end:
+    remove(script);
+    remove(module);
+    hymn_delete(hymn);
+}
+
+static void test_census(void) {
+    tests_count++;
+    printf("census\n");
+    Hymn *hymn = new_hymn();
+    hymn->print = console;
+    hymn_string_zero(out);
+
+    hymn_census_track(hymn, true);
+
+    char *error = hymn_do(hymn, "set numbers = [1, 2, 3]\n"
+                                "set cycle = {}\n"
+                                "cycle.self = cycle");
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+        tests_fail++;
+        hymn_delete(hymn);
+        return;
+    }
+
+    HymnValue cycle = hymn_get(hymn, "cycle");
+    hymn_reference(cycle);
+
+    error = hymn_do(hymn, "cycle = none");
+    if (error != NULL) {
+        printf("%s\n\n", error);
+        free(error);
+    }
+
+    HymnString *report = hymn_census(hymn);
+
+    if (strstr(report, "\nnumbers ") == NULL || strstr(report, "keys [self]") == NULL) {
+        printf("incorrent census: <%s>\n\n", report);
+        tests_fail++;
+    } else {
+        tests_success++;
+    }
+
+    hymn_string_delete(report);
+    hymn_set_property_const(hymn, hymn_as_table(cycle), "self", hymn_new_none());
+    hymn_dereference(hymn, cycle);
+    hymn_delete(hymn);
 }
 
 static void test_dynamic_library(void) {
@@ -356,6 +1415,84 @@ static void test_hymn(const char *filter) {
         test_api();
     }
 
+    if (filter == NULL || hymn_string_equal(filter, "memory")) {
+        test_memory();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "memory refused")) {
+        test_memory_refused();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "memory libs")) {
+        test_memory_libs();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "memory frozen")) {
+        test_memory_frozen();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "thread limits")) {
+        test_thread_limits();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "serialize")) {
+        test_serialize();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "handle")) {
+        test_handle();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "call nested")) {
+        test_call_nested();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "typed")) {
+        test_typed();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "reset")) {
+        test_reset();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "budget")) {
+        test_budget();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "profile")) {
+        test_profile();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "allocations")) {
+        test_allocations();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "trace")) {
+        test_trace();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "stats")) {
+        test_compile_stats();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "compile stats deferred")) {
+        test_compile_stats_deferred();
+    }
+    if (filter == NULL || hymn_string_equal(filter, "lines")) {
+        test_line_table();
+    }
+    if (filter == NULL || hymn_string_equal(filter, "precompile")) {
+        test_precompile();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "precompile stale")) {
+        test_precompile_stale();
+    }
+
+    if (filter == NULL || hymn_string_equal(filter, "census")) {
+        test_census();
+    }
+
     if (filter == NULL || hymn_string_equal(filter, "dynamic")) {
         test_dynamic_library();
         test_direct_dynamic_library();